@@ -25,24 +25,32 @@
  */
 
 
+#include <string.h>
+#include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <math.h>
+#include <sched.h>
+#include <time.h>
 #include <sys/errno.h>
+#include <sys/mman.h>
 #include <libltnsdi/ltnsdi.h>
 #include <libltnsdi/smpte338.h>
 
 #include "ltnsdi-private.h"
+#include "audio_kernels.h"
+#include "realtime.h"
 
 __inline__ static enum sdiaudio_channel_type_e sdiaudio_channel_getType(struct sdiaudio_channel_s *ch)
 {
 	/* Lets have a centralized place so we can adjust date/times for queries etc. */
-	return ch->type;
+	return sdiaudio_hot(ch, type);
 }
 
-static void sdiaudio_channel_setType(struct sdiaudio_channel_s *ch, enum sdiaudio_channel_type_e type)
+static void sdiaudio_channel_setType(struct sdiaudio_channel_s *ch, enum sdiaudio_channel_type_e type,
+	const struct timeval *now)
 {
-	if (ch->type == type && type != AUDIO_TYPE_UNDEFINED)
+	if (sdiaudio_hot(ch, type) == type && type != AUDIO_TYPE_UNDEFINED)
 		return;
 
 	if (type != AUDIO_TYPE_UNUSED) {
@@ -52,7 +60,7 @@ static void sdiaudio_channel_setType(struct sdiaudio_channel_s *ch, enum sdiaudi
 	if (type != AUDIO_TYPE_PCM) {
 		ch->pcm.samplesWritten = 0;
 		ch->pcm.sampleRateHz = 0;
-		ch->pcm.dbFS = 0.0;
+		sdiaudio_hot(ch, dbFS) = 0.0;
 	}
 
 	if (type != AUDIO_TYPE_SMPTE337) {
@@ -61,438 +69,1805 @@ static void sdiaudio_channel_setType(struct sdiaudio_channel_s *ch, enum sdiaudi
 		/* Undefined State */
 	}
 
-	ch->type = type;
-	gettimeofday(&ch->type_last_update, NULL);
+	/* Nothing left for a detector to lock to, give up any stream and the burst buffer that came with it. */
+	if (type == AUDIO_TYPE_UNUSED && sdiaudio_hot(ch, detector))
+		smpte337_detector_reset(sdiaudio_hot(ch, detector));
+
+	sdiaudio_hot(ch, type) = type;
+	ch->type_last_update = *now;
+}
+
+__inline__ void sdiaudio_channel_statsUpdate(struct sdiaudio_channel_s *ch, const struct timeval *now)
+{
+	switch (sdiaudio_hot(ch, type)) {
+	case AUDIO_TYPE_UNUSED:
+		ch->unused.unusedSampleCount++;
+		ch->unused.last_update = *now;
+		break;
+	case AUDIO_TYPE_SMPTE337:
+		ch->smpte337.framesWritten++;
+		ch->smpte337.last_update = *now;
+		sdiaudio_hot(ch, lastActive) = now->tv_sec;
+		break;
+	case AUDIO_TYPE_PCM:
+		ch->pcm.samplesWritten++;
+		ch->pcm.last_update = *now;
+		sdiaudio_hot(ch, lastActive) = now->tv_sec;
+		break;
+	case AUDIO_TYPE_UNDEFINED:
+		break;
+	}
+}
+
+__inline__ int16_t be_s16(int16_t n)
+{
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN 
+    return (int16_t)(((uint16_t)n >> 8) | ((uint16_t)n << 8));
+#elif G_BYTE_ORDER == G_BIG_ENDIAN
+    return n;
+#else
+#error "G_BYTE_ORDER should be big or little endian."
+#endif
+}
+
+static const char *sdiaudio_channel_type_name(enum sdiaudio_channel_type_e e)
+{
+	switch (e) {
+	default:
+	case AUDIO_TYPE_UNDEFINED: return "UNDEFINED";
+	case AUDIO_TYPE_SMPTE337:  return "SMPTE337";
+	case AUDIO_TYPE_PCM:       return "PCM";
+	case AUDIO_TYPE_UNUSED:    return "UNUSED";
+	}
+};
+
+/* The type as reported to callers, 1 = PCM, 2 = SMPTE 337, 3 = UNUSED. */
+static uint32_t sdiaudio_channel_type_public(enum sdiaudio_channel_type_e e)
+{
+	switch (e) {
+	case AUDIO_TYPE_PCM:      return 1;
+	case AUDIO_TYPE_SMPTE337: return 2;
+	default:
+	case AUDIO_TYPE_UNUSED:   return 3;
+	}
+}
+
+static __inline__ void incrementChannelBitsPs(struct ltnsdi_context_s *ctx, struct sdiaudio_channel_s *ch, uint64_t bitCount,
+	const struct timeval *now)
+{
+	if (!ch->group->hot.housekept && now->tv_sec != sdiaudio_hot(ch, bitsNowTime)) {
+		sdiaudio_hot(ch, bitsPsCurrent) = sdiaudio_hot(ch, bitsNow);
+		sdiaudio_hot(ch, bitsNow) = 0;
+		sdiaudio_hot(ch, bitsNowTime) = now->tv_sec;
+	}
+
+	sdiaudio_hot(ch, bitsNow) += bitCount;
+}
+
+/* Publish the groups current statistics for status readers. Must hold the group mutex,
+ * which guarantees a single writer. Nothing here formats or allocates, keep it cheap.
+ */
+static void sdiaudio_snapshot_publish(struct sdiaudio_group_s *grp)
+{
+	struct sdiaudio_snapshot_s *snap = &grp->snapshot;
+	uint32_t seq = snap->seq;
+
+	__atomic_store_n(&snap->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	for (int i = 0; i < SDI_AUDIO_CHANNELS; i++) {
+		struct sdiaudio_channel_s *ch = &grp->ch[i];
+		struct sdiaudio_channel_snapshot_s *s = &snap->ch[i];
+
+		s->groupNr = ch->groupNr;
+		s->channelNr = ch->channelNr;
+		s->wordLength = sdiaudio_hot(ch, wordLength);
+		s->type = sdiaudio_hot(ch, type);
+		s->type_last_update = ch->type_last_update;
+		s->bitsPsCurrent = sdiaudio_hot(ch, bitsPsCurrent);
+		s->dbFS = sdiaudio_hot(ch, dbFS);
+		s->missingAudioCount = ch->pcm.missingAudioCount;
+		s->dataType = ch->smpte337.dataType;
+		s->dataMode = ch->smpte337.dataMode;
+		s->burstPeriod = 0;
+		s->burstJitter = 0;
+		s->burstTracking = 0;
+		s->burstMispredictions = 0;
+		if (grp->hot.detector[i]) {
+			int tracking = smpte337_detector_period(grp->hot.detector[i], &s->burstPeriod, &s->burstJitter,
+				&s->burstMispredictions);
+			s->burstTracking = tracking > 0;
+		}
+
+		switch (sdiaudio_hot(ch, type)) {
+		case AUDIO_TYPE_PCM:
+			s->buffersProcessed = ch->pcm.samplesWritten;
+			s->lastBufferArrival = ch->pcm.last_update;
+			break;
+		case AUDIO_TYPE_SMPTE337:
+			s->buffersProcessed = ch->smpte337.framesWritten;
+			s->lastBufferArrival = ch->smpte337.last_update;
+			break;
+		default:
+			s->buffersProcessed = ch->unused.unusedSampleCount;
+			s->lastBufferArrival = ch->unused.last_update;
+			break;
+		}
+	}
+
+	snap->memory.scratchBytes = grp->scratchSize + grp->payloadSize;
+	snap->memory.detectorBytes = 0;
+	snap->memory.detectorBuffers = 0;
+	for (int c = 0; c < SDI_AUDIO_CHANNELS; c++) {
+		struct smpte337_detector_s *d = grp->hot.detector[c];
+		if (d) {
+			snap->memory.detectorBytes += smpte337_detector_memory(d);
+			snap->memory.detectorBuffers += d->carry != NULL;
+		}
+	}
+
+	__atomic_store_n(&snap->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Take a consistent copy of the groups published statistics, without blocking the writer. */
+static void sdiaudio_snapshot_read(struct sdiaudio_group_s *grp, struct sdiaudio_channel_snapshot_s *dst,
+	struct sdiaudio_group_memory_s *memory)
+{
+	struct sdiaudio_snapshot_s *snap = &grp->snapshot;
+	uint32_t seq0, seq1;
+
+	do {
+		seq0 = __atomic_load_n(&snap->seq, __ATOMIC_ACQUIRE);
+		if (seq0 & 1) {
+			/* Writer mid update, it's only copying a few hundred bytes. */
+			sched_yield();
+			continue;
+		}
+		memcpy(dst, &snap->ch[0], sizeof(snap->ch));
+		*memory = snap->memory;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq1 = __atomic_load_n(&snap->seq, __ATOMIC_RELAXED);
+	} while ((seq0 & 1) || (seq0 != seq1));
+}
+
+/* Make sure the groups scratch area can hold at least size bytes.
+ * Only grows, so once we've seen the largest packet the write path never allocates again.
+ */
+static int sdiaudio_scratch_reserve(struct sdiaudio_group_s *grp, size_t size)
+{
+	if (size <= grp->scratchSize)
+		return 0;
+
+	/* Real-time mode refuses the packet rather than allocate. */
+	if (grp->realtime)
+		return -1;
+
+	ltnsdi_realtime_check("heap allocation");
+	uint8_t *p = realloc(grp->scratch, size);
+	if (!p)
+		return -1;
+
+	grp->scratch = p;
+	grp->scratchSize = size;
+	return 0;
+}
+
+/* 16bit big endian containers. */
+static void analyzeChannels_16b(struct sdiaudio_channel_analysis_s *a, const uint8_t *buf,
+	uint32_t audioFrames, uint32_t channelsPerFrame, uint32_t frameStrideBytes)
+{
+	memset(a, 0, channelsPerFrame * sizeof(*a));
+
+	for (int i = 0; i < audioFrames; i++) {
+		const int16_t *p = (const int16_t *)(buf + (i * frameStrideBytes));
+
+		for (int c = 0; c < channelsPerFrame; c++) {
+			int16_t s = be_s16(p[c]);
+			int32_t x = abs(s);
+			uint32_t isZero = (p[c] == 0);
+
+			if (x > a[c].largestSample)
+				a[c].largestSample = x;
+			a[c].bitMask |= (uint16_t)s;
+			a[c].zeroCount += isZero;
+			a[c].zeroRunTrailing = (a[c].zeroRunTrailing + 1) * isZero;
+			if (a[c].zeroRunTrailing > a[c].zeroRunLongest)
+				a[c].zeroRunLongest = a[c].zeroRunTrailing;
+		}
+	}
+}
+
+static void *detector_callback(void *userContext,
+	struct smpte337_detector_s *ctx,
+	uint8_t datamode, uint8_t datatype, uint32_t payload_bitCount, uint8_t *payload)
+{
+	struct sdiaudio_channel_s *ch = (struct sdiaudio_channel_s *)userContext;
+	const struct timeval *now = &ch->group->now;
+
+#if 0
+	printf("libltnsdi:%s() groupnr: %d channelnr: %d datamode = %d [%dbit], datatype = %d [payload: %s]"
+		", payload_bitcount = %d, payload = %p\n",
+		__func__,
+		ch->groupNr,
+		ch->channelNr,
+		datamode, smpte338_lookupDataMode(datamode),
+		datatype, smpte338_lookupDataTypeDescription(datatype),
+		payload_bitCount,
+		payload);
+#endif
+
+	if (sdiaudio_channel_getType(ch) == AUDIO_TYPE_PCM) {
+		/* PCM removal alert */
+	}
+
+	sdiaudio_hot(ch, wordLength) = smpte338_lookupDataMode(datamode);
+	ch->smpte337.dataType = datatype;
+	ch->smpte337.dataMode = datamode;
+
+	sdiaudio_channel_setType(ch, AUDIO_TYPE_SMPTE337, now);
+	sdiaudio_channel_statsUpdate(ch, now);
+	incrementChannelBitsPs(NULL, ch, payload_bitCount, now);
+	sdiaudio_hot(ch, bursts)++;
+
+	if (sdiaudio_channel_getType(ch->pairedChannel) != AUDIO_TYPE_SMPTE337) {
+		sdiaudio_channel_setType(ch->pairedChannel, AUDIO_TYPE_SMPTE337, now);
+		ch->pairedChannel->smpte337.dataType = datatype;
+		ch->pairedChannel->smpte337.dataMode = datamode;
+	}
+	sdiaudio_channel_statsUpdate(ch->pairedChannel, now);
+	incrementChannelBitsPs(NULL, ch->pairedChannel, payload_bitCount, now);
+
+#if 0
+	if (ctx->spanCount == 2) {
+		sdiaudio_channel_setType(ch->pairedChannel, AUDIO_TYPE_UNUSED, now);
+	}
+#endif
+
+	/* SMPTE 337 Discovery alert. */
+
+	return 0;
+}
+
+static void genericDumpAudioPayload(const uint8_t *data, int sampleFrameCount, int audioChannelCount, int audioSampleDepth,
+	uint32_t frameStrideBytes)
+{
+	assert(audioSampleDepth == 32);
+
+	for (int s = 0; s < sampleFrameCount; s++) {
+		const uint32_t *p = (const uint32_t *)(data + (s * frameStrideBytes));
+		printf("%06d : ", s);
+		for (int i = 0; i < audioChannelCount; i++) {
+			printf("%08x ", *p);
+			p++;
+		}
+		printf("\n");
+	}
+	printf("\n\n");
+
+}
+
+static void checkForSilence(struct sdiaudio_channel_s *ch, const struct sdiaudio_channel_analysis_s *a,
+	const uint8_t *data, int sampleFrameCount,
+	int channelNr, int audioChannelCount, int audioSampleDepth, uint32_t frameStrideBytes, const struct timeval *now)
+{
+	/* A fully silent buffer extends the current run, otherwise the run restarts
+	 * from whatever silence trails the buffer.
+	 */
+	if (a->zeroCount == sampleFrameCount)
+		sdiaudio_hot(ch, sequentialAudioSilence) += sampleFrameCount;
+	else
+		sdiaudio_hot(ch, sequentialAudioSilence) = a->zeroRunTrailing;
+
+	int silence = a->zeroCount;
+	if (silence > sdiaudio_hot(ch, audioPCMLossLimit)) {
+		ch->pcm.missingAudioCount++;
+		if (ch->analyzePCMConsoleDump && !ch->group->realtime) {
+			ltnsdi_realtime_check("stdio");
+			time_t t = now->tv_sec;
+			printf("\n\nSilence detected on channel %d (count #%d limit #%d) @ %s\n",
+				channelNr, silence, sdiaudio_hot(ch, audioPCMLossLimit), ctime(&t));
+			if (channelNr == 0 && data) {
+				genericDumpAudioPayload(data, sampleFrameCount, audioChannelCount, audioSampleDepth, frameStrideBytes);
+			}
+		}
+	}
+}
+
+/* What the built in analyzers are handed, the callers view of a block plus where it came from. */
+struct sdiaudio_block_s
+{
+	struct ltnsdi_analyzer_block_s block;
+	const struct sdiaudio_write_s *w;
+	const struct sdiaudio_channel_analysis_s *a;
+};
+
+/* The built in analyzers keep their state in the channel itself. */
+static int sdiaudio_builtin_init(void *userContext, uint32_t channelNr, void **channelState)
+{
+	struct sdiaudio_group_s *grp = userContext;
+
+	*channelState = &grp->ch[channelNr % SDI_AUDIO_CHANNELS];
+	return 0;
+}
+
+/* PCM loss, for channels with ltnsdi_audio_channels_analyze_pcm_enable(). */
+static void sdiaudio_silence_block(void *channelState, const struct ltnsdi_analyzer_block_s *block)
+{
+	struct sdiaudio_channel_s *ch = channelState;
+	const struct sdiaudio_block_s *b = (const struct sdiaudio_block_s *)block;
+
+	if (!sdiaudio_hot(ch, analyzePCM) || block->sampleDepth != 32)
+		return;
+
+	checkForSilence(ch, b->a, b->w->planes ? NULL : (const uint8_t *)b->w->buf, block->audioFrames, block->channelNr,
+		b->w->channelsPerFrame, block->sampleDepth, b->w->frameStrideBytes, &ch->group->now);
+}
+
+static const struct ltnsdi_analyzer_s sdiaudio_analyzer_silence = {
+	.name = "silence",
+	.init = sdiaudio_builtin_init,
+	.block = sdiaudio_silence_block,
+};
+
+/* Generate a dbFS measurement for PCM channels. Where maximum power is 0dbFS, and minimum is -90dbFS. */
+static void sdiaudio_dbfs_block(void *channelState, const struct ltnsdi_analyzer_block_s *block)
+{
+	struct sdiaudio_channel_s *ch = channelState;
+	struct sdiaudio_group_hot_s *hot = &ch->group->hot;
+	int c = ch->channelNr;
+
+	if (hot->type[c] != AUDIO_TYPE_PCM || (hot->shed & (1 << LTNSDI_SHED_DBFS)))
+		return;
+
+	/* The bitwidth the channel pass rounded the largest sample to. */
+	uint32_t bits = hot->wordLength[c];
+	double x = block->peak;
+	if (bits <= 16) {
+		/* 16 bit */
+		hot->dbFS[c] = 20 * log10( x / 32767.0);
+	} else
+	if (bits <= 20) {
+		/* TODO: Test this. */
+		/* 20bit */
+		hot->dbFS[c] = 20 * log10( x / 524287.0);
+	} else
+	if (bits <= 24) {
+		/* TODO: Test this. */
+		/* 24bit */
+		hot->dbFS[c] = 20 * log10( x / 8388607.0);
+	} else
+	if (bits <= 32) {
+		/* TODO: Test this. */
+		/* 32bit */
+		hot->dbFS[c] = 20 * log10( x / 2147483647.0);
+	}
+
+//	printf("g%dc%d: %.03fdbFS largest: %08x\n", ch->groupNr, ch->channelNr, hot->dbFS[c], block->peak);
+}
+
+static const struct ltnsdi_analyzer_s sdiaudio_analyzer_dbfs = {
+	.name = "dbfs",
+	.init = sdiaudio_builtin_init,
+	.block = sdiaudio_dbfs_block,
+};
+
+/* Call an analyzer's finalize for each of its channels in the group. */
+static void sdiaudio_module_finalize(struct sdiaudio_group_s *grp, struct sdiaudio_module_s *mod)
+{
+	for (int c = 0; c < SDI_AUDIO_CHANNELS; c++) {
+		if ((mod->mask & (1 << c)) && mod->analyzer->finalize)
+			mod->analyzer->finalize(mod->state[c], ((grp->groupNr - 1) * SDI_AUDIO_CHANNELS) + c);
+	}
+}
+
+/* Run an analyzer on the groups channels in mask, after those already added. Must hold the group mutex. */
+static int sdiaudio_group_module_add(struct sdiaudio_group_s *grp, const struct ltnsdi_analyzer_s *analyzer,
+	void *userContext, uint32_t mask)
+{
+	if (grp->moduleCount >= SDI_AUDIO_MODULES_MAX)
+		return -1;
+
+	struct sdiaudio_module_s *mod = &grp->module[grp->moduleCount];
+	memset(mod, 0, sizeof(*mod));
+	mod->analyzer = analyzer;
+	mod->userContext = userContext;
+
+	for (int c = 0; c < SDI_AUDIO_CHANNELS; c++) {
+		if (!(mask & (1 << c)))
+			continue;
+
+		if (analyzer->init &&
+			analyzer->init(userContext, ((grp->groupNr - 1) * SDI_AUDIO_CHANNELS) + c, &mod->state[c]) < 0) {
+			/* Undo the channels already initialized. */
+			sdiaudio_module_finalize(grp, mod);
+			return -1;
+		}
+		mod->mask |= 1 << c;
+	}
+
+	grp->moduleCount++;
+	return 0;
+}
+
+/* Index of an analyzer the caller added to the group, or -1. Must hold the group mutex. */
+static int sdiaudio_group_module_find(struct sdiaudio_group_s *grp, const struct ltnsdi_analyzer_s *analyzer,
+	void *userContext)
+{
+	for (int m = SDI_AUDIO_MODULES_BUILTIN; m < grp->moduleCount; m++) {
+		if (grp->module[m].analyzer == analyzer && grp->module[m].userContext == userContext)
+			return m;
+	}
+
+	return -1;
+}
+
+static void sdiaudio_group_module_remove(struct sdiaudio_group_s *grp, int m)
+{
+	sdiaudio_module_finalize(grp, &grp->module[m]);
+
+	grp->moduleCount--;
+	memmove(&grp->module[m], &grp->module[m + 1], (grp->moduleCount - m) * sizeof(grp->module[0]));
+}
+
+/* Channels settled as unused, with no loss detection and no detector lock, need nothing
+ * from a buffer beyond finding out whether a signal has appeared. Must hold the group mutex.
+ */
+static void sdiaudio_group_idle_update(struct sdiaudio_group_s *grp)
+{
+	struct sdiaudio_group_hot_s *hot = &grp->hot;
+	uint32_t idle = 0;
+
+	for (int c = 0; c < SDI_AUDIO_CHANNELS; c++) {
+		if (hot->type[c] == AUDIO_TYPE_UNUSED && !hot->analyzePCM[c] &&
+			hot->detector[c] && hot->detector[c]->wordLength == 0)
+			idle |= 1 << c;
+	}
+
+	hot->idleMask = idle;
+}
+
+/* A PCM or SMPTE 337 channel that hasn't carried either for two seconds is demoted to unused.
+ * Must hold the group mutex.
+ */
+static int sdiaudio_channel_age(struct sdiaudio_group_s *grp, int c, const struct timeval *now)
+{
+	struct sdiaudio_group_hot_s *hot = &grp->hot;
+
+	if (hot->type[c] != AUDIO_TYPE_SMPTE337 && hot->type[c] != AUDIO_TYPE_PCM)
+		return 0;
+	if (now->tv_sec < hot->lastActive[c] + 2)
+		return 0;
+
+	sdiaudio_channel_setType(&grp->ch[c], AUDIO_TYPE_UNUSED, now);
+	hot->wordLength[c] = 0;
+
+	return 1;
+}
+
+/* Report this groups channels in the callers results, once the buffer has been processed. */
+static void sdiaudio_group_results(struct sdiaudio_group_s *grp, struct ltnsdi_audio_results_s *results,
+	uint32_t first, uint32_t count, uint32_t measured, const enum sdiaudio_channel_type_e *typeBefore,
+	const uint64_t *lossBefore)
+{
+	struct sdiaudio_group_hot_s *hot = &grp->hot;
+
+	for (int c = 0; c < count; c++) {
+		struct ltnsdi_audio_result_channel_s *r = &results->channels[first + c];
+
+		r->type = sdiaudio_channel_type_public(hot->type[c]);
+		r->bursts = hot->bursts[c];
+		r->flags = 0;
+
+		if (measured & (1 << c)) {
+			r->peak = grp->analysis[c].largestSample;
+			r->zeroCount = grp->analysis[c].zeroCount;
+		} else {
+			r->peak = 0;
+			r->zeroCount = 0;
+			r->flags |= LTNSDI_AUDIO_RESULT_IDLE;
+		}
+
+		if (hot->type[c] != typeBefore[c])
+			r->flags |= LTNSDI_AUDIO_RESULT_TYPE_CHANGED;
+		if (grp->ch[c].pcm.missingAudioCount != lossBefore[c])
+			r->flags |= LTNSDI_AUDIO_RESULT_PCM_LOSS;
+		if (hot->detector[c] && hot->detector[c]->wordLength)
+			r->flags |= LTNSDI_AUDIO_RESULT_SMPTE337_LOCKED;
+	}
+}
+
+/* Process this groups share of a buffer, the channels in the group that are present in the frame.
+ * Touches nothing outside of the group, so groups may run concurrently on different threads.
+ * Must hold the group mutex.
+ */
+static int sdiaudio_group_process(struct sdiaudio_group_s *grp, const struct sdiaudio_write_s *w)
+{
+	uint8_t *buf = w->buf;
+	uint32_t audioFrames = w->audioFrames;
+	uint32_t sampleDepth = w->sampleDepth;
+	uint32_t channelsPerFrame = w->channelsPerFrame;
+	uint32_t frameStrideBytes = w->frameStrideBytes;
+
+	uint32_t first = (grp->groupNr - 1) * SDI_AUDIO_CHANNELS;
+	if (first >= channelsPerFrame)
+		return 0;
+
+	uint32_t count = channelsPerFrame - first;
+	if (count > SDI_AUDIO_CHANNELS)
+		count = SDI_AUDIO_CHANNELS;
+
+	uint8_t *groupBuf = buf + (first * (sampleDepth / 8));
+	uint8_t **planes = w->planes ? w->planes + first : NULL;
+
+	struct sdiaudio_group_hot_s *hot = &grp->hot;
+
+	/* Visible to the detector callbacks. */
+	grp->now = w->now;
+	const struct timeval *now = &grp->now;
+
+	/* Idle channels are skipped entirely, unless a probe (every buffer, or one in probeInterval)
+	 * finds any non zero word in them, which brings them back to full analysis.
+	 */
+	uint32_t present = (1 << count) - 1;
+	uint32_t skip = 0;
+
+	/* What the caller wants reported is compared against the state going in. */
+	enum sdiaudio_channel_type_e typeBefore[SDI_AUDIO_CHANNELS];
+	uint64_t lossBefore[SDI_AUDIO_CHANNELS];
+	if (w->results) {
+		for (int c = 0; c < count; c++) {
+			typeBefore[c] = hot->type[c];
+			lossBefore[c] = grp->ch[c].pcm.missingAudioCount;
+		}
+	}
+	memset(hot->bursts, 0, sizeof(hot->bursts));
+
+	if (sampleDepth == 32 && (hot->idleMask & present)) {
+		skip = hot->idleMask & present;
+		if (++hot->probeCount >= hot->probeInterval) {
+			hot->probeCount = 0;
+			if (planes) {
+				for (int c = 0; c < count; c++) {
+					if ((skip & (1 << c)) && planes[c] && sdiaudio_nonzero_32b(planes[c], audioFrames, 1, sizeof(uint32_t), 1))
+						skip &= ~(1 << c);
+				}
+			} else
+				skip &= ~sdiaudio_nonzero_32b(groupBuf, audioFrames, count, frameStrideBytes, skip);
+		}
+	}
+
+	/* Under load, work being shed is only done on one buffer in SDI_AUDIO_SHED_DECIMATE. */
+	uint32_t shed = 0;
+	if (hot->shed && (hot->shedPhase++ % SDI_AUDIO_SHED_DECIMATE) != 0)
+		shed = hot->shed;
+
+	if ((shed & (1 << LTNSDI_SHED_PCM_DECIMATE)) && sampleDepth == 32) {
+		for (int c = 0; c < count; c++) {
+			if (hot->type[c] == AUDIO_TYPE_PCM)
+				skip |= 1 << c;
+		}
+	}
+
+	/* One pass over the groups part of the buffer, transposing each channel into the scratch area,
+	 * then measure each channel from contiguous memory. Planar input is measured where it lies.
+	 */
+	int analyzed = 1;
+	int transposed = 0;
+	if (skip == present) {
+		/* Nothing to look at. */
+	} else
+	if (sampleDepth == 32) {
+		if (planes) {
+			for (int c = 0; c < count; c++)
+				grp->planes[c] = (int32_t *)planes[c];
+		} else {
+			if (sdiaudio_scratch_reserve(grp, audioFrames * count * sizeof(int32_t)) < 0)
+				return -1;
+			for (int c = 0; c < count; c++)
+				grp->planes[c] = (int32_t *)grp->scratch + (c * audioFrames);
+
+			if (w->plan)
+				w->plan->deinterleave[grp->groupNr - 1](groupBuf, audioFrames, count, frameStrideBytes, grp->planes, 0);
+			else
+				sdiaudio_deinterleave_32b(groupBuf, audioFrames, count, frameStrideBytes, grp->planes, 0);
+			transposed = 1;
+		}
+
+		for (int c = 0; c < count; c++) {
+			if (grp->planes[c] && !(skip & (1 << c)))
+				sdiaudio_analyze_32b(&grp->analysis[c], grp->planes[c], audioFrames);
+		}
+	} else
+	if (sampleDepth == 16) {
+		if (planes) {
+			for (int c = 0; c < count; c++) {
+				if (planes[c])
+					analyzeChannels_16b(&grp->analysis[c], planes[c], audioFrames, 1, sizeof(int16_t));
+			}
+		} else
+			analyzeChannels_16b(&grp->analysis[0], groupBuf, audioFrames, count, frameStrideBytes);
+	} else
+		analyzed = 0;
+
+	/* Channels the sweep above measured, the analysis of any other is stale. */
+	uint32_t measured = 0;
+	if (analyzed) {
+		for (int c = 0; c < count; c++) {
+			if (!(skip & (1 << c)) && (!planes || planes[c]))
+				measured |= 1 << c;
+		}
+	}
+
+	for (int c = 0; c < count; c++) {
+		int i = first + c;
+		struct sdiaudio_channel_s *ch = &grp->ch[c];
+		struct sdiaudio_channel_analysis_s *a = &grp->analysis[c];
+
+		/* Planar callers may leave out channels they don't carry. */
+		if (planes && !planes[c])
+			continue;
+
+		if (skip & (1 << c)) {
+			/* Keep the bitrate rolling over, as a full pass would. */
+			incrementChannelBitsPs(NULL, ch, hot->wordLength[c] * audioFrames, now);
+			continue;
+		}
+
+		if (hot->type[c] != AUDIO_TYPE_UNUSED) {
+
+			if (hot->type[c] == AUDIO_TYPE_SMPTE337 || hot->type[c] == AUDIO_TYPE_PCM) {
+				if (!hot->housekept && sdiaudio_channel_age(grp, c, now))
+					continue;
+			} else
+				sdiaudio_channel_setType(ch, AUDIO_TYPE_UNUSED, now);
+		}
+
+		/* A detector that hasn't locked yet can only lock on a Pa syncword, and
+		 * the sweep already told us whether this channel carries one.
+		 */
+		int sampleOffset = (i * (sampleDepth / 8));
+		int hunt = !(shed & (1 << LTNSDI_SHED_HUNT));
+		if (hot->detector[c] &&
+			(hot->detector[c]->wordLength || (hunt && (a->syncwordCount || sampleDepth != 32)))) {
+			if (planes) {
+				/* The following channel, possibly in the next group, for streams spanning two channels. */
+				uint8_t *next = (i + 1 < channelsPerFrame) ? w->planes[i + 1] : NULL;
+				smpte337_detector_write_planar(hot->detector[c], planes[c], next, audioFrames, sampleDepth);
+			} else
+			if (transposed) {
+				/* Read back from the scratch planes, pairs never span groups. */
+				smpte337_detector_write_planar(hot->detector[c], (uint8_t *)grp->planes[c],
+					c + 1 < count ? (uint8_t *)grp->planes[c + 1] : NULL, audioFrames, 32);
+			} else {
+				smpte337_detector_write(hot->detector[c], buf + sampleOffset, audioFrames, sampleDepth,
+					channelsPerFrame, frameStrideBytes);
+			}
+		}
+
+		if (hot->type[c] == AUDIO_TYPE_SMPTE337)
+			continue;
+
+		/* Now process the payload as if its PCM. */
+		if (!analyzed)
+			continue;
+
+		int32_t largestSample = a->largestSample;
+		/* Convert from stream specific format into LE */
+		if (largestSample == 0) {
+			if (hot->type[c] == AUDIO_TYPE_PCM) {
+				hot->emptyBufferCount[c]++;
+
+				if (hot->emptyBufferCount[c] > 128) {
+					/* No actual data, flag this sample as unused. */
+					sdiaudio_channel_setType(ch, AUDIO_TYPE_UNUSED, now);
+					sdiaudio_channel_statsUpdate(ch, now);
+					hot->wordLength[c] = 0;
+				}
+			}
+		} else {
+//printf("ch g%dc%dPCM largest sample = 0x%x\n", ch->groupNr, ch->channelNr, largestSample);
+			sdiaudio_channel_setType(ch, AUDIO_TYPE_PCM, now);
+			sdiaudio_channel_statsUpdate(ch, now);
+			hot->emptyBufferCount[c] = 0;
+		}
+		incrementChannelBitsPs(NULL, ch, hot->wordLength[c] * audioFrames, now);
+
+		if (hot->type[c] == AUDIO_TYPE_PCM) {
+			/* We don't know if these PCM samples ar 16/20/24/32 but, calculate the  size in bitwidth.  */
+			/* Lets scan the channel, see if our samples are 16, 20 or 24 bit constrained. */
+			int bits = 0;
+			for (int z = 31; z > 0; z--) {
+				if (largestSample & (1 << z)) {
+					bits = z + 1;
+					break;
+				}
+			}
+
+			/* Measuring the largest sample only hints at the bitwidth.
+			 * For example, the smallest sample in actuality can only be 16bit.
+			 * Round accordingly. */
+			if (bits <= 16)
+				bits = 16;
+			else
+			if (bits <= 32)
+				bits = 32;
+
+			hot->wordLength[c] = bits;
+		} /* If ch == PCM */
+	}
+
+	/* Hand each measured channel to the analyzers, built in first, now the channels are classified
+	 * and while the samples the sweep read are still in cache.
+	 */
+	for (int c = 0; c < count; c++) {
+		if (!(measured & (1 << c)))
+			continue;
+
+		struct sdiaudio_block_s b = {
+			.block = {
+				.channelNr = first + c,
+				.type = sdiaudio_channel_type_public(hot->type[c]),
+				.ts = *now,
+				.audioFrames = audioFrames,
+				.sampleDepth = sampleDepth,
+				.peak = grp->analysis[c].largestSample,
+				.zeroCount = grp->analysis[c].zeroCount,
+				.zeroRunTrailing = grp->analysis[c].zeroRunTrailing,
+			},
+			.w = w,
+			.a = &grp->analysis[c],
+		};
+		if (sampleDepth == 32) {
+			b.block.samples = (const uint8_t *)grp->planes[c];
+			b.block.stepBytes = sizeof(int32_t);
+		} else
+		if (planes) {
+			b.block.samples = planes[c];
+			b.block.stepBytes = sizeof(int16_t);
+		} else {
+			b.block.samples = groupBuf + (c * sizeof(int16_t));
+			b.block.stepBytes = frameStrideBytes;
+		}
+
+		for (uint32_t m = 0; m < grp->moduleCount; m++) {
+			struct sdiaudio_module_s *mod = &grp->module[m];
+			if (mod->mask & (1 << c))
+				mod->analyzer->block(mod->state[c], &b.block);
+		}
+	}
+
+	sdiaudio_group_idle_update(grp);
+
+	if (w->results)
+		sdiaudio_group_results(grp, w->results, first, count, measured, typeBefore, lossBefore);
+
+	return 0;
+}
+
+/* Process this groups share of one or more buffers, in order, under a single lock
+ * acquisition, publishing the results for status readers once at the end.
+ */
+int sdiaudio_group_write(struct sdiaudio_group_s *grp, const struct sdiaudio_write_s *w, uint32_t writeCount)
+{
+	int ret = 0;
+
+	ltnsdi_realtime_mutex_lock(&grp->mutex);
+
+	for (uint32_t i = 0; i < writeCount; i++) {
+		if (sdiaudio_group_process(grp, &w[i]) < 0)
+			ret = -1;
+	}
+
+	if (!grp->hot.housekept)
+		sdiaudio_snapshot_publish(grp);
+
+	pthread_mutex_unlock(&grp->mutex);
+
+	return ret;
+}
+
+/* The housekeeping thread's tick, elapsedUs since the last. Time moves on with the timestamps
+ * of written buffers and, once they stop arriving, with the timer, so a stalled input still ages out.
+ */
+void sdiaudio_group_housekeep(struct sdiaudio_group_s *grp, uint64_t elapsedUs)
+{
+	struct sdiaudio_group_hot_s *hot = &grp->hot;
+
+	pthread_mutex_lock(&grp->mutex);
+
+	if (timercmp(&grp->now, &grp->housekeepSeen, !=)) {
+		grp->housekeepSeen = grp->now;
+		grp->housekeepStalledUs = 0;
+	} else
+		grp->housekeepStalledUs += elapsedUs;
+
+	struct timeval stalled = {
+		.tv_sec = grp->housekeepStalledUs / 1000000,
+		.tv_usec = grp->housekeepStalledUs % 1000000,
+	};
+	struct timeval now;
+	timeradd(&grp->now, &stalled, &now);
+
+	for (int c = 0; c < SDI_AUDIO_CHANNELS; c++) {
+		sdiaudio_channel_age(grp, c, &now);
+
+		if (now.tv_sec != hot->bitsNowTime[c]) {
+			hot->bitsPsCurrent[c] = hot->bitsNow[c];
+			hot->bitsNow[c] = 0;
+			hot->bitsNowTime[c] = now.tv_sec;
+		}
+	}
+
+	sdiaudio_group_idle_update(grp);
+	sdiaudio_snapshot_publish(grp);
+
+	pthread_mutex_unlock(&grp->mutex);
+}
+
+/* Bytes of 32bit words needed to convert every buffer that isn't already in that layout. */
+static size_t sdiaudio_channels_convert_size(const struct sdiaudio_write_s *w, uint32_t writeCount)
+{
+	size_t size = 0;
+	for (uint32_t i = 0; i < writeCount; i++) {
+		if (w[i].format != LTNSDI_AUDIO_FORMAT_S32)
+			size += (size_t)w[i].audioFrames * w[i].channelsPerFrame * sizeof(int32_t);
+	}
+
+	return size;
+}
+
+/* Bring every buffer that isn't already 32bit words into that layout, returns the buffers to analyze. */
+static const struct sdiaudio_write_s *sdiaudio_channels_convert(struct sdiaudio_channels_s *channels,
+	const struct sdiaudio_write_s *w, uint32_t writeCount, struct sdiaudio_write_s *converted)
+{
+	size_t size = sdiaudio_channels_convert_size(w, writeCount);
+	if (size == 0)
+		return w;
+
+	if (writeCount > SDI_AUDIO_WRITEV_BATCH)
+		return NULL;
+
+	if (size > channels->convertSize) {
+		/* Real-time mode refuses the buffers rather than allocate. */
+		if (channels->realtime.enabled)
+			return NULL;
+
+		ltnsdi_realtime_check("heap allocation");
+		int32_t *p = realloc(channels->convert, size);
+		if (!p)
+			return NULL;
+		channels->convert = p;
+		__atomic_store_n(&channels->convertSize, size, __ATOMIC_RELAXED);
+	}
+
+	int32_t *dst = channels->convert;
+	for (uint32_t i = 0; i < writeCount; i++) {
+		converted[i] = w[i];
+		if (w[i].format == LTNSDI_AUDIO_FORMAT_S32)
+			continue;
+
+		sdiaudio_convert_s32(w[i].format, w[i].buf, w[i].audioFrames, w[i].channelsPerFrame,
+			w[i].frameStrideBytes, dst);
+
+		converted[i].buf = (uint8_t *)dst;
+		converted[i].format = LTNSDI_AUDIO_FORMAT_S32;
+		converted[i].sampleDepth = 32;
+		converted[i].frameStrideBytes = w[i].channelsPerFrame * sizeof(int32_t);
+		dst += w[i].audioFrames * w[i].channelsPerFrame;
+	}
+
+	return converted;
+}
+
+/* Hand every group its share of the buffers, on the pool or on this thread. */
+static int sdiaudio_channels_process(struct sdiaudio_channels_s *channels, const struct sdiaudio_write_s *w, uint32_t writeCount)
+{
+	/* In real-time mode the conversion buffer holds one packet, convert a batch that won't fit a buffer at a time. */
+	if (channels->realtime.enabled && writeCount > 1 &&
+		sdiaudio_channels_convert_size(w, writeCount) > channels->convertSize) {
+		int ret = 0;
+		for (uint32_t i = 0; i < writeCount; i++) {
+			if (sdiaudio_channels_process(channels, &w[i], 1) < 0)
+				ret = -1;
+		}
+		return ret;
+	}
+
+	struct sdiaudio_write_s converted[SDI_AUDIO_WRITEV_BATCH];
+	w = sdiaudio_channels_convert(channels, w, writeCount, converted);
+	if (!w)
+		return -1;
+
+	uint32_t groupCount = 0;
+	for (uint32_t i = 0; i < writeCount; i++) {
+		uint32_t n = (w[i].channelsPerFrame + SDI_AUDIO_CHANNELS - 1) / SDI_AUDIO_CHANNELS;
+		if (n > groupCount)
+			groupCount = n;
+	}
+
+	if (channels->workers && groupCount > 1)
+		return sdiaudio_workers_run(channels->workers, w, writeCount, groupCount);
+
+	int ret = 0;
+	for (int g = 0; g < groupCount; g++) {
+		if (sdiaudio_group_write(&channels->group[g], w, writeCount) < 0)
+			ret = -1;
+	}
+
+	return ret;
+}
+
+/* Tell every group which work is shed at the current level. */
+static void sdiaudio_channels_shed_apply(struct sdiaudio_channels_s *channels)
+{
+	uint32_t mask = 0;
+	for (uint32_t i = 0; i < channels->load.level; i++)
+		mask |= 1 << channels->load.order[i];
+
+	__atomic_store_n(&channels->load.shed, mask, __ATOMIC_RELAXED);
+
+	for (int g = 0; g < channels->groupCount; g++) {
+		struct sdiaudio_group_s *grp = &channels->group[g];
+
+		pthread_mutex_lock(&grp->mutex);
+		grp->hot.shed = mask;
+		grp->hot.shedPhase = 0;
+		pthread_mutex_unlock(&grp->mutex);
+	}
+}
+
+/* Compare how long analysis took with how long the audio lasts. Each write over budget sheds
+ * one more item of work, a run of writes comfortably within budget restores one.
+ */
+static void sdiaudio_channels_shed_update(struct sdiaudio_channels_s *channels, const struct sdiaudio_write_s *w,
+	uint32_t writeCount, const struct timespec *start)
+{
+	struct timespec end;
+	ltnsdi_realtime_check("clock read");
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	uint64_t elapsedNs = ((int64_t)(end.tv_sec - start->tv_sec) * 1000000000) + (end.tv_nsec - start->tv_nsec);
+
+	uint64_t frames = 0;
+	for (uint32_t i = 0; i < writeCount; i++)
+		frames += w[i].audioFrames;
+	uint64_t budgetNs = ((frames * 1000000000) / SDI_AUDIO_SAMPLE_RATE) * channels->load.budgetPercent / 100;
+
+	uint64_t elapsedUs = elapsedNs / 1000;
+	uint64_t budgetUs = budgetNs / 1000;
+
+	uint32_t level = channels->load.level;
+	if (elapsedNs > budgetNs) {
+		__atomic_store_n(&channels->load.overruns, channels->load.overruns + 1, __ATOMIC_RELAXED);
+		channels->load.calm = 0;
+		if (level < channels->load.orderCount)
+			level++;
+	} else
+	if (elapsedNs < budgetNs / 2) {
+		if (level && ++channels->load.calm >= SDI_AUDIO_SHED_CALM) {
+			channels->load.calm = 0;
+			level--;
+		}
+	} else
+		channels->load.calm = 0;
+
+	__atomic_store_n(&channels->load.budgetUs, budgetUs, __ATOMIC_RELAXED);
+	__atomic_store_n(&channels->load.lastUs, elapsedUs, __ATOMIC_RELAXED);
+	if (elapsedUs > channels->load.peakUs)
+		__atomic_store_n(&channels->load.peakUs, elapsedUs, __ATOMIC_RELAXED);
+
+	if (level != channels->load.level) {
+		__atomic_store_n(&channels->load.level, level, __ATOMIC_RELAXED);
+		sdiaudio_channels_shed_apply(channels);
+	}
+}
+
+/* Analyze one or more buffers, every group in them, before returning. */
+int sdiaudio_channels_write(struct sdiaudio_channels_s *channels, const struct sdiaudio_write_s *w, uint32_t writeCount)
+{
+	int rt = ltnsdi_realtime_begin(channels->realtime.enabled);
+	int ret;
+
+	if (!channels->load.budgetPercent) {
+		ret = sdiaudio_channels_process(channels, w, writeCount);
+	} else {
+		struct timespec start;
+		ltnsdi_realtime_check("clock read");
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		ret = sdiaudio_channels_process(channels, w, writeCount);
+
+		sdiaudio_channels_shed_update(channels, w, writeCount, &start);
+	}
+
+	ltnsdi_realtime_end(rt);
+
+	return ret;
+}
+
+/* The time to stamp a buffer the caller didn't. Real-time mode never reads the clock here, time
+ * runs from when the mode was enabled, advanced by the audio written without a timestamp since.
+ */
+static void sdiaudio_channels_now(struct sdiaudio_channels_s *channels, uint32_t audioFrames, struct timeval *now)
+{
+	if (!channels->realtime.enabled) {
+		gettimeofday(now, NULL);
+		return;
+	}
+
+	uint64_t us = (channels->realtime.frames * 1000000) / SDI_AUDIO_SAMPLE_RATE;
+	struct timeval elapsed = {
+		.tv_sec = us / 1000000,
+		.tv_usec = us % 1000000,
+	};
+	timeradd(&channels->realtime.epoch, &elapsed, now);
+
+	channels->realtime.frames += audioFrames;
+}
+
+/* Write many channels at once to the internal channels.
+ * The buffer is assumed to start with group 1 channel 0.
+ * G1C0 | G1C1 | G1C2 | G1C3 | G2C0 | G2C1 | .... up to G4C3
+ * All per channel time keeping is driven from ts, the clock is never read here.
+ * zero on success else < zero.
+ * */
+int ltnsdi_audio_channels_write_ts(struct ltnsdi_context_s *ctx, uint8_t *buf,
+        uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame, uint32_t frameStrideBytes,
+	const struct timeval *ts)
+{
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
+
+	if (channelsPerFrame > channels->channelCount)
+		return -1;
+
+	if (!ts)
+		return -1;
+
+	struct sdiaudio_write_s w = {
+		.buf = buf,
+		.audioFrames = audioFrames,
+		.sampleDepth = sampleDepth,
+		.channelsPerFrame = channelsPerFrame,
+		.frameStrideBytes = frameStrideBytes,
+		.now = *ts,
+	};
+
+	if (channels->async)
+		return sdiaudio_async_enqueue(channels->async, &w);
+
+	return sdiaudio_channels_write(channels, &w, 1);
+}
+
+int ltnsdi_audio_channels_write_results(struct ltnsdi_context_s *ctx, uint8_t *buf,
+        uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame, uint32_t frameStrideBytes,
+	const struct timeval *ts, struct ltnsdi_audio_results_s *results)
+{
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
+
+	if (!results || channelsPerFrame > channels->channelCount)
+		return -1;
+
+	/* Results only exist once the buffer is analyzed, which in async mode is after we return. */
+	if (channels->async)
+		return -1;
+
+	struct sdiaudio_write_s w = {
+		.buf = buf,
+		.results = results,
+		.audioFrames = audioFrames,
+		.sampleDepth = sampleDepth,
+		.channelsPerFrame = channelsPerFrame,
+		.frameStrideBytes = frameStrideBytes,
+	};
+
+	if (ts)
+		w.now = *ts;
+	else
+		sdiaudio_channels_now(channels, audioFrames, &w.now);
+
+	results->channelCount = channelsPerFrame;
+
+	return sdiaudio_channels_write(channels, &w, 1);
+}
+
+int ltnsdi_audio_channels_write_format(struct ltnsdi_context_s *ctx, uint8_t *buf, uint32_t audioFrames,
+	enum ltnsdi_audio_format_e format, uint32_t channelsPerFrame, uint32_t frameStrideBytes,
+	const struct timeval *ts)
+{
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
+
+	uint32_t bytes = sdiaudio_format_bytes(format);
+	if (!buf || !bytes || channelsPerFrame > channels->channelCount)
+		return -1;
+
+	if (frameStrideBytes < channelsPerFrame * bytes)
+		return -1;
+
+	struct sdiaudio_write_s w = {
+		.buf = buf,
+		.format = format,
+		.audioFrames = audioFrames,
+		.sampleDepth = 32,
+		.channelsPerFrame = channelsPerFrame,
+		.frameStrideBytes = frameStrideBytes,
+	};
+
+	if (ts)
+		w.now = *ts;
+	else
+		sdiaudio_channels_now(channels, audioFrames, &w.now);
+
+	if (channels->async)
+		return sdiaudio_async_enqueue(channels->async, &w);
+
+	return sdiaudio_channels_write(channels, &w, 1);
+}
+
+int ltnsdi_audio_plan_alloc(struct ltnsdi_context_s *ctx, struct ltnsdi_audio_plan_s **plan,
+	enum ltnsdi_audio_format_e format, uint32_t channelsPerFrame, uint32_t frameStrideBytes)
+{
+	uint32_t bytes = sdiaudio_format_bytes(format);
+	if (!plan || !bytes || !channelsPerFrame || channelsPerFrame > getChannels(ctx)->channelCount)
+		return -1;
+
+	if (frameStrideBytes < channelsPerFrame * bytes)
+		return -1;
+
+	struct ltnsdi_audio_plan_s *p = calloc(1, sizeof(*p));
+	if (!p)
+		return -1;
+
+	p->ctx = ctx;
+	p->format = format;
+	p->channelsPerFrame = channelsPerFrame;
+	p->frameStrideBytes = frameStrideBytes;
+
+	/* Anything converted arrives at the groups tightly packed. */
+	uint32_t stride = frameStrideBytes;
+	if (format != LTNSDI_AUDIO_FORMAT_S32)
+		stride = channelsPerFrame * sizeof(int32_t);
+
+	for (int g = 0; g < SDI_AUDIO_GROUPS_MAX; g++) {
+		uint32_t count = 0;
+		if (channelsPerFrame > g * SDI_AUDIO_CHANNELS)
+			count = channelsPerFrame - (g * SDI_AUDIO_CHANNELS);
+		if (count > SDI_AUDIO_CHANNELS)
+			count = SDI_AUDIO_CHANNELS;
+
+		p->deinterleave[g] = sdiaudio_deinterleave_32b_select(count, stride);
+	}
+
+	*plan = p;
+	return 0;
+}
+
+int ltnsdi_audio_plan_write(struct ltnsdi_audio_plan_s *plan, uint8_t *buf, uint32_t audioFrames,
+	const struct timeval *ts)
+{
+	struct sdiaudio_channels_s *channels = getChannels(plan->ctx);
+
+	struct sdiaudio_write_s w = {
+		.buf = buf,
+		.format = plan->format,
+		.plan = plan,
+		.audioFrames = audioFrames,
+		.sampleDepth = 32,
+		.channelsPerFrame = plan->channelsPerFrame,
+		.frameStrideBytes = plan->frameStrideBytes,
+	};
+
+	if (ts)
+		w.now = *ts;
+	else
+		sdiaudio_channels_now(channels, audioFrames, &w.now);
+
+	if (channels->async)
+		return sdiaudio_async_enqueue(channels->async, &w);
+
+	return sdiaudio_channels_write(channels, &w, 1);
+}
+
+void ltnsdi_audio_plan_free(struct ltnsdi_audio_plan_s *plan)
+{
+	struct sdiaudio_channels_s *channels = getChannels(plan->ctx);
+
+	/* Queued buffers still refer to the plan. */
+	if (channels->async)
+		sdiaudio_async_flush(channels->async);
+
+	free(plan);
+}
+
+int ltnsdi_audio_channels_write_planar(struct ltnsdi_context_s *ctx, uint8_t **planes,
+	uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelCount, const struct timeval *ts)
+{
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
+
+	if (!planes || channelCount > channels->channelCount)
+		return -1;
+
+	if (sampleDepth != 16 && sampleDepth != 32)
+		return -1;
+
+	struct sdiaudio_write_s w = {
+		.planes = planes,
+		.audioFrames = audioFrames,
+		.sampleDepth = sampleDepth,
+		.channelsPerFrame = channelCount,
+		.frameStrideBytes = sampleDepth / 8,
+	};
+
+	if (ts)
+		w.now = *ts;
+	else
+		sdiaudio_channels_now(channels, audioFrames, &w.now);
+
+	if (channels->async)
+		return sdiaudio_async_enqueue(channels->async, &w);
+
+	return sdiaudio_channels_write(channels, &w, 1);
+}
+
+int ltnsdi_audio_channels_writev(struct ltnsdi_context_s *ctx, const struct ltnsdi_audio_packet_s *pkts, unsigned int count)
+{
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
+
+	if (!pkts)
+		return -1;
+
+	/* Reject the whole batch up front, rather than half processing it. */
+	for (unsigned int i = 0; i < count; i++) {
+		if (pkts[i].channelsPerFrame > channels->channelCount)
+			return -1;
+	}
+
+	int ret = 0;
+	for (unsigned int i = 0; i < count; ) {
+		struct sdiaudio_write_s w[SDI_AUDIO_WRITEV_BATCH];
+		uint32_t n = 0;
+
+		for (; i < count && n < SDI_AUDIO_WRITEV_BATCH; i++, n++) {
+			w[n].buf = pkts[i].buf;
+			w[n].planes = NULL;
+			w[n].format = LTNSDI_AUDIO_FORMAT_S32;
+			w[n].plan = NULL;
+			w[n].results = NULL;
+			w[n].audioFrames = pkts[i].audioFrames;
+			w[n].sampleDepth = pkts[i].sampleDepth;
+			w[n].channelsPerFrame = pkts[i].channelsPerFrame;
+			w[n].frameStrideBytes = pkts[i].frameStrideBytes;
+			w[n].now = pkts[i].ts;
+		}
+
+		if (channels->async) {
+			for (uint32_t j = 0; j < n; j++) {
+				if (sdiaudio_async_enqueue(channels->async, &w[j]) < 0)
+					ret = -1;
+			}
+		} else
+		if (sdiaudio_channels_write(channels, w, n) < 0)
+			ret = -1;
+	}
+
+	return ret;
+}
+
+int ltnsdi_audio_channels_write(struct ltnsdi_context_s *ctx, uint8_t *buf,
+        uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame, uint32_t frameStrideBytes)
+{
+	/* One clock read for the entire buffer. */
+	struct timeval now;
+	sdiaudio_channels_now(getChannels(ctx), audioFrames, &now);
+
+	return ltnsdi_audio_channels_write_ts(ctx, buf, audioFrames, sampleDepth, channelsPerFrame, frameStrideBytes, &now);
+}
+
+int sdiaudio_channels_alloc(struct sdiaudio_channels_s **ctx, uint32_t channelCount)
+{
+	struct sdiaudio_channels_s *o = calloc(1, sizeof(*o));
+	if (!o)
+		return -1;
+
+	o->groupCount = (channelCount + SDI_AUDIO_CHANNELS - 1) / SDI_AUDIO_CHANNELS;
+	o->channelCount = o->groupCount * SDI_AUDIO_CHANNELS;
+	if (posix_memalign((void **)&o->group, 64, o->groupCount * sizeof(*o->group)) != 0) {
+		free(o);
+		return -1;
+	}
+	memset(o->group, 0, o->groupCount * sizeof(*o->group));
+
+	/* Every group can be torn down by sdiaudio_channels_free(), however far it got. */
+	for (int g = 0; g < o->groupCount; g++)
+		pthread_mutex_init(&o->group[g].mutex, NULL);
+
+	for (int g = 0; g < o->groupCount; g++) {
+		struct sdiaudio_group_s *grp = &o->group[g];
+
+		grp->groupNr = g + 1;
+		grp->hot.probeInterval = 1;
+		gettimeofday(&grp->now, NULL);
+
+		if (sdiaudio_scratch_reserve(grp, SDI_AUDIO_SCRATCH_DEFAULT) < 0)
+			goto err;
+
+		for (int c = 0; c < SDI_AUDIO_CHANNELS; c++) {
+			struct sdiaudio_channel_s *ch = &grp->ch[c];
+
+			ch->group = grp;
+			ch->groupNr = g + 1;
+			ch->channelNr = c;
+			sdiaudio_hot(ch, analyzePCM) = 0;
+			sdiaudio_hot(ch, audioPCMLossLimit) = 24;
+			ch->analyzePCMConsoleDump = 1;
+
+			if (c == 0 || c == 2)
+				ch->pairedChannel = &grp->ch[c + 1];
+			else
+			if (c == 1 || c == 3)
+				ch->pairedChannel = &grp->ch[c - 1];
+
+			ch->userContext = NULL;
+			sdiaudio_channel_setType(ch, AUDIO_TYPE_UNDEFINED, &grp->now);
+			sdiaudio_hot(ch, wordLength) = 0;
+
+			/* PCM */
+			ch->pcm.samplesWritten = 0;
+			ch->pcm.sampleRateHz = 0;
+
+			/* SMPTE 337 */
+			ch->smpte337.framesWritten = 0;
+			sdiaudio_hot(ch, detector) = smpte337_detector_alloc((smpte337_detector_callback)detector_callback, ch);
+			if (!sdiaudio_hot(ch, detector))
+				goto err;
+		}
+
+		if (sdiaudio_group_module_add(grp, &sdiaudio_analyzer_silence, grp, (1 << SDI_AUDIO_CHANNELS) - 1) < 0 ||
+			sdiaudio_group_module_add(grp, &sdiaudio_analyzer_dbfs, grp, (1 << SDI_AUDIO_CHANNELS) - 1) < 0)
+			goto err;
+
+		sdiaudio_snapshot_publish(grp);
+	}
+
+	*ctx = o;
+	return 0;
+
+err:
+	sdiaudio_channels_free(o);
+	return -1;
 }
 
-__inline__ void sdiaudio_channel_statsUpdate(struct sdiaudio_channel_s *ch)
+/* Lock a region into RAM, or unlock it, keeping *bytes as the total currently locked. */
+int sdiaudio_mlock(const void *p, size_t size, int lock, uint64_t *bytes)
 {
-	switch (ch->type) {
-	case AUDIO_TYPE_UNUSED:
-		ch->unused.unusedSampleCount++;
-		gettimeofday(&ch->unused.last_update, NULL);
-		break;
-	case AUDIO_TYPE_SMPTE337:
-		ch->smpte337.framesWritten++;
-		gettimeofday(&ch->smpte337.last_update, NULL);
-		break;
-	case AUDIO_TYPE_PCM:
-		ch->pcm.samplesWritten++;
-		gettimeofday(&ch->pcm.last_update, NULL);
-		break;
-	case AUDIO_TYPE_UNDEFINED:
-		break;
+	if (!p || !size)
+		return 0;
+
+	if (!lock) {
+		munlock(p, size);
+		*bytes = *bytes > size ? *bytes - size : 0;
+		return 0;
 	}
-}
 
-__inline__ int16_t be_s16(int16_t n)
-{
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN 
-    return ((n & 0xff00) >> 8) | (n << 8);
-#elif G_BYTE_ORDER == G_BIG_ENDIAN
-    return n;
-#else
-#error "G_BYTE_ORDER should be big or little endian."
-#endif
-}
+	if (mlock(p, size) < 0)
+		return -1;
 
-__inline__ int32_t be_s32(int32_t n)
-{
-#if G_BYTE_ORDER == G_LITTLE_ENDIAN 
-    return ((n & 0xff000000) >> 24) | ((n & 0x00ff0000) >> 8) | ((n & 0x0000ff00) << 8) | (n << 24);
-#elif G_BYTE_ORDER == G_BIG_ENDIAN
-    return n;
-#else
-#error "G_BYTE_ORDER should be big or little endian."
-#endif
+	*bytes += size;
+	return 0;
 }
 
-static const char *sdiaudio_channel_type_name(enum sdiaudio_channel_type_e e)
+/* Lock everything the write path touches into RAM, or unlock it again. */
+static int sdiaudio_channels_mlock(struct sdiaudio_channels_s *channels, int lock, uint64_t *bytes)
 {
-	switch (e) {
-	default:
-	case AUDIO_TYPE_UNDEFINED: return "UNDEFINED";
-	case AUDIO_TYPE_SMPTE337:  return "SMPTE337";
-	case AUDIO_TYPE_PCM:       return "PCM";
-	case AUDIO_TYPE_UNUSED:    return "UNUSED";
+	int ret = 0;
+
+	if (sdiaudio_mlock(channels, sizeof(*channels), lock, bytes) < 0)
+		ret = -1;
+	if (sdiaudio_mlock(channels->group, channels->groupCount * sizeof(*channels->group), lock, bytes) < 0)
+		ret = -1;
+	if (sdiaudio_mlock(channels->convert, channels->convertSize, lock, bytes) < 0)
+		ret = -1;
+
+	for (int g = 0; g < channels->groupCount; g++) {
+		struct sdiaudio_group_s *grp = &channels->group[g];
+
+		if (sdiaudio_mlock(grp->scratch, grp->scratchSize, lock, bytes) < 0)
+			ret = -1;
+		if (sdiaudio_mlock(grp->payload, grp->payloadSize, lock, bytes) < 0)
+			ret = -1;
+
+		for (int c = 0; c < SDI_AUDIO_CHANNELS; c++) {
+			struct smpte337_detector_s *d = grp->hot.detector[c];
+			if (sdiaudio_mlock(d, sizeof(*d), lock, bytes) < 0)
+				ret = -1;
+			if (d->carry && sdiaudio_mlock(d->carry, d->carrySize, lock, bytes) < 0)
+				ret = -1;
+		}
 	}
-};
 
-static __inline__ void incrementChannelBitsPs(struct ltnsdi_context_s *ctx, struct sdiaudio_channel_s *ch, uint64_t bitCount)
-{
-	time_t now;
-	time(&now);
+	if (channels->async && sdiaudio_async_mlock(channels->async, lock, bytes) < 0)
+		ret = -1;
+
+	return ret;
+}
 
-	if (now != ch->bitsNowTime) {
-		ch->bitsPsCurrent = ch->bitsNow;
-		ch->bitsNow = 0;
-		ch->bitsNowTime = now;
+/* Return every group to normal operation and unlock the memory real-time mode locked. */
+static void sdiaudio_channels_realtime_release(struct sdiaudio_channels_s *channels)
+{
+	uint64_t bytes = channels->realtime.lockedBytes;
+	sdiaudio_channels_mlock(channels, 0, &bytes);
+
+	for (int g = 0; g < channels->groupCount; g++) {
+		struct sdiaudio_group_s *grp = &channels->group[g];
+
+		pthread_mutex_lock(&grp->mutex);
+		grp->realtime = 0;
+		for (int c = 0; c < SDI_AUDIO_CHANNELS; c++)
+			smpte337_detector_set_realtime(grp->hot.detector[c], NULL, 0);
+		free(grp->payload);
+		grp->payload = NULL;
+		grp->payloadSize = 0;
+		sdiaudio_snapshot_publish(grp);
+		pthread_mutex_unlock(&grp->mutex);
 	}
 
-	ch->bitsNow += bitCount;
+	__atomic_store_n(&channels->realtime.enabled, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&channels->realtime.lockedBytes, 0, __ATOMIC_RELAXED);
 }
 
-static uint8_t *demuxChannelWords(struct ltnsdi_context_s *ctx, uint8_t *buf,
-        uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame, uint32_t frameStrideBytes, int channelIndex,
-        int32_t *largestSample)
+/* Allocate everything the write path could otherwise allocate later, at its largest, then lock it all into RAM. */
+static int sdiaudio_channels_realtime_reserve(struct sdiaudio_channels_s *channels)
 {
-	*largestSample = 0;
+	size_t convertSize = SDI_AUDIO_ASYNC_SLOT_DEFAULT(channels->channelCount);
+	if (channels->convertSize < convertSize) {
+		int32_t *p = realloc(channels->convert, convertSize);
+		if (!p)
+			return -1;
+		channels->convert = p;
+		__atomic_store_n(&channels->convertSize, convertSize, __ATOMIC_RELAXED);
+	}
 
-	if (sampleDepth == 32) {
-		int step = (frameStrideBytes / sizeof(uint32_t));
-		int32_t *b   = malloc(audioFrames * sizeof(int32_t));
-		int32_t *dst = b;
-		int32_t *src = (int32_t *)buf;
-		src += channelIndex;
+	for (int g = 0; g < channels->groupCount; g++) {
+		struct sdiaudio_group_s *grp = &channels->group[g];
+		int ret = 0;
 
-		for (int i = 0; i < audioFrames; i++) {
-			*dst = be_s32(*src);
+		pthread_mutex_lock(&grp->mutex);
 
-			int16_t x = abs(*src >> 16);
+		grp->payload = malloc(SMPTE337_DETECTOR_REALTIME_CARRY);
+		if (grp->payload)
+			grp->payloadSize = SMPTE337_DETECTOR_REALTIME_CARRY;
+		else
+			ret = -1;
 
-			if (x > *largestSample)
-                            *largestSample = x;
-			src += step;
-			dst++;
+		for (int c = 0; c < SDI_AUDIO_CHANNELS && ret == 0; c++) {
+			if (smpte337_detector_set_realtime(grp->hot.detector[c], grp->payload, grp->payloadSize) < 0)
+				ret = -1;
 		}
 
-		return (uint8_t *)b;
+		grp->realtime = 1;
+		sdiaudio_snapshot_publish(grp);
+		pthread_mutex_unlock(&grp->mutex);
+
+		if (ret < 0)
+			return -1;
 	}
 
-	if (sampleDepth == 16) {
-// TODO: requires testing. */
-printf("%s() 16 bit\n", __func__);
-		uint32_t step = (frameStrideBytes / sizeof(uint16_t));
-		int32_t *b = malloc(audioFrames * sizeof(int32_t));
-		int32_t *dst = b;
-		int16_t *src = (int16_t *)buf;
-		src += (channelIndex * (sampleDepth / 8));
+	uint64_t bytes = 0;
+	int ret = sdiaudio_channels_mlock(channels, 1, &bytes);
+	__atomic_store_n(&channels->realtime.lockedBytes, bytes, __ATOMIC_RELAXED);
+	if (ret < 0)
+		return -1;
 
-		for (int i = 0; i < audioFrames; i++) {
-			*dst = be_s16(*src);
-			if (*dst > *largestSample)
-				*largestSample = *dst;
-			src += step;
-			dst++;
-		}
-		return (uint8_t *)b;
-	}
+	/* The last clock read, buffers without a timestamp are stamped relative to it from here on. */
+	gettimeofday(&channels->realtime.epoch, NULL);
+	channels->realtime.frames = 0;
+	__atomic_store_n(&channels->realtime.enabled, 1, __ATOMIC_RELAXED);
 
-	return NULL;
+	return 0;
 }
 
-static void *detector_callback(void *userContext,
-	struct smpte337_detector_s *ctx,
-	uint8_t datamode, uint8_t datatype, uint32_t payload_bitCount, uint8_t *payload)
+void sdiaudio_channels_free(struct sdiaudio_channels_s *ctx)
 {
-	struct sdiaudio_channel_s *ch = (struct sdiaudio_channel_s *)userContext;
+	/* Stop the async thread and the workers first, nothing can be in flight after this. */
+	if (ctx->housekeeping) {
+		sdiaudio_housekeeping_free(ctx->housekeeping);
+		ctx->housekeeping = NULL;
+	}
+	if (ctx->async) {
+		sdiaudio_async_free(ctx->async);
+		ctx->async = NULL;
+	}
+	if (ctx->workers) {
+		sdiaudio_workers_free(ctx->workers);
+		ctx->workers = NULL;
+	}
+	if (ctx->realtime.enabled)
+		sdiaudio_channels_realtime_release(ctx);
 
-#if 0
-	printf("libltnsdi:%s() groupnr: %d channelnr: %d datamode = %d [%dbit], datatype = %d [payload: %s]"
-		", payload_bitcount = %d, payload = %p\n",
-		__func__,
-		ch->groupNr,
-		ch->channelNr,
-		datamode, smpte338_lookupDataMode(datamode),
-		datatype, smpte338_lookupDataTypeDescription(datatype),
-		payload_bitCount,
-		payload);
-#endif
+	for (int g = 0; g < ctx->groupCount; g++) {
+		struct sdiaudio_group_s *grp = &ctx->group[g];
 
-	if (sdiaudio_channel_getType(ch) == AUDIO_TYPE_PCM) {
-		/* PCM removal alert */
-	}
+		/* Acquire the mutex, prevent futher callbacks, prevent further use, and destroy the channels. */
+		pthread_mutex_lock(&grp->mutex);
 
-	ch->wordLength = smpte338_lookupDataMode(datamode);
-	ch->smpte337.dataType = datatype;
-	ch->smpte337.dataMode = datamode;
+		for (int m = 0; m < grp->moduleCount; m++)
+			sdiaudio_module_finalize(grp, &grp->module[m]);
 
-	sdiaudio_channel_setType(ch, AUDIO_TYPE_SMPTE337);
-	sdiaudio_channel_statsUpdate(ch);
-	incrementChannelBitsPs(NULL, ch, payload_bitCount);
+		for (int c = 0; c < SDI_AUDIO_CHANNELS; c++) {
+			/* Destroy the channel, regardless of type. */
+			/* PCM */
 
-	if (sdiaudio_channel_getType(ch->pairedChannel) != AUDIO_TYPE_SMPTE337) {
-		sdiaudio_channel_setType(ch->pairedChannel, AUDIO_TYPE_SMPTE337);
-		ch->pairedChannel->smpte337.dataType = datatype;
-		ch->pairedChannel->smpte337.dataMode = datamode;
-	}
-	sdiaudio_channel_statsUpdate(ch->pairedChannel);
-	incrementChannelBitsPs(NULL, ch->pairedChannel, payload_bitCount);
+			/* SMPTE 337, through the group, a context that failed to allocate may not have set up the channel. */
+			if (grp->hot.detector[c]) {
+				smpte337_detector_free(grp->hot.detector[c]);
+			}
+		}
 
-#if 0
-	if (ctx->spanCount == 2) {
-		sdiaudio_channel_setType(ch->pairedChannel, AUDIO_TYPE_UNUSED);
+		free(grp->scratch);
+
+		/* Intensionally leave the mutex locked. */
 	}
-#endif
 
-	/* SMPTE 337 Discovery alert. */
+	free(ctx->convert);
 
-	return 0;
+	free(ctx->group);
+	free(ctx);
 }
 
-static void genericDumpAudioPayload(const uint8_t *data, int sampleFrameCount, int audioChannelCount, int audioSampleDepth)
+int ltnsdi_context_set_worker_threads(struct ltnsdi_context_s *ctx, unsigned int threads)
 {
-	assert(audioChannelCount == 16);
-	assert(audioSampleDepth == 32);
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
 
-	uint32_t *p = (uint32_t *)data;
+	/* The writer would wait on the helpers. */
+	if (threads && channels->realtime.enabled)
+		return -1;
 
-	for (int s = 0; s < sampleFrameCount; s++) {
-		printf("%06d : ", s);
-		for (int i = 0; i < audioChannelCount; i++) {
-			printf("%08x ", *p);
-			p++;
-		}
-		printf("\n");
+	/* The async thread is a writer too, make sure it's idle. */
+	if (channels->async)
+		sdiaudio_async_flush(channels->async);
+
+	if (channels->workers) {
+		sdiaudio_workers_free(channels->workers);
+		channels->workers = NULL;
 	}
-	printf("\n\n");
 
+	if (threads == 0)
+		return 0;
+
+	/* The callers thread always processes a group itself. */
+	if (threads > channels->groupCount - 1)
+		threads = channels->groupCount - 1;
+	if (threads == 0)
+		return 0;
+
+	return sdiaudio_workers_alloc(&channels->workers, channels, threads);
 }
 
-static void checkForSilence(struct sdiaudio_channel_s *ch,
-	const uint8_t *data, int sampleFrameCount,
-	int channelNr, int audioChannelCount, int audioSampleDepth)
+int ltnsdi_context_set_probe_interval(struct ltnsdi_context_s *ctx, unsigned int buffers)
 {
-	assert(audioChannelCount == 16);
-	assert(audioSampleDepth == 32);
-
-	if (!data)
-		return;
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
 
-	uint32_t *p = (uint32_t *)data;
-	p += channelNr; /* Adjust the offset to the start of the channel we are inspecting */
-	int silence = 0;
-	//int lastSilenceIdx = -1;
+	if (buffers == 0)
+		buffers = 1;
 
-	for (int s = 0; s < sampleFrameCount; s++) {
-		uint32_t dw = *p;
-		if (dw == 0) {
-			//printf("silence at %d last %d\n", s, lastSilenceIdx);
-			silence++;
-			ch->pcm.sequentialAudioSilence++;
-		} else {
-			ch->pcm.sequentialAudioSilence = 0;
-		}
-		//printf("%08x\n", dw);
+	for (int g = 0; g < channels->groupCount; g++) {
+		struct sdiaudio_group_s *grp = &channels->group[g];
 
-		p += audioChannelCount;
+		pthread_mutex_lock(&grp->mutex);
+		grp->hot.probeInterval = buffers;
+		grp->hot.probeCount = 0;
+		pthread_mutex_unlock(&grp->mutex);
 	}
 
-	if (silence > ch->audioPCMLossLimit) {
-		ch->pcm.missingAudioCount++;
-		time_t now;
-		time(&now);
-		if (ch->analyzePCMConsoleDump) {
-			printf("\n\nSilence detected on channel %d (count #%d limit #%d) @ %s\n",
-				channelNr, silence, ch->audioPCMLossLimit, ctime(&now));
-			if (channelNr == 0) {
-				genericDumpAudioPayload(data, sampleFrameCount, audioChannelCount, audioSampleDepth);
-			}
-		}
-	}
+	return 0;
 }
 
-/* Write many channels at once to the internal channels.
- * The buffer is assumed to start with group 1 channel 0.
- * G1C0 | G1C1 | G1C2 | G1C3 | G2C0 | G2C1 | .... up to G4C3
- * zero on success else < zero.
- * */
-int ltnsdi_audio_channels_write(struct ltnsdi_context_s *ctx, uint8_t *buf,
-        uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame, uint32_t frameStrideBytes)
+int ltnsdi_context_set_load_shedding(struct ltnsdi_context_s *ctx, unsigned int budgetPercent,
+	const enum ltnsdi_shed_e *order, unsigned int count)
 {
 	struct sdiaudio_channels_s *channels = getChannels(ctx);
 
-	if (channelsPerFrame >  MAXSDI_AUDIO_CHANNELS)
+	static const enum ltnsdi_shed_e defaultOrder[] = {
+		LTNSDI_SHED_DBFS, LTNSDI_SHED_HUNT, LTNSDI_SHED_PCM_DECIMATE
+	};
+	if (!order) {
+		order = defaultOrder;
+		count = sizeof(defaultOrder) / sizeof(defaultOrder[0]);
+	}
+
+	/* Measuring the load reads the clock on every write. */
+	if (budgetPercent && channels->realtime.enabled)
 		return -1;
 
-	pthread_mutex_lock(&channels->mutex);
+	uint32_t seen = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		if (order[i] < LTNSDI_SHED_DBFS || order[i] >= LTNSDI_SHED_MAX || (seen & (1 << order[i])))
+			return -1;
+		seen |= 1 << order[i];
+	}
 
-	for (int i = 0; i < channelsPerFrame; i++) {
-		struct sdiaudio_channel_s *ch = &channels->ch[i];
+	/* The analyzing thread owns the load state, make sure it's idle. */
+	if (channels->async)
+		sdiaudio_async_flush(channels->async);
 
-		if (ch->analyzePCM) {
-			checkForSilence(ch, (const uint8_t *)buf, audioFrames, i, channelsPerFrame, sampleDepth);
-		}
+	for (unsigned int i = 0; i < count; i++)
+		channels->load.order[i] = order[i];
+	channels->load.orderCount = count;
+	channels->load.budgetPercent = budgetPercent;
+	channels->load.calm = 0;
+	channels->load.level = 0;
+	sdiaudio_channels_shed_apply(channels);
 
-		struct timeval tv;
-		gettimeofday(&tv, NULL);
-		if (sdiaudio_channel_getType(ch) != AUDIO_TYPE_UNUSED) {
+	return 0;
+}
 
-			if (sdiaudio_channel_getType(ch) == AUDIO_TYPE_SMPTE337) {
-				if (tv.tv_sec >= ch->smpte337.last_update.tv_sec + 2) {
-					sdiaudio_channel_setType(ch, AUDIO_TYPE_UNUSED);
-					ch->wordLength = 0;
-					continue;
-				}
-			} else
-			if (sdiaudio_channel_getType(ch) == AUDIO_TYPE_PCM) {
-				if (tv.tv_sec >= ch->pcm.last_update.tv_sec + 2) {
-					sdiaudio_channel_setType(ch, AUDIO_TYPE_UNUSED);
-					ch->wordLength = 0;
-					continue;
-				}
-			} else
-				sdiaudio_channel_setType(ch, AUDIO_TYPE_UNUSED);
-		}
+int ltnsdi_context_set_housekeeping(struct ltnsdi_context_s *ctx, unsigned int intervalMs)
+{
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
 
-		int sampleOffset = (i * (sampleDepth / 8));
-		if (ch->smpte337.detector) {
-			smpte337_detector_write(ch->smpte337.detector, buf + sampleOffset, audioFrames, sampleDepth,
-				channelsPerFrame, frameStrideBytes);
-		}
+	/* The housekeeper holds each group's lock, the writer would wait on it. */
+	if (intervalMs && channels->realtime.enabled)
+		return -1;
 
-		if (sdiaudio_channel_getType(ch) == AUDIO_TYPE_SMPTE337)
-			continue;
+	if (channels->housekeeping) {
+		sdiaudio_housekeeping_free(channels->housekeeping);
+		channels->housekeeping = NULL;
+	}
 
-		/* Now process the payload as if its PCM. */
+	/* From here on the write path leaves aging, rollover and publishing alone, or resumes them. */
+	for (int g = 0; g < channels->groupCount; g++) {
+		struct sdiaudio_group_s *grp = &channels->group[g];
+		pthread_mutex_lock(&grp->mutex);
+		grp->hot.housekept = intervalMs > 0;
+		grp->housekeepSeen = grp->now;
+		grp->housekeepStalledUs = 0;
+		pthread_mutex_unlock(&grp->mutex);
+	}
 
-		/* De-interleave the sample. */
-		int32_t largestSample = 0;
-		uint8_t *dat = demuxChannelWords(ctx, buf, audioFrames, sampleDepth, channelsPerFrame, frameStrideBytes, i, &largestSample);
-		if (!dat)
-			continue;
+	if (intervalMs == 0)
+		return 0;
 
-		/* Convert from stream specific format into LE */
-		if (largestSample == 0) {
-			if (sdiaudio_channel_getType(ch) == AUDIO_TYPE_PCM) {
-				ch->pcm.emptyBufferCount++;
+	if (sdiaudio_housekeeping_alloc(&channels->housekeeping, channels, intervalMs) < 0) {
+		ltnsdi_context_set_housekeeping(ctx, 0);
+		return -1;
+	}
 
-				if (ch->pcm.emptyBufferCount > 128) {
-					/* No actual data, flag this sample as unused. */
-					sdiaudio_channel_setType(ch, AUDIO_TYPE_UNUSED);
-					sdiaudio_channel_statsUpdate(ch);
-					ch->wordLength = 0;
-				}
-			}
-		} else {
-//printf("ch g%dc%dPCM largest sample = 0x%x\n", ch->groupNr, ch->channelNr, largestSample);
-			sdiaudio_channel_setType(ch, AUDIO_TYPE_PCM);
-			sdiaudio_channel_statsUpdate(ch);
-			ch->pcm.emptyBufferCount = 0;
-		}
-		incrementChannelBitsPs(ctx, ch, ch->wordLength * audioFrames);
+	return 0;
+}
 
-		if (sdiaudio_channel_getType(ch) == AUDIO_TYPE_PCM) {
-			/* We don't know if these PCM samples ar 16/20/24/32 but, calculate the  size in bitwidth.  */
-			/* Lets scan the channel, see if our samples are 16, 20 or 24 bit constrained. */
-			int bits = 0;
-			for (int z = 31; z > 0; z--) {
-				if (largestSample & (1 << z)) {
-					bits = z + 1;
-					break;
-				}
-			}
+int ltnsdi_context_set_async(struct ltnsdi_context_s *ctx, unsigned int slots, uint32_t slotBytes)
+{
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
 
-			/* Measuring the largest sample only hints at the bitwidth.
-			 * For example, the smallest sample in actuality can only be 16bit.
-			 * Round accordingly. */
-			if (bits <= 16)
-				bits = 16;
-			else
-			if (bits <= 32)
-				bits = 32;
+	/* Anything already queued is analyzed before the old queue goes away. */
+	if (channels->async) {
+		uint64_t bytes = channels->realtime.lockedBytes;
+		if (channels->realtime.enabled)
+			sdiaudio_async_mlock(channels->async, 0, &bytes);
+		__atomic_store_n(&channels->realtime.lockedBytes, bytes, __ATOMIC_RELAXED);
 
-			ch->wordLength = bits;
+		sdiaudio_async_free(channels->async);
+		channels->async = NULL;
+	}
 
+	if (slots == 0)
+		return 0;
 
-			/* Generate a dbFS measurement. Where maximum power is 0dbFS, and minimum is -90dbFS. */
-			double x = largestSample;
-			if (bits <= 16) {
-				/* 16 bit */
-				ch->pcm.dbFS = 20 * log10( x / 32767.0);
-			} else
-			if (bits <= 20) {
-				/* TODO: Test this. */
-				/* 20bit */
-				ch->pcm.dbFS = 20 * log10( x / 524287.0);
-			} else
-			if (bits <= 24) {
-				/* TODO: Test this. */
-				/* 24bit */
-				ch->pcm.dbFS = 20 * log10( x / 8388607.0);
-			} else
-			if (bits <= 32) {
-				/* TODO: Test this. */
-				/* 32bit */
-				ch->pcm.dbFS = 20 * log10( x / 2147483647.0);
-			}
-		} /* If ch == PCM */
+	if (slotBytes == 0)
+		slotBytes = SDI_AUDIO_ASYNC_SLOT_DEFAULT(channels->channelCount);
 
-//		printf("g%dc%d: %.03fdbFS largest: %08x\n", ch->groupNr, ch->channelNr, ch->pcm.dbFS, largestSample);
+	if (sdiaudio_async_alloc(&channels->async, channels, slots, slotBytes) < 0)
+		return -1;
 
-		free(dat);
+	/* The queue is context memory too. */
+	if (channels->realtime.enabled) {
+		uint64_t bytes = channels->realtime.lockedBytes;
+		int ret = sdiaudio_async_mlock(channels->async, 1, &bytes);
+		__atomic_store_n(&channels->realtime.lockedBytes, bytes, __ATOMIC_RELAXED);
+		if (ret < 0) {
+			ltnsdi_context_set_async(ctx, 0, 0);
+			return -1;
+		}
 	}
 
-	pthread_mutex_unlock(&channels->mutex);
 	return 0;
 }
 
-int sdiaudio_channels_alloc(struct sdiaudio_channels_s **ctx)
+int ltnsdi_context_set_realtime(struct ltnsdi_context_s *ctx, int enabled)
 {
-	struct sdiaudio_channels_s *o = calloc(1, sizeof(*o));
-	if (!o)
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
+
+	/* Each of these blocks the writer, or reads the clock, on every write. */
+	if (enabled && (channels->workers || channels->housekeeping || channels->load.budgetPercent))
 		return -1;
 
-	*ctx = o;
+	/* The analyzing thread is about to gain or lose its guarantees, make sure it's idle. */
+	if (channels->async)
+		sdiaudio_async_flush(channels->async);
 
-	pthread_mutex_init(&o->mutex, NULL);
-	memset(&o->ch, 0, sizeof(o->ch));
+	if (channels->realtime.enabled) {
+		munlock(ctx, sizeof(*ctx));
+		sdiaudio_channels_realtime_release(channels);
+	}
 
-	for (int g = 0; g < SDI_AUDIO_GROUPS; g++) {
-		for (int c = 0; c < SDI_AUDIO_CHANNELS; c++) {
-			struct sdiaudio_channel_s *ch = &o->ch[ (g * SDI_AUDIO_GROUPS) + c ];
+	if (!enabled)
+		return 0;
 
-			ch->groupNr = g + 1;
-			ch->channelNr = c;
-			ch->analyzePCM = 0;
-			ch->audioPCMLossLimit = 24;
-			ch->analyzePCMConsoleDump = 1;
+	uint64_t bytes = 0;
+	if (sdiaudio_channels_realtime_reserve(channels) < 0 || sdiaudio_mlock(ctx, sizeof(*ctx), 1, &bytes) < 0) {
+		sdiaudio_channels_realtime_release(channels);
+		return -1;
+	}
+	__atomic_store_n(&channels->realtime.lockedBytes, channels->realtime.lockedBytes + bytes, __ATOMIC_RELAXED);
 
-			if (c == 0 || c == 2)
-				ch->pairedChannel = &o->ch[ (g * SDI_AUDIO_GROUPS) + c + 1 ];
-			else
-			if (c == 1 || c == 3)
-				ch->pairedChannel = &o->ch[ (g * SDI_AUDIO_GROUPS) + c - 1 ];
+	return 0;
+}
 
-			ch->userContext = NULL;
-			sdiaudio_channel_setType(ch, AUDIO_TYPE_UNDEFINED);
-			ch->wordLength = 0;
+int ltnsdi_analyzer_add(struct ltnsdi_context_s *ctx, const struct ltnsdi_analyzer_s *analyzer, void *userContext,
+	uint64_t channelMask)
+{
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
 
-			/* PCM */
-			ch->pcm.samplesWritten = 0;
-			ch->pcm.sampleRateHz = 0;
+	if (!analyzer || !analyzer->block || !channelMask)
+		return -1;
+	if (channels->channelCount < 64 && (channelMask >> channels->channelCount))
+		return -1;
 
-			/* SMPTE 337 */
-			ch->smpte337.framesWritten = 0;
-			ch->smpte337.detector = smpte337_detector_alloc((smpte337_detector_callback)detector_callback, ch);
-			if (!ch->smpte337.detector) {
-				return -1;
-			}
+	/* Every group it's added to must have room, and not already run it. */
+	for (int g = 0; g < channels->groupCount; g++) {
+		struct sdiaudio_group_s *grp = &channels->group[g];
+		if (!((channelMask >> (g * SDI_AUDIO_CHANNELS)) & 0xf))
+			continue;
+		if (grp->moduleCount >= SDI_AUDIO_MODULES_MAX || sdiaudio_group_module_find(grp, analyzer, userContext) >= 0)
+			return -1;
+	}
+
+	for (int g = 0; g < channels->groupCount; g++) {
+		struct sdiaudio_group_s *grp = &channels->group[g];
+		uint32_t mask = (channelMask >> (g * SDI_AUDIO_CHANNELS)) & 0xf;
+		if (!mask)
+			continue;
+
+		pthread_mutex_lock(&grp->mutex);
+		int ret = sdiaudio_group_module_add(grp, analyzer, userContext, mask);
+		pthread_mutex_unlock(&grp->mutex);
+
+		if (ret < 0) {
+			ltnsdi_analyzer_remove(ctx, analyzer, userContext);
+			return -1;
 		}
 	}
 
 	return 0;
 }
 
-void sdiaudio_channels_free(struct sdiaudio_channels_s *ctx)
+int ltnsdi_analyzer_remove(struct ltnsdi_context_s *ctx, const struct ltnsdi_analyzer_s *analyzer, void *userContext)
 {
-	/* Acquire the mutex, prevent futher callbacks, prevent further use, and destroy the channels. */
-	pthread_mutex_lock(&ctx->mutex);
-
-	for (int i = 0; i < MAXSDI_AUDIO_CHANNELS; i++) {
-		struct sdiaudio_channel_s *ch = &ctx->ch[i];
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
+	int found = 0;
 
-		/* Destroy the channel, regardless of type. */
-		/* PCM */
+	for (int g = 0; g < channels->groupCount; g++) {
+		struct sdiaudio_group_s *grp = &channels->group[g];
 
-		/* SMPTE 337 */
-		if (ch->smpte337.detector) {
-			smpte337_detector_free(ch->smpte337.detector);
+		pthread_mutex_lock(&grp->mutex);
+		int m = sdiaudio_group_module_find(grp, analyzer, userContext);
+		if (m >= 0) {
+			sdiaudio_group_module_remove(grp, m);
+			found = 1;
 		}
+		pthread_mutex_unlock(&grp->mutex);
 	}
 
-	/* Intensionally leave the mutex locked. */
-	free(ctx);
+	return found ? 0 : -1;
+}
+
+int ltnsdi_audio_channels_flush(struct ltnsdi_context_s *ctx)
+{
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
+
+	if (channels->async)
+		sdiaudio_async_flush(channels->async);
+
+	return 0;
 }
 
 #if 0
@@ -541,34 +1916,53 @@ static void createDateString(time_t n, char *dst)
 
 int ltnsdi_status_alloc(struct ltnsdi_context_s *ctx, struct ltnsdi_status_s **status)
 {
-	struct ltnsdi_status_s *s = calloc(1, sizeof(*s));
+	struct sdiaudio_channels_s *channels = getChannels(ctx);
+
+	/* One allocation, the channels follow the report. */
+	struct ltnsdi_status_s *s = calloc(1, sizeof(*s) + (channels->channelCount * sizeof(*s->channels)));
 	if (!s)
 		return -1;
 
-	struct sdiaudio_channels_s *channels = getChannels(ctx);
-
-	int ltn_pairs[16] = { 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8 };
+	s->channelCount = channels->channelCount;
+	s->channels = (struct ltnsdi_status_channel_s *)(s + 1);
+
+	/* Copy the statistics the writer last published, then do all of the
+	 * formatting here on the readers thread, never holding up the writer.
+	 */
+	struct sdiaudio_channel_snapshot_s snap[SDI_AUDIO_CHANNELS_MAX];
+	s->memory.totalBytes = sizeof(*channels) + (channels->groupCount * sizeof(*channels->group)) +
+		__atomic_load_n(&channels->convertSize, __ATOMIC_RELAXED);
+	s->realtime.enabled = __atomic_load_n(&channels->realtime.enabled, __ATOMIC_RELAXED);
+	s->realtime.lockedBytes = __atomic_load_n(&channels->realtime.lockedBytes, __ATOMIC_RELAXED);
+
+	for (int g = 0; g < channels->groupCount; g++) {
+		struct sdiaudio_group_memory_s memory;
+		sdiaudio_snapshot_read(&channels->group[g], &snap[g * SDI_AUDIO_CHANNELS], &memory);
+
+		s->memory.totalBytes += memory.scratchBytes + memory.detectorBytes;
+		s->memory.detectorBytes += memory.detectorBytes;
+		s->memory.detectorBuffers += memory.detectorBuffers;
+	}
 
-	pthread_mutex_lock(&channels->mutex);
-	for (int i = 0; i < MAXSDI_AUDIO_CHANNELS; i++) {
-		struct sdiaudio_channel_s *ch = &channels->ch[i];
+	for (int i = 0; i < s->channelCount; i++) {
+		struct sdiaudio_channel_snapshot_s *ch = &snap[i];
 
-		s->channels[i].LTNPairNumber = ltn_pairs[i];
+		s->channels[i].LTNPairNumber = (i / 2) + 1;
 		s->channels[i].LTNChannelNumber = i + 1;
 		s->channels[i].groupNumber = ch->groupNr;
 		s->channels[i].channelNumber = ch->channelNr + 1;
 		s->channels[i].wordLength = ch->wordLength;
+		s->channels[i].buffersProcessed = ch->buffersProcessed;
+		s->channels[i].lastBufferArrival = ch->lastBufferArrival;
 
-		switch (sdiaudio_channel_getType(ch)) {
+		s->channels[i].type = sdiaudio_channel_type_public(ch->type);
+		switch (ch->type) {
 		case AUDIO_TYPE_PCM:
-			s->channels[i].type = 1;
-			s->channels[i].buffersProcessed = ch->pcm.samplesWritten;
-			s->channels[i].lastBufferArrival = ch->pcm.last_update;
-			s->channels[i].pcm_dbFS = ch->pcm.dbFS;
-			if (isinf(ch->pcm.dbFS))
+			s->channels[i].pcm_dbFS = ch->dbFS;
+			if (isinf(ch->dbFS))
 				sprintf((char *)s->channels[i].pcm_dbFSDescription, "   N/A");
 			else
-				sprintf((char *)s->channels[i].pcm_dbFSDescription, "% 04.02f", ch->pcm.dbFS);
+				sprintf((char *)s->channels[i].pcm_dbFSDescription, "% 04.02f", ch->dbFS);
 			sprintf((char *)s->channels[i].smpte337_dataTypeDescription, "N/A");
 
 			if (s->channels[i].channelNumber == 2 || s->channels[i].channelNumber == 4)
@@ -576,29 +1970,28 @@ int ltnsdi_status_alloc(struct ltnsdi_context_s *ctx, struct ltnsdi_status_s **s
 			else
 				sprintf((char *)s->channels[i].pcm_channelDescription, "Left");
 
-			s->channels[i].pcm_Hz = ch->bitsPsCurrent / ch->wordLength;
-			s->channels[i].pcm_missingAudioCount = ch->pcm.missingAudioCount;
+			if (ch->wordLength)
+				s->channels[i].pcm_Hz = ch->bitsPsCurrent / ch->wordLength;
+			s->channels[i].pcm_missingAudioCount = ch->missingAudioCount;
 			break;
 		case AUDIO_TYPE_SMPTE337:
-			s->channels[i].buffersProcessed = ch->smpte337.framesWritten;
-			s->channels[i].lastBufferArrival = ch->smpte337.last_update;
-			s->channels[i].type = 2;
-			s->channels[i].smpte337_dataMode = ch->smpte337.dataType;
-			s->channels[i].smpte337_dataType = ch->smpte337.dataMode;
+			s->channels[i].smpte337_dataMode = ch->dataType;
+			s->channels[i].smpte337_dataType = ch->dataMode;
 			strncpy((char *)s->channels[i].smpte337_dataTypeDescription,
-				smpte338_lookupDataTypeDescription(ch->smpte337.dataType),
-				sizeof(s->channels[i].smpte337_dataTypeDescription));
+				smpte338_lookupDataTypeDescription(ch->dataType),
+				sizeof(s->channels[i].smpte337_dataTypeDescription) - 1);
+			s->channels[i].smpte337_burstPeriod = ch->burstPeriod;
+			s->channels[i].smpte337_burstJitter = ch->burstJitter;
+			s->channels[i].smpte337_burstTracking = ch->burstTracking;
+			s->channels[i].smpte337_burstMispredictions = ch->burstMispredictions;
 			break;
 		default:
 		case AUDIO_TYPE_UNUSED:
-			s->channels[i].buffersProcessed = ch->unused.unusedSampleCount;
-			s->channels[i].lastBufferArrival = ch->unused.last_update;
-			s->channels[i].type = 3;
 			break;
 		}
 		createDateString(s->channels[i].lastBufferArrival.tv_sec, (char *)s->channels[i].lastBufferArrivalDescription);
 
-		strncpy((char *)s->channels[i].typeDescription, sdiaudio_channel_type_name(sdiaudio_channel_getType(ch)), sizeof(s->channels[i].typeDescription));
+		strncpy((char *)s->channels[i].typeDescription, sdiaudio_channel_type_name(ch->type), sizeof(s->channels[i].typeDescription));
 		s->channels[i].typeUpdated = ch->type_last_update; /* Implicit struct copy. */
 
 		createDateString(s->channels[i].typeUpdated.tv_sec, (char *)s->channels[i].typeUpdatedDescription);
@@ -616,7 +2009,17 @@ int ltnsdi_status_alloc(struct ltnsdi_context_s *ctx, struct ltnsdi_status_s **s
 			}
 		}
 	}
-	pthread_mutex_unlock(&channels->mutex);
+
+	if (channels->async)
+		sdiaudio_async_stats(channels->async, s);
+
+	s->load.enabled = channels->load.budgetPercent > 0;
+	s->load.level = __atomic_load_n(&channels->load.level, __ATOMIC_RELAXED);
+	s->load.shed = __atomic_load_n(&channels->load.shed, __ATOMIC_RELAXED);
+	s->load.budgetUs = __atomic_load_n(&channels->load.budgetUs, __ATOMIC_RELAXED);
+	s->load.lastUs = __atomic_load_n(&channels->load.lastUs, __ATOMIC_RELAXED);
+	s->load.peakUs = __atomic_load_n(&channels->load.peakUs, __ATOMIC_RELAXED);
+	s->load.overruns = __atomic_load_n(&channels->load.overruns, __ATOMIC_RELAXED);
 
 	*status = s;
 	return 0; /* Success */
@@ -631,15 +2034,15 @@ int ltnsdi_audio_channels_analyze_pcm_enable(struct ltnsdi_context_s *ctx, unsig
 {
 	struct sdiaudio_channels_s *channels = getChannels(ctx);
 
-	if (channelNr > MAXSDI_AUDIO_CHANNELS)
+	if (channelNr >= channels->channelCount)
 		return -1;
 
-	pthread_mutex_lock(&channels->mutex);
+	struct sdiaudio_channel_s *ch = sdiaudio_channel_get(channels, channelNr);
 
-	struct sdiaudio_channel_s *ch = &channels->ch[channelNr];
-	ch->analyzePCM = truefalse ? 1 : 0;
-
-	pthread_mutex_unlock(&channels->mutex);
+	pthread_mutex_lock(&ch->group->mutex);
+	sdiaudio_hot(ch, analyzePCM) = truefalse ? 1 : 0;
+	sdiaudio_group_idle_update(ch->group);
+	pthread_mutex_unlock(&ch->group->mutex);
 
 	return 0;
 }
@@ -648,15 +2051,14 @@ int ltnsdi_audio_channels_analyze_pcm_limit(struct ltnsdi_context_s *ctx, unsign
 {
 	struct sdiaudio_channels_s *channels = getChannels(ctx);
 
-	if (channelNr > MAXSDI_AUDIO_CHANNELS)
+	if (channelNr >= channels->channelCount)
 		return -1;
 
-	pthread_mutex_lock(&channels->mutex);
-
-	struct sdiaudio_channel_s *ch = &channels->ch[channelNr];
-	ch->audioPCMLossLimit = limit;
+	struct sdiaudio_channel_s *ch = sdiaudio_channel_get(channels, channelNr);
 
-	pthread_mutex_unlock(&channels->mutex);
+	pthread_mutex_lock(&ch->group->mutex);
+	sdiaudio_hot(ch, audioPCMLossLimit) = limit;
+	pthread_mutex_unlock(&ch->group->mutex);
 
 	return 0;
 }
@@ -665,16 +2067,19 @@ int ltnsdi_audio_channels_analyze_pcm_reset(struct ltnsdi_context_s *ctx)
 {
 	struct sdiaudio_channels_s *channels = getChannels(ctx);
 
-	pthread_mutex_lock(&channels->mutex);
+	for (int g = 0; g < channels->groupCount; g++) {
+		struct sdiaudio_group_s *grp = &channels->group[g];
 
-	for (int i = 0; i < MAXSDI_AUDIO_CHANNELS; i++) {
-		struct sdiaudio_channel_s *ch = &channels->ch[i];
-		ch->pcm.missingAudioCount = 0;
-		ch->pcm.sequentialAudioSilence = 0;
+		pthread_mutex_lock(&grp->mutex);
+		for (int c = 0; c < SDI_AUDIO_CHANNELS; c++) {
+			struct sdiaudio_channel_s *ch = &grp->ch[c];
+			ch->pcm.missingAudioCount = 0;
+			sdiaudio_hot(ch, sequentialAudioSilence) = 0;
+		}
+		sdiaudio_snapshot_publish(grp);
+		pthread_mutex_unlock(&grp->mutex);
 	}
 
-	pthread_mutex_unlock(&channels->mutex);
-
 	return 0;
 }
 
@@ -682,12 +2087,13 @@ int ltnsdi_audio_channels_analyze_pcm_console_dump(struct ltnsdi_context_s *ctx,
 {
 	struct sdiaudio_channels_s *channels = getChannels(ctx);
 
-	pthread_mutex_lock(&channels->mutex);
-	for (int i = 0; i < MAXSDI_AUDIO_CHANNELS; i++) {
-		struct sdiaudio_channel_s *ch = &channels->ch[i];
+	for (int i = 0; i < channels->channelCount; i++) {
+		struct sdiaudio_channel_s *ch = sdiaudio_channel_get(channels, i);
+
+		pthread_mutex_lock(&ch->group->mutex);
 		ch->analyzePCMConsoleDump = truefalse ? 1 : 0;
+		pthread_mutex_unlock(&ch->group->mutex);
 	}
-	pthread_mutex_unlock(&channels->mutex);
 
 	return 0;
 }
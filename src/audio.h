@@ -41,16 +41,30 @@
 #include <sys/time.h>
 
 #include "ltnsdi-private.h"
+#include "audio_kernels.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define SDI_AUDIO_GROUPS    4
 #define SDI_AUDIO_CHANNELS  4
-#define MAXSDI_AUDIO_CHANNELS (SDI_AUDIO_GROUPS * SDI_AUDIO_CHANNELS)
+#define SDI_AUDIO_CHANNELS_MAX LTNSDI_AUDIO_CHANNELS_MAX
+#define SDI_AUDIO_GROUPS_MAX (SDI_AUDIO_CHANNELS_MAX / SDI_AUDIO_CHANNELS)
+
+/* What ltnsdi_context_alloc() sizes a context for, a single SDI link. */
+#define SDI_AUDIO_CHANNELS_DEFAULT 16
+
+/* SDI embedded audio is always 48KHz, which is what a packet's duration is derived from. */
+#define SDI_AUDIO_SAMPLE_RATE 48000
+
+/* Work being shed is only done on one buffer in this many. */
+#define SDI_AUDIO_SHED_DECIMATE 4
+
+/* Consecutive writes comfortably within budget before shed work is restored, a level at a time. */
+#define SDI_AUDIO_SHED_CALM 32
 
 struct smpte337_detector_s;
+struct sdiaudio_group_s;
 
 enum sdiaudio_channel_type_e
 {
@@ -60,29 +74,22 @@ enum sdiaudio_channel_type_e
 	AUDIO_TYPE_UNUSED,	/* We didn't detect SMPTE337 headers, and the channel consistently has zeros for data. */
 };
 
+/* A channel's state that the write path rarely reads, its statistics and identity. Everything
+ * consulted for every buffer lives in the group's sdiaudio_group_hot_s, see sdiaudio_hot().
+ */
 struct sdiaudio_channel_s
 {
-	uint32_t groupNr;	/* 1-4 */
+	uint32_t groupNr;	/* 1-16 */
 	uint32_t channelNr;	/* 0-3 */
 
 	void *userContext;
 
-	enum sdiaudio_channel_type_e type;
 	struct timeval type_last_update;
 
-	/* Bitrate PS */
-	uint64_t bitsPsCurrent;
-	uint64_t bitsNow;
-	time_t   bitsNowTime;
-
-	/* Flag this channels as due for analysis */
-	unsigned int analyzePCM;
-	unsigned int audioPCMLossLimit;
 	unsigned int analyzePCMConsoleDump;
 
 	/* Statistics */
 	struct {
-		struct smpte337_detector_s *detector;
 		uint64_t framesWritten;
 		struct timeval last_update;
 		uint32_t dataType;
@@ -91,13 +98,9 @@ struct sdiaudio_channel_s
 	struct {
 		uint64_t samplesWritten;
 		uint32_t sampleRateHz; /* Eg. 48000, 44100 */
-		/* dbFS for the first sample in the last buffer. 0dbFS maximum volume, -90dbFS basically silence. */
-		double dbFS;
 		struct timeval last_update;
-		uint32_t emptyBufferCount;
 
 		uint64_t missingAudioCount;
-		int sequentialAudioSilence;
 	} pcm;
 	struct {
 		uint64_t unusedSampleCount;
@@ -105,17 +108,286 @@ struct sdiaudio_channel_s
 	} unused;
 	/* End: Statistics */
 
-	uint32_t wordLength;	/* 0 (Unset), 16, 20 or 24. */
 	struct sdiaudio_channel_s *pairedChannel;
+	struct sdiaudio_group_s *group;
 };
 
-struct sdiaudio_channels_s
+/* Enough for a group of 32bit 23.98fps audio (2002 frames per packet), the
+ * largest packet a DeckLink card will hand us. Larger packets grow the scratch once.
+ */
+#define SDI_AUDIO_SCRATCH_DEFAULT (SDI_AUDIO_CHANNELS * 2002 * sizeof(int32_t))
+
+/* Unformatted copy of a channel's statistics, as published for status readers. */
+struct sdiaudio_channel_snapshot_s
+{
+	uint32_t groupNr;
+	uint32_t channelNr;
+	uint32_t wordLength;
+	enum sdiaudio_channel_type_e type;
+	struct timeval type_last_update;
+
+	/* Taken from the pcm, smpte337 or unused stats, depending on type. */
+	uint64_t buffersProcessed;
+	struct timeval lastBufferArrival;
+
+	uint64_t bitsPsCurrent;
+	double dbFS;
+	uint64_t missingAudioCount;
+	uint32_t dataType;
+	uint32_t dataMode;
+	double burstPeriod;	/* Audio frames between bursts, zero until measured. */
+	double burstJitter;
+	uint32_t burstTracking;
+	uint64_t burstMispredictions;
+};
+
+/* Memory a group holds, published alongside its statistics. */
+struct sdiaudio_group_memory_s
+{
+	uint64_t scratchBytes;
+	uint64_t detectorBytes;
+	uint32_t detectorBuffers;
+};
+
+/* Seqlock protected statistics. The writer (holding the group mutex) bumps seq
+ * to an odd value, updates the channels, then bumps it to even again. Readers never
+ * take a lock, they copy the channels and retry if seq was odd or changed underneath them.
+ */
+struct sdiaudio_snapshot_s
+{
+	uint32_t seq;
+	struct sdiaudio_channel_snapshot_s ch[SDI_AUDIO_CHANNELS];
+	struct sdiaudio_group_memory_s memory;
+};
+
+/* One buffer, as handed to ltnsdi_audio_channels_write_ts() or _write_planar(), ready to be
+ * processed by every group, potentially on different threads.
+ */
+struct sdiaudio_write_s
+{
+	uint8_t *buf;
+	uint8_t **planes;	/* Planar input, one buffer per channel, used instead of buf when set. */
+	enum ltnsdi_audio_format_e format;	/* Anything but S32 is converted before analysis. */
+	const struct ltnsdi_audio_plan_s *plan;	/* Optional, kernels bound to this layout. */
+	struct ltnsdi_audio_results_s *results;	/* Optional, filled in for the caller as each group finishes. */
+	uint32_t audioFrames;
+	uint32_t sampleDepth;
+	uint32_t channelsPerFrame;
+	uint32_t frameStrideBytes;
+	struct timeval now;
+};
+
+/* A fixed input layout, resolved once to the kernels that handle it. */
+struct ltnsdi_audio_plan_s
+{
+	struct ltnsdi_context_s *ctx;
+	enum ltnsdi_audio_format_e format;
+	uint32_t channelsPerFrame;
+	uint32_t frameStrideBytes;
+
+	/* Per group de-interleave, applied after any format conversion. */
+	sdiaudio_deinterleave_func deinterleave[SDI_AUDIO_GROUPS_MAX];
+};
+
+/* Every field the write path reads or writes for each buffer, for all four channels of a group.
+ * One array per field, indexed by channel, so a pass over the group touches a few cache lines
+ * instead of every channel's full record.
+ */
+struct sdiaudio_group_hot_s
+{
+	enum sdiaudio_channel_type_e type[SDI_AUDIO_CHANNELS];
+	uint32_t wordLength[SDI_AUDIO_CHANNELS];	/* 0 (Unset), 16, 20 or 24. */
+
+	/* Flag this channels as due for analysis */
+	uint32_t analyzePCM[SDI_AUDIO_CHANNELS];
+	uint32_t audioPCMLossLimit[SDI_AUDIO_CHANNELS];
+
+	uint32_t emptyBufferCount[SDI_AUDIO_CHANNELS];
+	int32_t  sequentialAudioSilence[SDI_AUDIO_CHANNELS];
+
+	/* dbFS for the first sample in the last buffer. 0dbFS maximum volume, -90dbFS basically silence. */
+	double dbFS[SDI_AUDIO_CHANNELS];
+
+	/* Seconds at which the channel last carried PCM or SMPTE 337, whichever it currently is. */
+	time_t   lastActive[SDI_AUDIO_CHANNELS];
+
+	/* Bitrate PS */
+	uint64_t bitsPsCurrent[SDI_AUDIO_CHANNELS];
+	uint64_t bitsNow[SDI_AUDIO_CHANNELS];
+	time_t   bitsNowTime[SDI_AUDIO_CHANNELS];
+
+	struct smpte337_detector_s *detector[SDI_AUDIO_CHANNELS];
+
+	/* SMPTE 337 bursts the detector completed during the buffer being processed. */
+	uint32_t bursts[SDI_AUDIO_CHANNELS];
+
+	/* Channels that only need probing for signal, see sdiaudio_group_idle_update(). */
+	uint32_t idleMask;
+	uint32_t probeInterval;		/* Probe idle channels on one buffer in this many. */
+	uint32_t probeCount;
+
+	/* Aging, bitrate rollover and publishing are left to the housekeeping thread. */
+	uint32_t housekept;
+
+	/* Work currently shed, a bitmask of (1 << enum ltnsdi_shed_e), see sdiaudio_channels_shed_update(). */
+	uint32_t shed;
+	uint32_t shedPhase;
+} __attribute__((aligned(64)));
+
+/* Built in analyzers, silence detection and dbFS, run ahead of any the caller adds. */
+#define SDI_AUDIO_MODULES_BUILTIN 2
+#define SDI_AUDIO_MODULES_MAX (SDI_AUDIO_MODULES_BUILTIN + LTNSDI_ANALYZERS_MAX)
+
+/* An analyzer as a group runs it, on the channels of the group it was added to. */
+struct sdiaudio_module_s
+{
+	const struct ltnsdi_analyzer_s *analyzer;
+	void *userContext;
+	uint32_t mask;			/* Channels of this group, bit 0 is channel 0. */
+	void *state[SDI_AUDIO_CHANNELS];
+};
+
+/* A channel's hot field, by way of its group. */
+#define sdiaudio_hot(ch, field) ((ch)->group->hot.field[(ch)->channelNr])
+
+/* An SDI audio group, four channels. Groups share nothing, each has its
+ * own lock, working memory and published statistics, so each can be processed
+ * on a different core. Cache line aligned so neighbouring groups don't false share.
+ */
+struct sdiaudio_group_s
 {
 	pthread_mutex_t mutex;
-	struct sdiaudio_channel_s ch[MAXSDI_AUDIO_CHANNELS];
+	uint32_t groupNr;	/* 1-16 */
+
+	/* Timestamp of the buffer currently being written, every time related
+	 * statistic is derived from this rather than the system clock.
+	 */
+	struct timeval now;
+
+	/* Working memory for the write path, sized at alloc time and only ever grown,
+	 * never released until the context is freed. Protected by the mutex.
+	 */
+	uint8_t *scratch;
+	size_t scratchSize;
+
+	/* Real-time mode, scratch is no longer grown and SMPTE 337 bursts are read into payload,
+	 * shared by the groups detectors. Protected by the mutex.
+	 */
+	uint32_t realtime;
+	uint8_t *payload;
+	size_t payloadSize;
+
+	/* Each channel's de-interleaved samples for the current packet, pointing into scratch. */
+	int32_t *planes[SDI_AUDIO_CHANNELS];
+
+	struct sdiaudio_group_hot_s hot;
+
+	/* Only touched by the housekeeping thread, how long now has stood still. */
+	struct timeval housekeepSeen;
+	uint64_t housekeepStalledUs;
+
+	/* Results of the most recent sweep, one per channel. */
+	struct sdiaudio_channel_analysis_s analysis[SDI_AUDIO_CHANNELS];
+
+	/* Analyzers handed each measured channel's samples, in order. Protected by the mutex. */
+	struct sdiaudio_module_s module[SDI_AUDIO_MODULES_MAX];
+	uint32_t moduleCount;
+
+	/* Cold, touched as statistics change. */
+	struct sdiaudio_channel_s ch[SDI_AUDIO_CHANNELS];
+
+	/* Statistics as last published for status readers, on lines of their own so
+	 * readers polling seq don't contend with the hot state.
+	 */
+	struct sdiaudio_snapshot_s snapshot __attribute__((aligned(64)));
+} __attribute__((aligned(64)));
+
+struct sdiaudio_workers_s;
+struct sdiaudio_async_s;
+struct sdiaudio_housekeeping_s;
+
+struct sdiaudio_channels_s
+{
+	/* Sized when the context is allocated, four channels to a group. */
+	uint32_t groupCount;
+	uint32_t channelCount;
+	struct sdiaudio_group_s *group;
+
+	/* Optional pool processing groups in parallel, NULL when groups run inline on the callers thread. */
+	struct sdiaudio_workers_s *workers;
+
+	/* Optional queue and thread analyzing buffers after the write call returns, NULL when writes are processed inline. */
+	struct sdiaudio_async_s *async;
+
+	/* Optional thread aging channels and publishing statistics on a timer, NULL when the write path does it. */
+	struct sdiaudio_housekeeping_s *housekeeping;
+
+	/* Load shedding, see ltnsdi_context_set_load_shedding(). Only changed by the thread analyzing
+	 * buffers, the statistics are read by status readers without a lock.
+	 */
+	struct {
+		uint32_t budgetPercent;		/* Of the packet duration, 0 when disabled. */
+		uint32_t order[LTNSDI_SHED_MAX];
+		uint32_t orderCount;
+		uint32_t level;			/* Entries of order currently shed. */
+		uint32_t shed;			/* The same, as a bitmask of (1 << enum ltnsdi_shed_e). */
+		uint32_t calm;
+		uint64_t budgetUs;
+		uint64_t lastUs;
+		uint64_t peakUs;
+		uint64_t overruns;
+	} load;
+
+	/* Real-time mode, see ltnsdi_context_set_realtime(). Buffers written without a timestamp
+	 * are stamped from epoch, advanced by the audio written since, instead of the system clock.
+	 */
+	struct {
+		uint32_t enabled;
+		uint64_t lockedBytes;
+		struct timeval epoch;
+		uint64_t frames;
+	} realtime;
+
+	/* Input converted to 32bit words, allocated on first use of another format and only ever grown.
+	 * Only touched by the thread analyzing buffers.
+	 */
+	int32_t *convert;
+	size_t convertSize;
 };
 
-int sdiaudio_channels_alloc(struct sdiaudio_channels_s **ctx);
+/* Access a channel by its index across all groups. */
+#define sdiaudio_channel_get(channels, nr) \
+	(&(channels)->group[(nr) / SDI_AUDIO_CHANNELS].ch[(nr) % SDI_AUDIO_CHANNELS])
+
+/* Most packets ltnsdi_audio_channels_writev() hands to the groups at once. */
+#define SDI_AUDIO_WRITEV_BATCH 16
+
+int  sdiaudio_group_write(struct sdiaudio_group_s *grp, const struct sdiaudio_write_s *w, uint32_t writeCount);
+int  sdiaudio_channels_write(struct sdiaudio_channels_s *channels, const struct sdiaudio_write_s *w, uint32_t writeCount);
+
+int  sdiaudio_workers_alloc(struct sdiaudio_workers_s **workers, struct sdiaudio_channels_s *channels, unsigned int threads);
+void sdiaudio_workers_free(struct sdiaudio_workers_s *workers);
+int  sdiaudio_workers_run(struct sdiaudio_workers_s *workers, const struct sdiaudio_write_s *w, uint32_t writeCount,
+	uint32_t groupCount);
+
+/* Largest packet of 32bit audio at 23.98fps, for the given number of channels. */
+#define SDI_AUDIO_ASYNC_SLOT_DEFAULT(channelCount) ((channelCount) * 2002 * sizeof(int32_t))
+
+int  sdiaudio_async_alloc(struct sdiaudio_async_s **async, struct sdiaudio_channels_s *channels, unsigned int slots, uint32_t slotBytes);
+void sdiaudio_async_free(struct sdiaudio_async_s *async);
+int  sdiaudio_async_enqueue(struct sdiaudio_async_s *async, const struct sdiaudio_write_s *w);
+void sdiaudio_async_flush(struct sdiaudio_async_s *async);
+void sdiaudio_async_stats(struct sdiaudio_async_s *async, struct ltnsdi_status_s *s);
+int  sdiaudio_async_mlock(struct sdiaudio_async_s *async, int lock, uint64_t *bytes);
+
+void sdiaudio_group_housekeep(struct sdiaudio_group_s *grp, uint64_t elapsedUs);
+
+int  sdiaudio_housekeeping_alloc(struct sdiaudio_housekeeping_s **hk, struct sdiaudio_channels_s *channels, unsigned int intervalMs);
+void sdiaudio_housekeeping_free(struct sdiaudio_housekeeping_s *hk);
+
+int sdiaudio_mlock(const void *p, size_t size, int lock, uint64_t *bytes);
+
+int sdiaudio_channels_alloc(struct sdiaudio_channels_s **ctx, uint32_t channelCount);
 void sdiaudio_channels_free(struct sdiaudio_channels_s *ctx);
 
 #ifdef __cplusplus
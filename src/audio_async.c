@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) LiveTimeNet, Inc. 2017. All Rights Reserved.
+ *
+ * Address: LTN Global Communications, Inc.
+ *          Historic Savage Mill
+ *          Box 2020
+ *          8600 Foundry Street
+ *          Savage, MD 20763
+ *
+ * Contact: sales@ltnglobal.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "audio.h"
+
+/* Single producer (the thread calling write), single consumer (our thread) ring of
+ * preallocated buffers. The producer never blocks and never allocates, when the ring
+ * is full the buffer is dropped and counted.
+ */
+struct sdiaudio_async_slot_s
+{
+	struct sdiaudio_write_s w;	/* w.buf, or w.planes, points at data. */
+	uint8_t *data;
+	uint8_t *planes[SDI_AUDIO_CHANNELS_MAX];
+};
+
+struct sdiaudio_async_s
+{
+	struct sdiaudio_channels_s *channels;
+
+	uint32_t slotCount;		/* Power of two. */
+	uint32_t slotMask;
+	uint32_t slotBytes;
+	struct sdiaudio_async_slot_s *slots;
+	uint8_t *data;
+
+	/* Written by the producer only. */
+	uint32_t head __attribute__((aligned(64)));
+	uint32_t depthHighWater;
+	uint64_t enqueued;
+	uint64_t dropped;
+
+	/* Written by the consumer only. */
+	uint32_t tail __attribute__((aligned(64)));
+
+	sem_t wake;
+	int shutdown;
+	pthread_t thread;
+
+	/* Only used to wake anyone waiting in sdiaudio_async_flush(). */
+	pthread_mutex_t idleMutex;
+	pthread_cond_t idle;
+};
+
+static void *async_thread(void *p)
+{
+	struct sdiaudio_async_s *a = p;
+
+	while (1) {
+		sem_wait(&a->wake);
+
+		uint32_t tail = a->tail;
+		uint32_t head = __atomic_load_n(&a->head, __ATOMIC_ACQUIRE);
+
+		if (tail == head && __atomic_load_n(&a->shutdown, __ATOMIC_ACQUIRE))
+			break;
+
+		while (tail != head) {
+			/* When we've fallen behind, catch up a batch of buffers at a time. */
+			struct sdiaudio_write_s w[SDI_AUDIO_WRITEV_BATCH];
+			uint32_t n = 0;
+			while (tail + n != head && n < SDI_AUDIO_WRITEV_BATCH) {
+				w[n] = a->slots[(tail + n) & a->slotMask].w;
+				n++;
+			}
+
+			sdiaudio_channels_write(a->channels, w, n);
+
+			/* Hand the slots back to the producer. */
+			tail += n;
+			__atomic_store_n(&a->tail, tail, __ATOMIC_RELEASE);
+			head = __atomic_load_n(&a->head, __ATOMIC_ACQUIRE);
+		}
+
+		pthread_mutex_lock(&a->idleMutex);
+		pthread_cond_broadcast(&a->idle);
+		pthread_mutex_unlock(&a->idleMutex);
+	}
+
+	return NULL;
+}
+
+int sdiaudio_async_alloc(struct sdiaudio_async_s **async, struct sdiaudio_channels_s *channels, unsigned int slots, uint32_t slotBytes)
+{
+	uint32_t count = 1;
+	while (count < slots)
+		count <<= 1;
+
+	struct sdiaudio_async_s *a;
+	if (posix_memalign((void **)&a, 64, sizeof(*a)) != 0)
+		return -1;
+	memset(a, 0, sizeof(*a));
+
+	a->channels = channels;
+	a->slotCount = count;
+	a->slotMask = count - 1;
+	a->slotBytes = (slotBytes + 63) & ~63;
+
+	a->slots = calloc(count, sizeof(*a->slots));
+	if (!a->slots || posix_memalign((void **)&a->data, 64, (size_t)count * a->slotBytes) != 0) {
+		free(a->slots);
+		free(a);
+		return -1;
+	}
+
+	/* Touch every page now, the producer must never fault them in. */
+	memset(a->data, 0, (size_t)count * a->slotBytes);
+	for (uint32_t i = 0; i < count; i++)
+		a->slots[i].data = a->data + ((size_t)i * a->slotBytes);
+
+	sem_init(&a->wake, 0, 0);
+	pthread_mutex_init(&a->idleMutex, NULL);
+	pthread_cond_init(&a->idle, NULL);
+
+	if (pthread_create(&a->thread, NULL, async_thread, a) != 0) {
+		pthread_cond_destroy(&a->idle);
+		pthread_mutex_destroy(&a->idleMutex);
+		sem_destroy(&a->wake);
+		free(a->data);
+		free(a->slots);
+		free(a);
+		return -1;
+	}
+
+	*async = a;
+	return 0;
+}
+
+/* Analyze whatever is still queued, then stop the thread. */
+void sdiaudio_async_free(struct sdiaudio_async_s *a)
+{
+	__atomic_store_n(&a->shutdown, 1, __ATOMIC_RELEASE);
+	sem_post(&a->wake);
+	pthread_join(a->thread, NULL);
+
+	pthread_cond_destroy(&a->idle);
+	pthread_mutex_destroy(&a->idleMutex);
+	sem_destroy(&a->wake);
+	free(a->data);
+	free(a->slots);
+	free(a);
+}
+
+/* Called on the producers thread. Copy and return, never block. */
+int sdiaudio_async_enqueue(struct sdiaudio_async_s *a, const struct sdiaudio_write_s *w)
+{
+	uint32_t head = a->head;
+	uint32_t depth = head - __atomic_load_n(&a->tail, __ATOMIC_ACQUIRE);
+	size_t planeBytes = (size_t)w->audioFrames * (w->sampleDepth / 8);
+	size_t bytes;
+	if (w->planes)
+		bytes = planeBytes * w->channelsPerFrame;
+	else
+		bytes = (size_t)w->audioFrames * w->frameStrideBytes;
+
+	if (depth >= a->slotCount || bytes > a->slotBytes) {
+		__atomic_store_n(&a->dropped, a->dropped + 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+
+	struct sdiaudio_async_slot_s *slot = &a->slots[head & a->slotMask];
+	slot->w = *w;
+	if (w->planes) {
+		/* Planes are packed back to back, channels the caller left out stay out. */
+		for (uint32_t c = 0; c < w->channelsPerFrame; c++) {
+			slot->planes[c] = w->planes[c] ? slot->data + (c * planeBytes) : NULL;
+			if (slot->planes[c])
+				memcpy(slot->planes[c], w->planes[c], planeBytes);
+		}
+		slot->w.planes = slot->planes;
+	} else {
+		memcpy(slot->data, w->buf, bytes);
+		slot->w.buf = slot->data;
+	}
+
+	__atomic_store_n(&a->head, head + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&a->enqueued, a->enqueued + 1, __ATOMIC_RELAXED);
+	if (depth + 1 > a->depthHighWater)
+		__atomic_store_n(&a->depthHighWater, depth + 1, __ATOMIC_RELAXED);
+
+	sem_post(&a->wake);
+
+	return 0;
+}
+
+void sdiaudio_async_flush(struct sdiaudio_async_s *a)
+{
+	uint32_t head = a->head;
+
+	pthread_mutex_lock(&a->idleMutex);
+	while (__atomic_load_n(&a->tail, __ATOMIC_ACQUIRE) != head)
+		pthread_cond_wait(&a->idle, &a->idleMutex);
+	pthread_mutex_unlock(&a->idleMutex);
+}
+
+void sdiaudio_async_stats(struct sdiaudio_async_s *a, struct ltnsdi_status_s *s)
+{
+	uint32_t tail = __atomic_load_n(&a->tail, __ATOMIC_ACQUIRE);
+	uint32_t head = __atomic_load_n(&a->head, __ATOMIC_ACQUIRE);
+
+	s->async.enabled = 1;
+	s->async.slots = a->slotCount;
+	s->async.depth = head - tail;
+	s->async.depthHighWater = __atomic_load_n(&a->depthHighWater, __ATOMIC_RELAXED);
+	s->async.enqueued = __atomic_load_n(&a->enqueued, __ATOMIC_RELAXED);
+	s->async.dropped = __atomic_load_n(&a->dropped, __ATOMIC_RELAXED);
+
+	s->memory.totalBytes += sizeof(*a) + ((size_t)a->slotCount * (sizeof(*a->slots) + a->slotBytes));
+}
+
+/* Lock the queue's memory into RAM, or unlock it, see sdiaudio_mlock(). */
+int sdiaudio_async_mlock(struct sdiaudio_async_s *a, int lock, uint64_t *bytes)
+{
+	int ret = 0;
+
+	if (sdiaudio_mlock(a, sizeof(*a), lock, bytes) < 0)
+		ret = -1;
+	if (sdiaudio_mlock(a->slots, a->slotCount * sizeof(*a->slots), lock, bytes) < 0)
+		ret = -1;
+	if (sdiaudio_mlock(a->data, (size_t)a->slotCount * a->slotBytes, lock, bytes) < 0)
+		ret = -1;
+
+	return ret;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) LiveTimeNet, Inc. 2017. All Rights Reserved.
+ *
+ * Address: LTN Global Communications, Inc.
+ *          Historic Savage Mill
+ *          Box 2020
+ *          8600 Foundry Street
+ *          Savage, MD 20763
+ *
+ * Contact: sales@ltnglobal.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#include "audio.h"
+
+/* A thread woken by a timerfd, aging channels, rolling bitrates over and publishing
+ * statistics for every group. Stopped through an eventfd, so free never waits out a tick.
+ */
+struct sdiaudio_housekeeping_s
+{
+	struct sdiaudio_channels_s *channels;
+	uint64_t intervalUs;
+
+	int timerfd;
+	int stopfd;
+	pthread_t thread;
+};
+
+static void *housekeeping_thread(void *p)
+{
+	struct sdiaudio_housekeeping_s *hk = p;
+	struct pollfd fds[2] = {
+		{ .fd = hk->timerfd, .events = POLLIN },
+		{ .fd = hk->stopfd, .events = POLLIN },
+	};
+
+	while (1) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (fds[1].revents)
+			break;
+
+		/* Ticks we slept through are counted, time keeps moving at the right rate. */
+		uint64_t expirations;
+		if (read(hk->timerfd, &expirations, sizeof(expirations)) != sizeof(expirations))
+			continue;
+
+		for (int g = 0; g < hk->channels->groupCount; g++)
+			sdiaudio_group_housekeep(&hk->channels->group[g], hk->intervalUs * expirations);
+	}
+
+	return NULL;
+}
+
+int sdiaudio_housekeeping_alloc(struct sdiaudio_housekeeping_s **housekeeping, struct sdiaudio_channels_s *channels,
+	unsigned int intervalMs)
+{
+	struct sdiaudio_housekeeping_s *hk = calloc(1, sizeof(*hk));
+	if (!hk)
+		return -1;
+
+	hk->channels = channels;
+	hk->intervalUs = (uint64_t)intervalMs * 1000;
+
+	hk->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	hk->stopfd = eventfd(0, EFD_CLOEXEC);
+	if (hk->timerfd < 0 || hk->stopfd < 0)
+		goto err;
+
+	struct itimerspec its = {
+		.it_interval = { .tv_sec = intervalMs / 1000, .tv_nsec = (intervalMs % 1000) * 1000000L },
+	};
+	its.it_value = its.it_interval;
+	if (timerfd_settime(hk->timerfd, 0, &its, NULL) < 0)
+		goto err;
+
+	if (pthread_create(&hk->thread, NULL, housekeeping_thread, hk) != 0)
+		goto err;
+
+	*housekeeping = hk;
+	return 0;
+
+err:
+	if (hk->stopfd >= 0)
+		close(hk->stopfd);
+	if (hk->timerfd >= 0)
+		close(hk->timerfd);
+	free(hk);
+	return -1;
+}
+
+void sdiaudio_housekeeping_free(struct sdiaudio_housekeeping_s *hk)
+{
+	uint64_t one = 1;
+	if (write(hk->stopfd, &one, sizeof(one)) != sizeof(one)) {
+		/* An eventfd write only fails on overflow, the thread is already being told to stop. */
+	}
+	pthread_join(hk->thread, NULL);
+
+	close(hk->stopfd);
+	close(hk->timerfd);
+	free(hk);
+}
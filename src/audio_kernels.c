@@ -0,0 +1,1275 @@
+/*
+ * Copyright (c) LiveTimeNet, Inc. 2017. All Rights Reserved.
+ *
+ * Address: LTN Global Communications, Inc.
+ *          Historic Savage Mill
+ *          Box 2020
+ *          8600 Foundry Street
+ *          Savage, MD 20763
+ *
+ * Contact: sales@ltnglobal.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/errno.h>
+#include <libltnsdi/ltnsdi.h>
+
+#include "audio_kernels.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define KERNELS_X86 1
+#endif
+
+typedef sdiaudio_deinterleave_func deinterleave_func;
+
+static __inline__ uint32_t bswap32(uint32_t n)
+{
+	return __builtin_bswap32(n);
+}
+
+/* Handle any rectangle of the buffer the vector kernels didn't cover. */
+static void deinterleave_32b_scalar_region(const uint8_t *buf,
+	uint32_t frameFirst, uint32_t frameLast, uint32_t channelFirst, uint32_t channelLast,
+	uint32_t frameStrideBytes, int32_t **planes, int byteSwap)
+{
+	for (uint32_t f = frameFirst; f < frameLast; f++) {
+		const uint32_t *p = (const uint32_t *)(buf + (f * frameStrideBytes));
+		for (uint32_t c = channelFirst; c < channelLast; c++) {
+			planes[c][f] = byteSwap ? bswap32(p[c]) : p[c];
+		}
+	}
+}
+
+static void deinterleave_32b_scalar(const uint8_t *buf, uint32_t audioFrames, uint32_t channelsPerFrame,
+	uint32_t frameStrideBytes, int32_t **planes, int byteSwap)
+{
+	deinterleave_32b_scalar_region(buf, 0, audioFrames, 0, channelsPerFrame, frameStrideBytes, planes, byteSwap);
+}
+
+#if KERNELS_X86
+/* SSE2 is part of the x86-64 baseline, so this kernel is always available. */
+static __inline__ __m128i bswap32_sse2(__m128i v)
+{
+	/* Swap the 16bit halves of each word, then the bytes within each half. */
+	v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+/* 4 channels x 4 frames at a time. Inlined into the fixed layout kernels below, where
+ * the channel count and stride are constants.
+ */
+static __inline__ __attribute__((always_inline)) void deinterleave_32b_sse2_body(const uint8_t *buf,
+	uint32_t audioFrames, uint32_t channelsPerFrame, uint32_t frameStrideBytes, int32_t **planes, int byteSwap)
+{
+	uint32_t frameBlocks = audioFrames & ~3;
+	uint32_t channelBlocks = channelsPerFrame & ~3;
+
+	for (uint32_t c = 0; c < channelBlocks; c += 4) {
+		int32_t *d0 = planes[c + 0], *d1 = planes[c + 1], *d2 = planes[c + 2], *d3 = planes[c + 3];
+
+		for (uint32_t f = 0; f < frameBlocks; f += 4) {
+			const uint8_t *p = buf + (f * frameStrideBytes) + (c * sizeof(uint32_t));
+			__m128i r0 = _mm_loadu_si128((const __m128i *)(p + (0 * frameStrideBytes)));
+			__m128i r1 = _mm_loadu_si128((const __m128i *)(p + (1 * frameStrideBytes)));
+			__m128i r2 = _mm_loadu_si128((const __m128i *)(p + (2 * frameStrideBytes)));
+			__m128i r3 = _mm_loadu_si128((const __m128i *)(p + (3 * frameStrideBytes)));
+
+			__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+			__m128i t1 = _mm_unpackhi_epi32(r0, r1);
+			__m128i t2 = _mm_unpacklo_epi32(r2, r3);
+			__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+			__m128i c0 = _mm_unpacklo_epi64(t0, t2);
+			__m128i c1 = _mm_unpackhi_epi64(t0, t2);
+			__m128i c2 = _mm_unpacklo_epi64(t1, t3);
+			__m128i c3 = _mm_unpackhi_epi64(t1, t3);
+
+			if (byteSwap) {
+				c0 = bswap32_sse2(c0);
+				c1 = bswap32_sse2(c1);
+				c2 = bswap32_sse2(c2);
+				c3 = bswap32_sse2(c3);
+			}
+
+			_mm_storeu_si128((__m128i *)(d0 + f), c0);
+			_mm_storeu_si128((__m128i *)(d1 + f), c1);
+			_mm_storeu_si128((__m128i *)(d2 + f), c2);
+			_mm_storeu_si128((__m128i *)(d3 + f), c3);
+		}
+	}
+
+	deinterleave_32b_scalar_region(buf, frameBlocks, audioFrames, 0, channelBlocks, frameStrideBytes, planes, byteSwap);
+	deinterleave_32b_scalar_region(buf, 0, audioFrames, channelBlocks, channelsPerFrame, frameStrideBytes, planes, byteSwap);
+}
+
+static void deinterleave_32b_sse2(const uint8_t *buf, uint32_t audioFrames, uint32_t channelsPerFrame,
+	uint32_t frameStrideBytes, int32_t **planes, int byteSwap)
+{
+	deinterleave_32b_sse2_body(buf, audioFrames, channelsPerFrame, frameStrideBytes, planes, byteSwap);
+}
+
+/* One group, 4 channels x 8 frames at a time. Frames 0-3 go through the low lanes and
+ * 4-7 through the high lanes of the same 4x4 transpose, each result is 8 frames of one channel.
+ */
+__attribute__((target("avx2")))
+static __inline__ __attribute__((always_inline)) void deinterleave4_32b_avx2_body(const uint8_t *buf,
+	uint32_t audioFrames, uint32_t frameStrideBytes, int32_t **planes)
+{
+	uint32_t frameBlocks = audioFrames & ~7;
+	int32_t *d0 = planes[0], *d1 = planes[1], *d2 = planes[2], *d3 = planes[3];
+
+	for (uint32_t f = 0; f < frameBlocks; f += 8) {
+		const uint8_t *p = buf + (f * frameStrideBytes);
+		__m256i r[4];
+		for (int k = 0; k < 4; k++) {
+			r[k] = _mm256_inserti128_si256(
+				_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(p + (k * frameStrideBytes)))),
+				_mm_loadu_si128((const __m128i *)(p + ((k + 4) * frameStrideBytes))), 1);
+		}
+
+		__m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+		__m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+		__m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+		__m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+
+		_mm256_storeu_si256((__m256i *)(d0 + f), _mm256_unpacklo_epi64(t0, t2));
+		_mm256_storeu_si256((__m256i *)(d1 + f), _mm256_unpackhi_epi64(t0, t2));
+		_mm256_storeu_si256((__m256i *)(d2 + f), _mm256_unpacklo_epi64(t1, t3));
+		_mm256_storeu_si256((__m256i *)(d3 + f), _mm256_unpackhi_epi64(t1, t3));
+	}
+
+	deinterleave_32b_scalar_region(buf, frameBlocks, audioFrames, 0, 4, frameStrideBytes, planes, 0);
+}
+
+/* Fixed layout kernels, one full group of channels out of the common DeckLink frame sizes.
+ * The stride is a constant so every address computation folds, and there are no channel loops.
+ */
+#define DEINTERLEAVE4_FIXED(stride) \
+static void deinterleave4_32b_sse2_##stride(const uint8_t *buf, uint32_t audioFrames, uint32_t channelsPerFrame, \
+	uint32_t frameStrideBytes, int32_t **planes, int byteSwap) \
+{ \
+	deinterleave_32b_sse2_body(buf, audioFrames, 4, stride, planes, 0); \
+} \
+__attribute__((target("avx2"))) \
+static void deinterleave4_32b_avx2_##stride(const uint8_t *buf, uint32_t audioFrames, uint32_t channelsPerFrame, \
+	uint32_t frameStrideBytes, int32_t **planes, int byteSwap) \
+{ \
+	deinterleave4_32b_avx2_body(buf, audioFrames, stride, planes); \
+}
+
+DEINTERLEAVE4_FIXED(16)	/*  4 channels */
+DEINTERLEAVE4_FIXED(32)	/*  8 channels */
+DEINTERLEAVE4_FIXED(64)	/* 16 channels */
+
+/* 8 channels x 8 frames at a time, falling back to SSE2 for a trailing block of four channels. */
+__attribute__((target("avx2")))
+static void deinterleave_32b_avx2(const uint8_t *buf, uint32_t audioFrames, uint32_t channelsPerFrame,
+	uint32_t frameStrideBytes, int32_t **planes, int byteSwap)
+{
+	const __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+					      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	uint32_t frameBlocks = audioFrames & ~7;
+	uint32_t channelBlocks = channelsPerFrame & ~7;
+
+	for (uint32_t c = 0; c < channelBlocks; c += 8) {
+		for (uint32_t f = 0; f < frameBlocks; f += 8) {
+			const uint8_t *p = buf + (f * frameStrideBytes) + (c * sizeof(uint32_t));
+			__m256i r[8];
+			for (int k = 0; k < 8; k++)
+				r[k] = _mm256_loadu_si256((const __m256i *)(p + (k * frameStrideBytes)));
+
+			/* Within each 128bit lane, build 4x4 transposes. Lane 0 holds channels 0-3, lane 1 holds 4-7. */
+			__m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+			__m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+			__m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+			__m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+			__m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+			__m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+			__m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+			__m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+			__m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+			__m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+			__m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+			__m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+			__m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+			__m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+			__m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+			__m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+			/* Stitch frames 0-3 and 4-7 together per channel. */
+			__m256i o[8];
+			o[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+			o[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+			o[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+			o[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+			o[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+			o[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+			o[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+			o[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+
+			for (int k = 0; k < 8; k++) {
+				if (byteSwap)
+					o[k] = _mm256_shuffle_epi8(o[k], swap);
+				_mm256_storeu_si256((__m256i *)(planes[c + k] + f), o[k]);
+			}
+		}
+	}
+
+	deinterleave_32b_scalar_region(buf, frameBlocks, audioFrames, 0, channelBlocks, frameStrideBytes, planes, byteSwap);
+
+	/* Whatever channels remain, hand them to the narrower kernel. */
+	if (channelBlocks < channelsPerFrame) {
+		deinterleave_32b_sse2(buf + (channelBlocks * sizeof(uint32_t)), audioFrames,
+			channelsPerFrame - channelBlocks, frameStrideBytes, planes + channelBlocks, byteSwap);
+	}
+}
+#endif /* KERNELS_X86 */
+
+/* Format conversion into the 32bit layout everything else works on, audio in the
+ * most significant bits. Operates on a contiguous run of samples.
+ */
+typedef void (*convert_func)(const uint8_t *src, int32_t *dst, uint32_t samples);
+
+static void convert_s16le_scalar(const uint8_t *src, int32_t *dst, uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++, src += 2)
+		dst[i] = (int32_t)((uint32_t)src[0] << 16 | (uint32_t)src[1] << 24);
+}
+
+static void convert_s24be_scalar(const uint8_t *src, int32_t *dst, uint32_t samples)
+{
+	for (uint32_t i = 0; i < samples; i++, src += 3)
+		dst[i] = (int32_t)((uint32_t)src[0] << 24 | (uint32_t)src[1] << 16 | (uint32_t)src[2] << 8);
+}
+
+/* +1.0 isn't representable, clamp just below it. NaN becomes full scale, matching the vector kernels. */
+#define F32_MAX 0.99999994f
+#define F32_MIN -1.0f
+#define F32_SCALE 2147483648.0f
+
+static void convert_f32_scalar(const uint8_t *src, int32_t *dst, uint32_t samples)
+{
+	const float *p = (const float *)src;
+	for (uint32_t i = 0; i < samples; i++) {
+		float x = p[i];
+		x = x < F32_MAX ? x : F32_MAX;
+		x = x > F32_MIN ? x : F32_MIN;
+		dst[i] = (int32_t)lrintf(x * F32_SCALE);
+	}
+}
+
+#if KERNELS_X86
+static void convert_s16le_sse2(const uint8_t *src, int32_t *dst, uint32_t samples)
+{
+	const __m128i zero = _mm_setzero_si128();
+	uint32_t i = 0;
+
+	for (; i + 8 <= samples; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + (i * 2)));
+		_mm_storeu_si128((__m128i *)(dst + i + 0), _mm_unpacklo_epi16(zero, v));
+		_mm_storeu_si128((__m128i *)(dst + i + 4), _mm_unpackhi_epi16(zero, v));
+	}
+	convert_s16le_scalar(src + (i * 2), dst + i, samples - i);
+}
+
+static void convert_f32_sse2(const uint8_t *src, int32_t *dst, uint32_t samples)
+{
+	const __m128 hi = _mm_set1_ps(F32_MAX), lo = _mm_set1_ps(F32_MIN), scale = _mm_set1_ps(F32_SCALE);
+	uint32_t i = 0;
+
+	for (; i + 4 <= samples; i += 4) {
+		__m128 v = _mm_loadu_ps((const float *)src + i);
+		v = _mm_max_ps(_mm_min_ps(v, hi), lo);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_cvtps_epi32(_mm_mul_ps(v, scale)));
+	}
+	convert_f32_scalar(src + (i * 4), dst + i, samples - i);
+}
+
+/* Four packed big endian samples (12 bytes) into the top 24 bits of four words. */
+#define S24BE_SHUFFLE \
+	0x80, 2, 1, 0, 0x80, 5, 4, 3, 0x80, 8, 7, 6, 0x80, 11, 10, 9
+
+__attribute__((target("ssse3")))
+static void convert_s24be_ssse3(const uint8_t *src, int32_t *dst, uint32_t samples)
+{
+	const __m128i shuffle = _mm_setr_epi8(S24BE_SHUFFLE);
+	uint32_t i = 0;
+
+	/* Each load reads 16 bytes but consumes 12, stay clear of the end of the buffer. */
+	for (; i + 6 <= samples; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + (i * 3)));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(v, shuffle));
+	}
+	convert_s24be_scalar(src + (i * 3), dst + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void convert_s16le_avx2(const uint8_t *src, int32_t *dst, uint32_t samples)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	uint32_t i = 0;
+
+	for (; i + 16 <= samples; i += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + (i * 2)));
+		/* Unpacks work within each lane, put the four quarters back in order. */
+		__m256i l = _mm256_unpacklo_epi16(zero, v);
+		__m256i h = _mm256_unpackhi_epi16(zero, v);
+		_mm256_storeu_si256((__m256i *)(dst + i + 0), _mm256_permute2x128_si256(l, h, 0x20));
+		_mm256_storeu_si256((__m256i *)(dst + i + 8), _mm256_permute2x128_si256(l, h, 0x31));
+	}
+	convert_s16le_sse2(src + (i * 2), dst + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void convert_s24be_avx2(const uint8_t *src, int32_t *dst, uint32_t samples)
+{
+	const __m256i shuffle = _mm256_setr_epi8(S24BE_SHUFFLE, S24BE_SHUFFLE);
+	uint32_t i = 0;
+
+	/* Eight samples per pass, 12 bytes into each lane, the second lane load reads 4 bytes beyond them. */
+	for (; i + 10 <= samples; i += 8) {
+		const uint8_t *p = src + (i * 3);
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+			_mm_loadu_si128((const __m128i *)(p + 12)), 1);
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(v, shuffle));
+	}
+	convert_s24be_ssse3(src + (i * 3), dst + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void convert_f32_avx2(const uint8_t *src, int32_t *dst, uint32_t samples)
+{
+	const __m256 hi = _mm256_set1_ps(F32_MAX), lo = _mm256_set1_ps(F32_MIN), scale = _mm256_set1_ps(F32_SCALE);
+	uint32_t i = 0;
+
+	for (; i + 8 <= samples; i += 8) {
+		__m256 v = _mm256_loadu_ps((const float *)src + i);
+		v = _mm256_max_ps(_mm256_min_ps(v, hi), lo);
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_cvtps_epi32(_mm256_mul_ps(v, scale)));
+	}
+	convert_f32_sse2(src + (i * 4), dst + i, samples - i);
+}
+#endif /* KERNELS_X86 */
+
+/* One pass gathers the peak, bit usage, zero and syncword counts. Unit stride and branch free,
+ * so the compiler vectorizes it for the baseline instruction set.
+ */
+static __inline__ __attribute__((always_inline)) void analyze_32b_c_body(struct sdiaudio_channel_analysis_s *a,
+	const int32_t *plane, uint32_t audioFrames)
+{
+	int32_t  peak = 0;
+	uint32_t mask = 0;
+	uint32_t zeros = 0;
+	uint32_t sync = 0;
+
+	for (int i = 0; i < audioFrames; i++) {
+		uint32_t dw = plane[i];
+		int16_t x = abs(plane[i] >> 16);
+
+		peak = x > peak ? x : peak;
+		mask |= dw;
+		zeros += (dw == 0);
+		sync += (dw == PA_16BIT) | (dw == PA_20BIT) | (dw == PA_24BIT);
+	}
+
+	a->largestSample = peak;
+	a->bitMask = mask;
+	a->zeroCount = zeros;
+	a->syncwordCount = sync;
+}
+
+/* Zero runs carry a dependency from sample to sample, so they're only walked when the sweep
+ * found any zeros at all, the plane is still in cache.
+ */
+static __inline__ void analyze_zero_runs(struct sdiaudio_channel_analysis_s *a, const int32_t *plane,
+	uint32_t first, uint32_t audioFrames, uint32_t run, uint32_t longest)
+{
+	for (uint32_t i = first; i < audioFrames; i++) {
+		run = (run + 1) * (plane[i] == 0);
+		longest = run > longest ? run : longest;
+	}
+
+	a->zeroRunLongest = longest;
+	a->zeroRunTrailing = run;
+}
+
+static void analyze_32b_c(struct sdiaudio_channel_analysis_s *a, const int32_t *plane, uint32_t audioFrames)
+{
+	analyze_32b_c_body(a, plane, audioFrames);
+
+	if (a->zeroCount == audioFrames) {
+		a->zeroRunLongest = a->zeroRunTrailing = audioFrames;
+	} else
+	if (a->zeroCount) {
+		analyze_zero_runs(a, plane, 0, audioFrames, 0, 0);
+	} else {
+		a->zeroRunLongest = a->zeroRunTrailing = 0;
+	}
+}
+
+static __inline__ int is_syncword_32b(uint32_t dw)
+{
+	return (dw == PA_16BIT) | (dw == PA_20BIT) | (dw == PA_24BIT);
+}
+
+static uint32_t find_syncword_32b_c(const uint8_t *buf, uint32_t words, uint32_t stepBytes)
+{
+	for (uint32_t i = 0; i < words; i++) {
+		if (is_syncword_32b(*(const uint32_t *)(buf + (i * stepBytes))))
+			return i;
+	}
+	return words;
+}
+
+static uint32_t nonzero_32b_c(const uint8_t *buf, uint32_t audioFrames, uint32_t channelCount,
+	uint32_t frameStrideBytes, uint32_t channelMask)
+{
+	uint32_t found = 0;
+
+	for (uint32_t f = 0; f < audioFrames && found != channelMask; f++) {
+		const uint32_t *p = (const uint32_t *)(buf + (f * frameStrideBytes));
+		for (uint32_t c = 0; c < channelCount; c++)
+			found |= (uint32_t)(p[c] != 0) << c;
+		found &= channelMask;
+	}
+
+	return found;
+}
+
+#if KERNELS_X86
+/* Peak of abs(word >> 16) as a 16bit value, -32768 contributes nothing, matching the C sweep. */
+__attribute__((target("avx2")))
+static void analyze_32b_avx2(struct sdiaudio_channel_analysis_s *a, const int32_t *plane, uint32_t audioFrames)
+{
+	const __m256i zero = _mm256_setzero_si256(), low = _mm256_set1_epi32(0x7fff);
+	const __m256i pa16 = _mm256_set1_epi32(PA_16BIT), pa20 = _mm256_set1_epi32(PA_20BIT), pa24 = _mm256_set1_epi32(PA_24BIT);
+	__m256i peak = zero, mask = zero, zeros = zero, sync = zero;
+	uint32_t blocks = audioFrames & ~7;
+
+	for (uint32_t i = 0; i < blocks; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(plane + i));
+		peak = _mm256_max_epi32(peak, _mm256_and_si256(_mm256_abs_epi32(_mm256_srai_epi32(v, 16)), low));
+		mask = _mm256_or_si256(mask, v);
+		zeros = _mm256_sub_epi32(zeros, _mm256_cmpeq_epi32(v, zero));
+		sync = _mm256_sub_epi32(sync, _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi32(v, pa16),
+			_mm256_cmpeq_epi32(v, pa20)), _mm256_cmpeq_epi32(v, pa24)));
+	}
+
+	/* Fold the lanes, then let the C sweep take the tail. */
+	int32_t lp[8];
+	uint32_t lm[8], lz[8], ls[8];
+	_mm256_storeu_si256((__m256i *)lp, peak);
+	_mm256_storeu_si256((__m256i *)lm, mask);
+	_mm256_storeu_si256((__m256i *)lz, zeros);
+	_mm256_storeu_si256((__m256i *)ls, sync);
+
+	analyze_32b_c_body(a, plane + blocks, audioFrames - blocks);
+	for (int k = 0; k < 8; k++) {
+		a->largestSample = lp[k] > a->largestSample ? lp[k] : a->largestSample;
+		a->bitMask |= lm[k];
+		a->zeroCount += lz[k];
+		a->syncwordCount += ls[k];
+	}
+
+	uint32_t run = 0, longest = 0;
+	if (a->zeroCount == audioFrames) {
+		run = longest = audioFrames;
+	} else
+	if (a->zeroCount) {
+		/* Whole blocks of zeros, or of samples, don't need walking a word at a time. */
+		for (uint32_t i = 0; i < blocks; i += 8) {
+			uint32_t z = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(
+				_mm256_loadu_si256((const __m256i *)(plane + i)), zero)));
+			if (z == 0xff) {
+				run += 8;
+			} else
+			if (z == 0) {
+				run = 0;
+			} else {
+				for (int k = 0; k < 8; k++) {
+					run = (run + 1) * ((z >> k) & 1);
+					longest = run > longest ? run : longest;
+				}
+			}
+			longest = run > longest ? run : longest;
+		}
+		analyze_zero_runs(a, plane, blocks, audioFrames, run, longest);
+		return;
+	}
+
+	a->zeroRunLongest = longest;
+	a->zeroRunTrailing = run;
+}
+
+__attribute__((target("avx512f")))
+static void analyze_32b_avx512(struct sdiaudio_channel_analysis_s *a, const int32_t *plane, uint32_t audioFrames)
+{
+	const __m512i zero = _mm512_setzero_si512(), low = _mm512_set1_epi32(0x7fff);
+	const __m512i pa16 = _mm512_set1_epi32(PA_16BIT), pa20 = _mm512_set1_epi32(PA_20BIT), pa24 = _mm512_set1_epi32(PA_24BIT);
+	__m512i peak = zero, mask = zero;
+	uint32_t zeros = 0, sync = 0;
+	uint32_t blocks = audioFrames & ~15;
+
+	for (uint32_t i = 0; i < blocks; i += 16) {
+		__m512i v = _mm512_loadu_si512((const void *)(plane + i));
+		peak = _mm512_max_epi32(peak, _mm512_and_si512(_mm512_abs_epi32(_mm512_srai_epi32(v, 16)), low));
+		mask = _mm512_or_si512(mask, v);
+		zeros += __builtin_popcount(_mm512_cmpeq_epi32_mask(v, zero));
+		sync += __builtin_popcount(_mm512_cmpeq_epi32_mask(v, pa16) | _mm512_cmpeq_epi32_mask(v, pa20) |
+			_mm512_cmpeq_epi32_mask(v, pa24));
+	}
+
+	analyze_32b_c_body(a, plane + blocks, audioFrames - blocks);
+	int32_t p = _mm512_reduce_max_epi32(peak);
+	a->largestSample = p > a->largestSample ? p : a->largestSample;
+	a->bitMask |= _mm512_reduce_or_epi32(mask);
+	a->zeroCount += zeros;
+	a->syncwordCount += sync;
+
+	uint32_t run = 0, longest = 0;
+	if (a->zeroCount == audioFrames) {
+		run = longest = audioFrames;
+	} else
+	if (a->zeroCount) {
+		for (uint32_t i = 0; i < blocks; i += 16) {
+			uint32_t z = _mm512_cmpeq_epi32_mask(_mm512_loadu_si512((const void *)(plane + i)), zero);
+			if (z == 0xffff) {
+				run += 16;
+			} else
+			if (z == 0) {
+				run = 0;
+			} else {
+				for (int k = 0; k < 16; k++) {
+					run = (run + 1) * ((z >> k) & 1);
+					longest = run > longest ? run : longest;
+				}
+			}
+			longest = run > longest ? run : longest;
+		}
+		analyze_zero_runs(a, plane, blocks, audioFrames, run, longest);
+		return;
+	}
+
+	a->zeroRunLongest = longest;
+	a->zeroRunTrailing = run;
+}
+
+/* How often the probes below check whether they've seen enough, in frames. */
+#define NONZERO_CHECK_FRAMES 64
+
+/* One group of four channels, a frame per load, or a single plane of contiguous words. */
+static uint32_t nonzero_32b_sse2(const uint8_t *buf, uint32_t audioFrames, uint32_t channelCount,
+	uint32_t frameStrideBytes, uint32_t channelMask)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = zero;
+	uint32_t f = 0;
+
+	if (channelCount == 1 && frameStrideBytes == sizeof(uint32_t)) {
+		uint32_t words = audioFrames & ~3;
+		for (; f < words; f += 4) {
+			acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *)(buf + (f * 4))));
+			if ((f & (NONZERO_CHECK_FRAMES - 1)) == 0 && _mm_movemask_epi8(_mm_cmpeq_epi32(acc, zero)) != 0xffff)
+				return channelMask & 1;
+		}
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(acc, zero)) != 0xffff)
+			return channelMask & 1;
+		return nonzero_32b_c(buf + (f * 4), audioFrames - f, 1, 4, channelMask);
+	}
+
+	if (channelCount != 4)
+		return nonzero_32b_c(buf, audioFrames, channelCount, frameStrideBytes, channelMask);
+
+	uint32_t found = 0;
+	for (; f < audioFrames; f++) {
+		acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *)(buf + (f * frameStrideBytes))));
+		if ((f & (NONZERO_CHECK_FRAMES - 1)) == NONZERO_CHECK_FRAMES - 1) {
+			found = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(acc, zero))) & channelMask;
+			if (found == channelMask)
+				return found;
+		}
+	}
+
+	return ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(acc, zero))) & channelMask;
+}
+
+/* As above, two frames (or eight words) per operation. */
+__attribute__((target("avx2")))
+static uint32_t nonzero_32b_avx2(const uint8_t *buf, uint32_t audioFrames, uint32_t channelCount,
+	uint32_t frameStrideBytes, uint32_t channelMask)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc = zero;
+	uint32_t f = 0;
+
+	if (channelCount == 1 && frameStrideBytes == sizeof(uint32_t)) {
+		uint32_t words = audioFrames & ~7;
+		for (; f < words; f += 8) {
+			acc = _mm256_or_si256(acc, _mm256_loadu_si256((const __m256i *)(buf + (f * 4))));
+			if ((f & (NONZERO_CHECK_FRAMES - 1)) == 0 && !_mm256_testz_si256(acc, acc))
+				return channelMask & 1;
+		}
+		if (!_mm256_testz_si256(acc, acc))
+			return channelMask & 1;
+		return nonzero_32b_c(buf + (f * 4), audioFrames - f, 1, 4, channelMask);
+	}
+
+	if (channelCount != 4)
+		return nonzero_32b_c(buf, audioFrames, channelCount, frameStrideBytes, channelMask);
+
+	uint32_t pairs = audioFrames & ~1;
+	for (; f < pairs; f += 2) {
+		const uint8_t *p = buf + (f * frameStrideBytes);
+		acc = _mm256_or_si256(acc, _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+			_mm_loadu_si128((const __m128i *)(p + frameStrideBytes)), 1));
+		if ((f & (NONZERO_CHECK_FRAMES - 1)) == NONZERO_CHECK_FRAMES - 2) {
+			__m128i both = _mm_or_si128(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+			if ((~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(both, _mm_setzero_si128()))) & channelMask) == channelMask)
+				return channelMask;
+		}
+	}
+
+	__m128i both = _mm_or_si128(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	uint32_t found = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(both, _mm_setzero_si128()))) & channelMask;
+	return found | nonzero_32b_c(buf + (f * frameStrideBytes), audioFrames - f, 4, frameStrideBytes, channelMask & ~found);
+}
+
+/* Largest stride the gathers below can address, 8 or 16 byte offsets held in 32bit lanes. */
+#define GATHER_STRIDE_MAX (INT32_MAX / 16)
+
+__attribute__((target("avx2")))
+static uint32_t find_syncword_32b_avx2(const uint8_t *buf, uint32_t words, uint32_t stepBytes)
+{
+	const __m256i pa16 = _mm256_set1_epi32(PA_16BIT), pa20 = _mm256_set1_epi32(PA_20BIT), pa24 = _mm256_set1_epi32(PA_24BIT);
+	uint32_t blocks = words & ~7;
+	uint32_t i = 0;
+
+	/* Planar input loads straight through, interleaved input gathers one channel out of 8 frames. */
+	if (stepBytes <= GATHER_STRIDE_MAX) {
+		const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+			_mm256_set1_epi32(stepBytes));
+		for (; i < blocks; i += 8) {
+			const uint8_t *p = buf + ((size_t)i * stepBytes);
+			__m256i v;
+			if (stepBytes == sizeof(uint32_t))
+				v = _mm256_loadu_si256((const __m256i *)p);
+			else
+				v = _mm256_i32gather_epi32((const int *)p, offsets, 1);
+
+			__m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi32(v, pa16),
+				_mm256_cmpeq_epi32(v, pa20)), _mm256_cmpeq_epi32(v, pa24));
+			uint32_t m = _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+			if (m)
+				return i + __builtin_ctz(m);
+		}
+	}
+
+	return i + find_syncword_32b_c(buf + ((size_t)i * stepBytes), words - i, stepBytes);
+}
+
+__attribute__((target("avx512f")))
+static uint32_t find_syncword_32b_avx512(const uint8_t *buf, uint32_t words, uint32_t stepBytes)
+{
+	const __m512i pa16 = _mm512_set1_epi32(PA_16BIT), pa20 = _mm512_set1_epi32(PA_20BIT), pa24 = _mm512_set1_epi32(PA_24BIT);
+	uint32_t blocks = words & ~15;
+	uint32_t i = 0;
+
+	if (stepBytes <= GATHER_STRIDE_MAX) {
+		const __m512i offsets = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+			8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(stepBytes));
+		for (; i < blocks; i += 16) {
+			const uint8_t *p = buf + ((size_t)i * stepBytes);
+			__m512i v;
+			if (stepBytes == sizeof(uint32_t))
+				v = _mm512_loadu_si512((const void *)p);
+			else
+				v = _mm512_i32gather_epi32(offsets, (const void *)p, 1);
+
+			uint32_t m = _mm512_cmpeq_epi32_mask(v, pa16) | _mm512_cmpeq_epi32_mask(v, pa20) |
+				_mm512_cmpeq_epi32_mask(v, pa24);
+			if (m)
+				return i + __builtin_ctz(m);
+		}
+	}
+
+	return i + find_syncword_32b_c(buf + ((size_t)i * stepBytes), words - i, stepBytes);
+}
+#endif /* KERNELS_X86 */
+
+/* SMPTE 337 word packing. The detector parses an MSB first byte stream, every word of
+ * every frame, so pack a packet at a time rather than a byte at a time.
+ */
+typedef size_t (*pack_contiguous_func)(uint8_t *dst, const uint8_t *src, uint32_t words);
+typedef size_t (*pack_pair_func)(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint32_t words);
+
+/* Words that aren't contiguous, any stride, any span count. */
+static __inline__ __attribute__((always_inline)) size_t pack_words_32b_body(uint8_t *dst, const uint8_t **span,
+	uint32_t spanCount, uint32_t audioFrames, uint32_t stepBytes, uint32_t wordLength)
+{
+	uint8_t *p = dst;
+
+	for (uint32_t i = 0; i < audioFrames; i++) {
+		for (uint32_t k = 0; k < spanCount; k++) {
+			uint32_t x = *(const uint32_t *)(span[k] + (i * stepBytes));
+			*(p++) = x >> 24;
+			*(p++) = x >> 16;
+			if (wordLength == 24)
+				*(p++) = x >> 8;
+		}
+	}
+	return p - dst;
+}
+
+static size_t pack_words_32b_scalar(uint8_t *dst, const uint8_t **span, uint32_t spanCount, uint32_t audioFrames,
+	uint32_t stepBytes, uint32_t wordLength)
+{
+	if (wordLength == 24)
+		return pack_words_32b_body(dst, span, spanCount, audioFrames, stepBytes, 24);
+	return pack_words_32b_body(dst, span, spanCount, audioFrames, stepBytes, 16);
+}
+
+static size_t pack16_contiguous_scalar(uint8_t *dst, const uint8_t *src, uint32_t words)
+{
+	return pack_words_32b_body(dst, &src, 1, words, sizeof(uint32_t), 16);
+}
+
+static size_t pack24_contiguous_scalar(uint8_t *dst, const uint8_t *src, uint32_t words)
+{
+	return pack_words_32b_body(dst, &src, 1, words, sizeof(uint32_t), 24);
+}
+
+static size_t pack16_pair_scalar(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint32_t words)
+{
+	const uint8_t *span[2] = { a, b };
+	return pack_words_32b_body(dst, span, 2, words, sizeof(uint32_t), 16);
+}
+
+static size_t pack24_pair_scalar(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint32_t words)
+{
+	const uint8_t *span[2] = { a, b };
+	return pack_words_32b_body(dst, span, 2, words, sizeof(uint32_t), 24);
+}
+
+/* 20bit words don't fall on byte boundaries, pairs of them do. Never vectorized,
+ * every word is checked for a Pa Pb pair to realign on.
+ */
+static size_t pack_words_20b(uint8_t *dst, const uint8_t **span, uint32_t spanCount, uint32_t audioFrames,
+	uint32_t stepBytes, uint32_t *carry)
+{
+	uint8_t *p = dst;
+	uint32_t nibble = *carry;
+
+	for (uint32_t i = 0; i < audioFrames; i++) {
+		for (uint32_t k = 0; k < spanCount; k++) {
+			uint32_t x = *(const uint32_t *)(span[k] + (i * stepBytes));
+
+			if (nibble && x == PA_20BIT) {
+				const uint8_t *next = NULL;
+				if (k + 1 < spanCount)
+					next = span[k + 1] + (i * stepBytes);
+				else
+				if (i + 1 < audioFrames)
+					next = span[0] + ((i + 1) * stepBytes);
+				if (next && *(const uint32_t *)next == PB_20BIT)
+					nibble = 0;
+			}
+
+			uint32_t w = x >> 12;
+			if (nibble) {
+				*(p++) = ((nibble & 0x0f) << 4) | (w >> 16);
+				*(p++) = w >> 8;
+				*(p++) = w;
+				nibble = 0;
+			} else {
+				*(p++) = w >> 12;
+				*(p++) = w >> 4;
+				nibble = 0x10 | (w & 0x0f);
+			}
+		}
+	}
+
+	*carry = nibble;
+	return p - dst;
+}
+
+static size_t pack_words_16b_scalar(uint8_t *dst, const uint8_t **span, uint32_t spanCount, uint32_t audioFrames,
+	uint32_t stepBytes)
+{
+	uint8_t *p = dst;
+
+	for (uint32_t i = 0; i < audioFrames; i++) {
+		for (uint32_t k = 0; k < spanCount; k++) {
+			const uint8_t *x = span[k] + (i * stepBytes);
+			*(p++) = x[1];
+			*(p++) = x[0];
+		}
+	}
+	return p - dst;
+}
+
+static size_t pack16_16b_contiguous_scalar(uint8_t *dst, const uint8_t *src, uint32_t words)
+{
+	return pack_words_16b_scalar(dst, &src, 1, words, sizeof(uint16_t));
+}
+
+#if KERNELS_X86
+/* The top two, or three, bytes of four words, most significant first, the rest zeroed. */
+#define PACK16_SHUFFLE \
+	3, 2, 7, 6, 11, 10, 15, 14, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+#define PACK24_SHUFFLE \
+	3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, 0x80, 0x80, 0x80, 0x80
+#define PACK16_16B_SHUFFLE \
+	1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+
+/* Eight words into 16 bytes. */
+__attribute__((target("ssse3")))
+static __inline__ void pack16_8words_ssse3(uint8_t *dst, __m128i v0, __m128i v1)
+{
+	const __m128i shuffle = _mm_setr_epi8(PACK16_SHUFFLE);
+	v0 = _mm_shuffle_epi8(v0, shuffle);
+	v1 = _mm_shuffle_epi8(v1, shuffle);
+	_mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi64(v0, v1));
+}
+
+/* Sixteen words into 48 bytes, the 12 bytes of each shuffle stitched into three full stores. */
+__attribute__((target("ssse3")))
+static __inline__ void pack24_16words_ssse3(uint8_t *dst, __m128i v0, __m128i v1, __m128i v2, __m128i v3)
+{
+	const __m128i shuffle = _mm_setr_epi8(PACK24_SHUFFLE);
+	v0 = _mm_shuffle_epi8(v0, shuffle);
+	v1 = _mm_shuffle_epi8(v1, shuffle);
+	v2 = _mm_shuffle_epi8(v2, shuffle);
+	v3 = _mm_shuffle_epi8(v3, shuffle);
+	_mm_storeu_si128((__m128i *)(dst + 0), _mm_or_si128(v0, _mm_slli_si128(v1, 12)));
+	_mm_storeu_si128((__m128i *)(dst + 16), _mm_or_si128(_mm_srli_si128(v1, 4), _mm_slli_si128(v2, 8)));
+	_mm_storeu_si128((__m128i *)(dst + 32), _mm_or_si128(_mm_srli_si128(v2, 8), _mm_slli_si128(v3, 4)));
+}
+
+__attribute__((target("ssse3")))
+static size_t pack16_contiguous_ssse3(uint8_t *dst, const uint8_t *src, uint32_t words)
+{
+	uint32_t i = 0;
+
+	for (; i + 8 <= words; i += 8) {
+		const __m128i *s = (const __m128i *)(src + (i * 4));
+		pack16_8words_ssse3(dst + (i * 2), _mm_loadu_si128(s + 0), _mm_loadu_si128(s + 1));
+	}
+	return (i * 2) + pack16_contiguous_scalar(dst + (i * 2), src + (i * 4), words - i);
+}
+
+__attribute__((target("ssse3")))
+static size_t pack24_contiguous_ssse3(uint8_t *dst, const uint8_t *src, uint32_t words)
+{
+	uint32_t i = 0;
+
+	for (; i + 16 <= words; i += 16) {
+		const __m128i *s = (const __m128i *)(src + (i * 4));
+		pack24_16words_ssse3(dst + (i * 3), _mm_loadu_si128(s + 0), _mm_loadu_si128(s + 1),
+			_mm_loadu_si128(s + 2), _mm_loadu_si128(s + 3));
+	}
+	return (i * 3) + pack24_contiguous_scalar(dst + (i * 3), src + (i * 4), words - i);
+}
+
+/* Streams spanning two planes, interleave the planes word by word first. */
+__attribute__((target("ssse3")))
+static size_t pack16_pair_ssse3(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint32_t words)
+{
+	uint32_t i = 0;
+
+	for (; i + 4 <= words; i += 4) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + (i * 4)));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + (i * 4)));
+		pack16_8words_ssse3(dst + (i * 4), _mm_unpacklo_epi32(va, vb), _mm_unpackhi_epi32(va, vb));
+	}
+	return (i * 4) + pack16_pair_scalar(dst + (i * 4), a + (i * 4), b + (i * 4), words - i);
+}
+
+__attribute__((target("ssse3")))
+static size_t pack24_pair_ssse3(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint32_t words)
+{
+	uint32_t i = 0;
+
+	for (; i + 8 <= words; i += 8) {
+		__m128i va0 = _mm_loadu_si128((const __m128i *)(a + (i * 4)));
+		__m128i va1 = _mm_loadu_si128((const __m128i *)(a + (i * 4) + 16));
+		__m128i vb0 = _mm_loadu_si128((const __m128i *)(b + (i * 4)));
+		__m128i vb1 = _mm_loadu_si128((const __m128i *)(b + (i * 4) + 16));
+		pack24_16words_ssse3(dst + (i * 6), _mm_unpacklo_epi32(va0, vb0), _mm_unpackhi_epi32(va0, vb0),
+			_mm_unpacklo_epi32(va1, vb1), _mm_unpackhi_epi32(va1, vb1));
+	}
+	return (i * 6) + pack24_pair_scalar(dst + (i * 6), a + (i * 4), b + (i * 4), words - i);
+}
+
+__attribute__((target("ssse3")))
+static size_t pack16_16b_contiguous_ssse3(uint8_t *dst, const uint8_t *src, uint32_t words)
+{
+	const __m128i shuffle = _mm_setr_epi8(PACK16_16B_SHUFFLE);
+	uint32_t i = 0;
+
+	for (; i + 8 <= words; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + (i * 2)));
+		_mm_storeu_si128((__m128i *)(dst + (i * 2)), _mm_shuffle_epi8(v, shuffle));
+	}
+	return (i * 2) + pack16_16b_contiguous_scalar(dst + (i * 2), src + (i * 2), words - i);
+}
+#endif /* KERNELS_X86 */
+
+/* Pa Pb preambles, as they appear in the packed byte stream. */
+static const uint8_t preamble_16b[] = { 0xf8, 0x72, 0x4e, 0x1f };
+static const uint8_t preamble_20b[] = { 0x6f, 0x87, 0x25, 0x4e, 0x1f };
+static const uint8_t preamble_24b[] = { 0x96, 0xf8, 0x72, 0xa5, 0x4e, 0x1f };
+
+typedef size_t (*find_preamble_func)(const uint8_t *buf, size_t bytes, const uint8_t *preamble, size_t len);
+
+static size_t find_preamble_c(const uint8_t *buf, size_t bytes, const uint8_t *preamble, size_t len)
+{
+	for (size_t i = 0; i + len <= bytes; i++) {
+		if (buf[i] == preamble[0] && memcmp(buf + i, preamble, len) == 0)
+			return i;
+	}
+	return bytes;
+}
+
+#if KERNELS_X86
+/* Match the first two bytes at every offset of a vector at once, confirm the rest one candidate at a time. */
+static size_t find_preamble_sse2(const uint8_t *buf, size_t bytes, const uint8_t *preamble, size_t len)
+{
+	const __m128i b0 = _mm_set1_epi8(preamble[0]), b1 = _mm_set1_epi8(preamble[1]);
+	size_t i = 0;
+
+	for (; i + 16 + len <= bytes; i += 16) {
+		__m128i v0 = _mm_loadu_si128((const __m128i *)(buf + i));
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(buf + i + 1));
+		uint32_t m = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v0, b0), _mm_cmpeq_epi8(v1, b1)));
+		for (; m; m &= m - 1) {
+			size_t k = i + __builtin_ctz(m);
+			if (memcmp(buf + k + 2, preamble + 2, len - 2) == 0)
+				return k;
+		}
+	}
+	return i + find_preamble_c(buf + i, bytes - i, preamble, len);
+}
+
+__attribute__((target("avx2")))
+static size_t find_preamble_avx2(const uint8_t *buf, size_t bytes, const uint8_t *preamble, size_t len)
+{
+	const __m256i b0 = _mm256_set1_epi8(preamble[0]), b1 = _mm256_set1_epi8(preamble[1]);
+	size_t i = 0;
+
+	for (; i + 32 + len <= bytes; i += 32) {
+		__m256i v0 = _mm256_loadu_si256((const __m256i *)(buf + i));
+		__m256i v1 = _mm256_loadu_si256((const __m256i *)(buf + i + 1));
+		uint32_t m = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(v0, b0), _mm256_cmpeq_epi8(v1, b1)));
+		for (; m; m &= m - 1) {
+			size_t k = i + __builtin_ctz(m);
+			if (memcmp(buf + k + 2, preamble + 2, len - 2) == 0)
+				return k;
+		}
+	}
+	return i + find_preamble_sse2(buf + i, bytes - i, preamble, len);
+}
+#endif /* KERNELS_X86 */
+
+typedef void (*analyze_func)(struct sdiaudio_channel_analysis_s *a, const int32_t *plane, uint32_t audioFrames);
+typedef uint32_t (*find_syncword_func)(const uint8_t *buf, uint32_t words, uint32_t stepBytes);
+typedef uint32_t (*nonzero_func)(const uint8_t *buf, uint32_t audioFrames, uint32_t channelCount,
+	uint32_t frameStrideBytes, uint32_t channelMask);
+
+static enum ltnsdi_cpu_level_e kernels_level = LTNSDI_CPU_LEVEL_GENERIC;
+static deinterleave_func deinterleave_32b = deinterleave_32b_scalar;
+static convert_func convert_s16le = convert_s16le_scalar;
+static convert_func convert_s24be = convert_s24be_scalar;
+static convert_func convert_f32 = convert_f32_scalar;
+static analyze_func analyze_32b = analyze_32b_c;
+static find_syncword_func find_syncword_32b = find_syncword_32b_c;
+static nonzero_func nonzero_32b = nonzero_32b_c;
+static pack_contiguous_func pack16_contiguous = pack16_contiguous_scalar;
+static pack_contiguous_func pack24_contiguous = pack24_contiguous_scalar;
+static pack_pair_func pack16_pair = pack16_pair_scalar;
+static pack_pair_func pack24_pair = pack24_pair_scalar;
+static pack_contiguous_func pack16_16b_contiguous = pack16_16b_contiguous_scalar;
+static find_preamble_func find_preamble = find_preamble_c;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static const char *kernels_level_names[] = {
+	[LTNSDI_CPU_LEVEL_GENERIC] = "generic",
+	[LTNSDI_CPU_LEVEL_SSE2] = "sse2",
+	[LTNSDI_CPU_LEVEL_AVX2] = "avx2",
+	[LTNSDI_CPU_LEVEL_AVX512] = "avx512",
+};
+
+static enum ltnsdi_cpu_level_e kernels_detect(void)
+{
+#if KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return LTNSDI_CPU_LEVEL_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return LTNSDI_CPU_LEVEL_AVX2;
+	return LTNSDI_CPU_LEVEL_SSE2;
+#else
+	return LTNSDI_CPU_LEVEL_GENERIC;
+#endif
+}
+
+/* The best level this cpu supports, unless LTNSDI_CPU_LEVEL asks for a lower one. */
+static void kernels_select(void)
+{
+	enum ltnsdi_cpu_level_e level = kernels_detect();
+
+	const char *force = getenv("LTNSDI_CPU_LEVEL");
+	if (force && *force) {
+		int found = -1;
+		for (int i = 0; i <= LTNSDI_CPU_LEVEL_AVX512; i++) {
+			if (strcasecmp(force, kernels_level_names[i]) == 0)
+				found = i;
+		}
+
+		if (found < 0) {
+			fprintf(stderr, "[libltnsdi] LTNSDI_CPU_LEVEL '%s' unknown, using %s\n",
+				force, kernels_level_names[level]);
+		} else
+		if (found > level) {
+			fprintf(stderr, "[libltnsdi] LTNSDI_CPU_LEVEL '%s' not supported by this cpu, using %s\n",
+				force, kernels_level_names[level]);
+		} else {
+			level = found;
+		}
+	}
+
+	kernels_level = level;
+
+#if KERNELS_X86
+	if (level >= LTNSDI_CPU_LEVEL_AVX2) {
+		deinterleave_32b = deinterleave_32b_avx2;
+		convert_s16le = convert_s16le_avx2;
+		convert_s24be = convert_s24be_avx2;
+		convert_f32 = convert_f32_avx2;
+		analyze_32b = analyze_32b_avx2;
+		find_syncword_32b = find_syncword_32b_avx2;
+		nonzero_32b = nonzero_32b_avx2;
+		find_preamble = find_preamble_avx2;
+	} else
+	if (level == LTNSDI_CPU_LEVEL_SSE2) {
+		deinterleave_32b = deinterleave_32b_sse2;
+		convert_s16le = convert_s16le_sse2;
+		convert_f32 = convert_f32_sse2;
+		nonzero_32b = nonzero_32b_sse2;
+		find_preamble = find_preamble_sse2;
+		if (__builtin_cpu_supports("ssse3"))
+			convert_s24be = convert_s24be_ssse3;
+	}
+
+	/* Packing is bound by the preamble scan that follows, 128bit shuffles are plenty. */
+	if (level >= LTNSDI_CPU_LEVEL_AVX2 || (level == LTNSDI_CPU_LEVEL_SSE2 && __builtin_cpu_supports("ssse3"))) {
+		pack16_contiguous = pack16_contiguous_ssse3;
+		pack24_contiguous = pack24_contiguous_ssse3;
+		pack16_pair = pack16_pair_ssse3;
+		pack24_pair = pack24_pair_ssse3;
+		pack16_16b_contiguous = pack16_16b_contiguous_ssse3;
+	}
+
+	/* De-interleave and conversion are bound by memory at 256 bits, only the sweeps go wider. */
+	if (level == LTNSDI_CPU_LEVEL_AVX512) {
+		analyze_32b = analyze_32b_avx512;
+		find_syncword_32b = find_syncword_32b_avx512;
+	}
+#endif
+}
+
+void sdiaudio_kernels_init(void)
+{
+	pthread_once(&kernels_once, kernels_select);
+}
+
+void sdiaudio_deinterleave_32b(const uint8_t *buf, uint32_t audioFrames, uint32_t channelsPerFrame,
+	uint32_t frameStrideBytes, int32_t **planes, int byteSwap)
+{
+	sdiaudio_kernels_init();
+	deinterleave_32b(buf, audioFrames, channelsPerFrame, frameStrideBytes, planes, byteSwap);
+}
+
+sdiaudio_deinterleave_func sdiaudio_deinterleave_32b_select(uint32_t channelsPerFrame, uint32_t frameStrideBytes)
+{
+	sdiaudio_kernels_init();
+
+#if KERNELS_X86
+	int avx2 = kernels_level >= LTNSDI_CPU_LEVEL_AVX2;
+	if (channelsPerFrame == 4 && kernels_level >= LTNSDI_CPU_LEVEL_SSE2) {
+		switch (frameStrideBytes) {
+		case 16: return avx2 ? deinterleave4_32b_avx2_16 : deinterleave4_32b_sse2_16;
+		case 32: return avx2 ? deinterleave4_32b_avx2_32 : deinterleave4_32b_sse2_32;
+		case 64: return avx2 ? deinterleave4_32b_avx2_64 : deinterleave4_32b_sse2_64;
+		}
+	}
+#endif
+
+	return deinterleave_32b;
+}
+
+void sdiaudio_analyze_32b(struct sdiaudio_channel_analysis_s *a, const int32_t *plane, uint32_t audioFrames)
+{
+	sdiaudio_kernels_init();
+	analyze_32b(a, plane, audioFrames);
+}
+
+uint32_t sdiaudio_find_syncword_32b(const uint8_t *buf, uint32_t words, uint32_t stepBytes)
+{
+	sdiaudio_kernels_init();
+	return find_syncword_32b(buf, words, stepBytes);
+}
+
+uint32_t sdiaudio_nonzero_32b(const uint8_t *buf, uint32_t audioFrames, uint32_t channelCount,
+	uint32_t frameStrideBytes, uint32_t channelMask)
+{
+	sdiaudio_kernels_init();
+	return nonzero_32b(buf, audioFrames, channelCount, frameStrideBytes, channelMask);
+}
+
+size_t sdiaudio_pack_words_32b(uint8_t *dst, const uint8_t **span, uint32_t spanCount, uint32_t audioFrames,
+	uint32_t stepBytes, uint32_t wordLength, uint32_t *carry)
+{
+	sdiaudio_kernels_init();
+
+	if (wordLength == 20)
+		return pack_words_20b(dst, span, spanCount, audioFrames, stepBytes, carry);
+
+	/* A single plane, or an interleaved pair of channels, is one contiguous run of words. */
+	if ((spanCount == 1 && stepBytes == sizeof(uint32_t)) ||
+		(spanCount == 2 && stepBytes == 2 * sizeof(uint32_t) && span[1] == span[0] + sizeof(uint32_t))) {
+		uint32_t words = audioFrames * spanCount;
+		return wordLength == 24 ? pack24_contiguous(dst, span[0], words) : pack16_contiguous(dst, span[0], words);
+	}
+
+	if (spanCount == 2 && stepBytes == sizeof(uint32_t)) {
+		return wordLength == 24 ? pack24_pair(dst, span[0], span[1], audioFrames) :
+			pack16_pair(dst, span[0], span[1], audioFrames);
+	}
+
+	return pack_words_32b_scalar(dst, span, spanCount, audioFrames, stepBytes, wordLength);
+}
+
+size_t sdiaudio_pack_words_16b(uint8_t *dst, const uint8_t **span, uint32_t spanCount, uint32_t audioFrames,
+	uint32_t stepBytes)
+{
+	sdiaudio_kernels_init();
+
+	if ((spanCount == 1 && stepBytes == sizeof(uint16_t)) ||
+		(spanCount == 2 && stepBytes == 2 * sizeof(uint16_t) && span[1] == span[0] + sizeof(uint16_t)))
+		return pack16_16b_contiguous(dst, span[0], audioFrames * spanCount);
+
+	return pack_words_16b_scalar(dst, span, spanCount, audioFrames, stepBytes);
+}
+
+size_t sdiaudio_find_preamble(const uint8_t *buf, size_t bytes, uint32_t wordLength)
+{
+	sdiaudio_kernels_init();
+
+	switch (wordLength) {
+	case 16:
+		return find_preamble(buf, bytes, preamble_16b, sizeof(preamble_16b));
+	case 20:
+		return find_preamble(buf, bytes, preamble_20b, sizeof(preamble_20b));
+	case 24:
+		return find_preamble(buf, bytes, preamble_24b, sizeof(preamble_24b));
+	}
+	return bytes;
+}
+
+uint32_t sdiaudio_format_bytes(enum ltnsdi_audio_format_e format)
+{
+	switch (format) {
+	case LTNSDI_AUDIO_FORMAT_S16LE:
+		return 2;
+	case LTNSDI_AUDIO_FORMAT_S24BE:
+		return 3;
+	case LTNSDI_AUDIO_FORMAT_S32:
+	case LTNSDI_AUDIO_FORMAT_F32:
+		return 4;
+	}
+	return 0;
+}
+
+void sdiaudio_convert_s32(enum ltnsdi_audio_format_e format, const uint8_t *buf, uint32_t audioFrames,
+	uint32_t channelsPerFrame, uint32_t frameStrideBytes, int32_t *dst)
+{
+	sdiaudio_kernels_init();
+
+	convert_func convert;
+	switch (format) {
+	case LTNSDI_AUDIO_FORMAT_S16LE:
+		convert = convert_s16le;
+		break;
+	case LTNSDI_AUDIO_FORMAT_S24BE:
+		convert = convert_s24be;
+		break;
+	case LTNSDI_AUDIO_FORMAT_F32:
+		convert = convert_f32;
+		break;
+	default:
+		return;
+	}
+
+	/* Tightly packed frames convert as one long run, otherwise a frame at a time. */
+	if (frameStrideBytes == channelsPerFrame * sdiaudio_format_bytes(format)) {
+		convert(buf, dst, audioFrames * channelsPerFrame);
+	} else {
+		for (uint32_t f = 0; f < audioFrames; f++)
+			convert(buf + (f * frameStrideBytes), dst + (f * channelsPerFrame), channelsPerFrame);
+	}
+}
+
+int ltnsdi_audio_deinterleave(const uint8_t *buf, uint32_t audioFrames, uint32_t channelsPerFrame,
+	uint32_t frameStrideBytes, int32_t **planes, int byteSwap)
+{
+	if (!buf || !planes || !channelsPerFrame)
+		return -EINVAL;
+
+	if (frameStrideBytes < (channelsPerFrame * sizeof(uint32_t)))
+		return -EINVAL;
+
+	for (int i = 0; i < channelsPerFrame; i++) {
+		if (!planes[i])
+			return -EINVAL;
+	}
+
+	sdiaudio_deinterleave_32b(buf, audioFrames, channelsPerFrame, frameStrideBytes, planes, byteSwap);
+
+	return 0; /* Success */
+}
+
+enum ltnsdi_cpu_level_e ltnsdi_cpu_level(void)
+{
+	sdiaudio_kernels_init();
+	return kernels_level;
+}
+
+const char *ltnsdi_cpu_level_name(enum ltnsdi_cpu_level_e level)
+{
+	if (level < LTNSDI_CPU_LEVEL_GENERIC || level > LTNSDI_CPU_LEVEL_AVX512)
+		return "unknown";
+	return kernels_level_names[level];
+}
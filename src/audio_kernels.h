@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) LiveTimeNet, Inc. 2017. All Rights Reserved.
+ *
+ * Address: LTN Global Communications, Inc.
+ *          Historic Savage Mill
+ *          Box 2020
+ *          8600 Foundry Street
+ *          Savage, MD 20763
+ *
+ * Contact: sales@ltnglobal.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file	audio_kernels.h
+ * @author	Steven Toth <stoth@ltnglobal.com>
+ * @copyright	Copyright (c) LiveTimeNet, Inc. 2017. All Rights Reserved.
+ * @brief	Sample processing inner loops, vectorized where the cpu allows.
+ */
+
+#ifndef _AUDIO_KERNELS_H
+#define _AUDIO_KERNELS_H
+
+#include <stdint.h>
+#include <libltnsdi/ltnsdi.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* SMPTE 337 Pa syncwords, as they appear in 32bit containers for each word length. */
+#define PA_16BIT 0xf8720000
+#define PA_20BIT 0x6f872000
+#define PA_24BIT 0x96f87200
+
+/* The Pb syncword that follows a 20bit Pa. */
+#define PB_20BIT 0x54e1f000
+
+/* Everything the write path learns about a channel from a single sweep over the packet. */
+struct sdiaudio_channel_analysis_s
+{
+	int32_t  largestSample;		/* Peak magnitude, in 16bit terms for 32bit containers. */
+	uint32_t bitMask;		/* Every word OR'd together, which bits the channel actually used. */
+	uint32_t zeroCount;		/* Total zero words. */
+	uint32_t zeroRunLongest;	/* Longest run of consecutive zero words. */
+	uint32_t zeroRunTrailing;	/* Zero words at the end of the packet, carries into the next packet. */
+	uint32_t syncwordCount;		/* Words matching a SMPTE 337 Pa syncword, in any word length. */
+};
+
+/* Pick the kernels for this cpu, or the level forced by LTNSDI_CPU_LEVEL. Runs once,
+ * every entry point below calls it, ltnsdi_context_alloc() calls it so the cost isn't paid mid stream.
+ */
+void sdiaudio_kernels_init(void);
+
+typedef void (*sdiaudio_deinterleave_func)(const uint8_t *buf, uint32_t audioFrames, uint32_t channelsPerFrame,
+	uint32_t frameStrideBytes, int32_t **planes, int byteSwap);
+
+/* Transpose interleaved 32bit words into one array per channel.
+ * planes[c] must hold audioFrames words. Optionally reverse the byte order of every word.
+ */
+void sdiaudio_deinterleave_32b(const uint8_t *buf, uint32_t audioFrames, uint32_t channelsPerFrame,
+	uint32_t frameStrideBytes, int32_t **planes, int byteSwap);
+
+/* The best kernel for repeatedly de-interleaving the given layout, without byte swapping.
+ * Common layouts get a kernel with the channel count and stride compiled in, the returned
+ * kernel ignores its channelsPerFrame and frameStrideBytes arguments in that case.
+ */
+sdiaudio_deinterleave_func sdiaudio_deinterleave_32b_select(uint32_t channelsPerFrame, uint32_t frameStrideBytes);
+
+/* Measure a single channel, already de-interleaved into contiguous memory. */
+void sdiaudio_analyze_32b(struct sdiaudio_channel_analysis_s *a, const int32_t *plane, uint32_t audioFrames);
+
+/* Index of the first of words 32bit words, stepBytes apart, that is a Pa syncword of any
+ * word length. Returns words when there are none.
+ */
+uint32_t sdiaudio_find_syncword_32b(const uint8_t *buf, uint32_t words, uint32_t stepBytes);
+
+/* Which of the first channelCount (at most 32) channels of an interleaved buffer of 32bit words
+ * carry any non zero word, as a bitmask. Only channels in channelMask are looked at, the scan
+ * stops early once they've all been seen.
+ */
+uint32_t sdiaudio_nonzero_32b(const uint8_t *buf, uint32_t audioFrames, uint32_t channelCount,
+	uint32_t frameStrideBytes, uint32_t channelMask);
+
+/* Pack SMPTE 337 words into the MSB first byte stream the detector parses. Word k (of spanCount, 1 or 2)
+ * of frame i is the top wordLength (16, 20 or 24) bits of the 32bit container at span[k] + (i * stepBytes).
+ * Two 20bit words make five bytes, an odd word leaves a nibble behind in *carry (0 when there isn't one)
+ * for the next call, it's dropped if a Pa Pb pair turns up, so every burst starts on a byte.
+ * dst must hold ((audioFrames * spanCount * wordLength) / 8) + 1 bytes. Returns the bytes written.
+ */
+size_t sdiaudio_pack_words_32b(uint8_t *dst, const uint8_t **span, uint32_t spanCount, uint32_t audioFrames,
+	uint32_t stepBytes, uint32_t wordLength, uint32_t *carry);
+
+/* As sdiaudio_pack_words_32b() for 16bit containers, which only carry 16bit words. */
+size_t sdiaudio_pack_words_16b(uint8_t *dst, const uint8_t **span, uint32_t spanCount, uint32_t audioFrames,
+	uint32_t stepBytes);
+
+/* Offset of the first SMPTE 337 Pa Pb preamble of the given word length (16, 20 or 24) lying wholly within
+ * bytes of a stream packed by the functions above. Returns bytes when there isn't one.
+ */
+size_t sdiaudio_find_preamble(const uint8_t *buf, size_t bytes, uint32_t wordLength);
+
+/* Bytes each sample occupies in the given input format. */
+uint32_t sdiaudio_format_bytes(enum ltnsdi_audio_format_e format);
+
+/* Convert interleaved samples of any supported format into tightly packed 32bit words,
+ * audio in the most significant bits. dst must hold audioFrames * channelsPerFrame words.
+ */
+void sdiaudio_convert_s32(enum ltnsdi_audio_format_e format, const uint8_t *buf, uint32_t audioFrames,
+	uint32_t channelsPerFrame, uint32_t frameStrideBytes, int32_t *dst);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _AUDIO_KERNELS_H */
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) LiveTimeNet, Inc. 2017. All Rights Reserved.
+ *
+ * Address: LTN Global Communications, Inc.
+ *          Historic Savage Mill
+ *          Box 2020
+ *          8600 Foundry Street
+ *          Savage, MD 20763
+ *
+ * Contact: sales@ltnglobal.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "audio.h"
+
+/* A small pool of helper threads. Each write call (one or more buffers) is a job, the groups in it are
+ * claimed one at a time by whichever thread gets there first, the writing thread included.
+ */
+struct sdiaudio_workers_s
+{
+	struct sdiaudio_channels_s *channels;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+
+	/* Current job, all protected by the mutex. */
+	uint64_t generation;
+	int shutdown;
+	const struct sdiaudio_write_s *job;
+	uint32_t jobCount;
+	uint32_t groupCount;
+	uint32_t nextGroup;
+	uint32_t remaining;
+	int result;
+
+	unsigned int threadCount;
+	pthread_t threads[];
+};
+
+/* Claim and process groups of the current job until none are left. Called with the mutex held, returns with it held. */
+static void workers_drain(struct sdiaudio_workers_s *w)
+{
+	while (w->job && w->nextGroup < w->groupCount) {
+		uint32_t g = w->nextGroup++;
+		const struct sdiaudio_write_s *job = w->job;
+		uint32_t jobCount = w->jobCount;
+
+		pthread_mutex_unlock(&w->mutex);
+		int ret = sdiaudio_group_write(&w->channels->group[g], job, jobCount);
+		pthread_mutex_lock(&w->mutex);
+
+		if (ret < 0)
+			w->result = ret;
+		if (--w->remaining == 0)
+			pthread_cond_broadcast(&w->done);
+	}
+}
+
+static void *workers_thread(void *p)
+{
+	struct sdiaudio_workers_s *w = p;
+	uint64_t seen = 0;
+
+	pthread_mutex_lock(&w->mutex);
+	while (1) {
+		while (!w->shutdown && w->generation == seen)
+			pthread_cond_wait(&w->wake, &w->mutex);
+
+		if (w->shutdown)
+			break;
+
+		seen = w->generation;
+		workers_drain(w);
+	}
+	pthread_mutex_unlock(&w->mutex);
+
+	return NULL;
+}
+
+int sdiaudio_workers_alloc(struct sdiaudio_workers_s **workers, struct sdiaudio_channels_s *channels, unsigned int threads)
+{
+	struct sdiaudio_workers_s *w = calloc(1, sizeof(*w) + (threads * sizeof(pthread_t)));
+	if (!w)
+		return -1;
+
+	w->channels = channels;
+	pthread_mutex_init(&w->mutex, NULL);
+	pthread_cond_init(&w->wake, NULL);
+	pthread_cond_init(&w->done, NULL);
+
+	for (unsigned int i = 0; i < threads; i++) {
+		if (pthread_create(&w->threads[i], NULL, workers_thread, w) != 0) {
+			w->threadCount = i;
+			sdiaudio_workers_free(w);
+			return -1;
+		}
+	}
+	w->threadCount = threads;
+
+	*workers = w;
+	return 0;
+}
+
+void sdiaudio_workers_free(struct sdiaudio_workers_s *w)
+{
+	pthread_mutex_lock(&w->mutex);
+	w->shutdown = 1;
+	pthread_cond_broadcast(&w->wake);
+	pthread_mutex_unlock(&w->mutex);
+
+	for (unsigned int i = 0; i < w->threadCount; i++)
+		pthread_join(w->threads[i], NULL);
+
+	pthread_cond_destroy(&w->done);
+	pthread_cond_destroy(&w->wake);
+	pthread_mutex_destroy(&w->mutex);
+	free(w);
+}
+
+/* Process every group of one or more buffers, returning once they're all complete. One job at a time,
+ * callers are already serialized by the write api contract.
+ */
+int sdiaudio_workers_run(struct sdiaudio_workers_s *w, const struct sdiaudio_write_s *job, uint32_t jobCount,
+	uint32_t groupCount)
+{
+	pthread_mutex_lock(&w->mutex);
+
+	w->job = job;
+	w->jobCount = jobCount;
+	w->groupCount = groupCount;
+	w->nextGroup = 0;
+	w->remaining = groupCount;
+	w->result = 0;
+	w->generation++;
+	pthread_cond_broadcast(&w->wake);
+
+	/* Don't sit idle, take groups alongside the helpers. */
+	workers_drain(w);
+
+	while (w->remaining)
+		pthread_cond_wait(&w->done, &w->mutex);
+
+	/* The job lives on the callers stack, make sure no helper can see it after we return. */
+	w->job = NULL;
+	int ret = w->result;
+
+	pthread_mutex_unlock(&w->mutex);
+
+	return ret;
+}
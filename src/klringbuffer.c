@@ -21,9 +21,12 @@
 
 #include <libltnsdi/klringbuffer.h>
 
+#include "pool.h"
+#include "realtime.h"
+
 #define RB_LOCK(rb) \
 	if ((rb)->usingMutex) \
-		pthread_mutex_lock(&(rb)->mutex);
+		ltnsdi_realtime_mutex_lock(&(rb)->mutex);
 
 #define RB_UNLOCK(rb) \
 	if ((rb)->usingMutex) \
@@ -34,11 +37,13 @@ KLRingBuffer *rb_new(size_t size, size_t size_max)
 	if ((size == 0) || (size > size_max))
 		return 0;
 
+	ltnsdi_realtime_check("heap allocation");
+
 	KLRingBuffer *buf = malloc(sizeof(*buf));
 	if (!buf)
 		return 0;
 
-	buf->data = malloc(size);
+	buf->data = ltnsdi_pool_alloc(size);
 	if (!buf->data) {
 		free(buf);
 		return 0;
@@ -58,7 +63,8 @@ KLRingBuffer *rb_new(size_t size, size_t size_max)
 KLRingBuffer *rb_new_threadsafe(size_t size, size_t size_max)
 {
 	KLRingBuffer *rb = rb_new(size, size_max);
-	rb->usingMutex = 1;
+	if (rb)
+		rb->usingMutex = 1;
 	return rb;
 }
 
@@ -148,7 +154,15 @@ static int _rb_grow(KLRingBuffer *buf, size_t increment)
 		return -2;
 	}
 
-	buf->data = realloc(buf->data, buf->size + increment);
+	buf->data = ltnsdi_pool_realloc(buf->data, buf->size + increment);
+
+	/* Data that wrapped past the old end would be read from the wrong place, slide the
+	 * segment before the wrap up to the new end.
+	 */
+	if (buf->head + buf->fill > buf->size) {
+		memmove(buf->data + buf->head + increment, buf->data + buf->head, buf->size - buf->head);
+		buf->head += increment;
+	}
 	buf->size += increment;
 
 	return 0;
@@ -156,11 +170,17 @@ static int _rb_grow(KLRingBuffer *buf, size_t increment)
 
 static void _rb_shrink_reset(KLRingBuffer *buf)
 {
-	buf->data = realloc(buf->data, buf->size_initial);
+	buf->data = ltnsdi_pool_realloc(buf->data, buf->size_initial);
 	buf->size = buf->size_initial;
 	buf->head = buf->fill = 0;
 }
 
+static inline void _advance_head(KLRingBuffer *buf, size_t bytes)
+{
+	buf->head = (buf->head + bytes) % buf->size;
+	buf->fill -= bytes;
+}
+
 static inline void _advance_tail(KLRingBuffer *buf, size_t bytes)
 {
 	buf->fill += bytes;
@@ -171,16 +191,25 @@ size_t rb_write_with_state(KLRingBuffer *buf, const char *from, size_t bytes, in
 	assert(buf);
 	assert(from);
 
-	*didOverflow = 0;
+	if (didOverflow)
+		*didOverflow = 0;
 	RB_LOCK(buf);
 	if (bytes > _rb_remain_in_seg(buf)) {
-		if (_rb_grow(buf, bytes * 128) < 0) {
-			RB_UNLOCK(buf);
+		/* Grow generously, but no further than the maximum. */
+		size_t increment = bytes * 128;
+		if (_rb_size(buf) + increment > buf->size_max)
+			increment = buf->size_max - _rb_size(buf);
 
+		if (bytes - _rb_remain_in_seg(buf) > increment || _rb_grow(buf, increment) < 0) {
 			/* Don't fail the write just because we've exceeded the maximum
-			 * amount of storage, instead, raise an overflow and store the data anyway.
+			 * amount of storage, instead, raise an overflow, drop just enough
+			 * of the oldest data and store the write anyway.
 			 */
-			rb_discard(buf, bytes);
+			if (bytes > _rb_size(buf)) {
+				from += bytes - _rb_size(buf);
+				bytes = _rb_size(buf);
+			}
+			_advance_head(buf, bytes - _rb_remain_in_seg(buf));
 			if (didOverflow)
 				*didOverflow = 1;
 		}
@@ -243,12 +272,6 @@ void rb_write_commit(KLRingBuffer *buf, size_t bytes)
 }
 #endif
 
-static inline void _advance_head(KLRingBuffer *buf, size_t bytes)
-{
-	buf->head = (buf->head + bytes) % buf->size;
-	buf->fill -= bytes;
-}
-
 void rb_discard(KLRingBuffer *rb, size_t bytes)
 {
 	RB_LOCK(rb);
@@ -304,6 +327,8 @@ size_t rb_read(KLRingBuffer *buf, char *to, size_t bytes)
 
 size_t rb_read_alloc(KLRingBuffer *buf, char **to, size_t bytes)
 {
+	ltnsdi_realtime_check("heap allocation");
+
 	*to = malloc(bytes);
 	if (!*to)
 		return 0;
@@ -384,7 +409,7 @@ void rb_free(KLRingBuffer *rb)
 
 	assert(rb);
 	if (rb) {
-		free(rb->data);
+		ltnsdi_pool_free(rb->data);
 		free(rb);
 	}
 }
@@ -85,63 +85,551 @@ struct ltnsdi_context_s
  */
 int ltnsdi_context_alloc(struct ltnsdi_context_s **ctx);
 
+/** Most audio channels a single context can analyze. */
+#define LTNSDI_AUDIO_CHANNELS_MAX 64
+
+/**
+ * @brief	As ltnsdi_context_alloc(), for signals carrying other than 16 channels, for example
+ *              quad link or ST 2110-30 flows. Channels are analyzed in groups of four, the count
+ *              is rounded up to a whole group. Each group costs the same to analyze, whatever the count.
+ * @param[out]	struct ltnsdi_context_s **ctx - Context.
+ * @param[in]	uint32_t channelCount - Channels to analyze, 1 to LTNSDI_AUDIO_CHANNELS_MAX.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_context_alloc_channels(struct ltnsdi_context_s **ctx, uint32_t channelCount);
+
 /**
  * @brief	Deallocate and destroy a context. See ltnsdi_context_alloc()
  * @param[in]	struct ltnsdi_context_s *ctx - Context.
  */
 void ltnsdi_context_free(struct ltnsdi_context_s *ctx);
 
+/**
+ * @brief	Process the SDI audio groups of each written buffer in parallel. Each group has
+ *              its own lock and state, so with threads > 0 a pool of helper threads takes groups
+ *              while the writing thread processes the others, the write call returns once every
+ *              group in the buffer has been processed. 0 (the default) processes every group on
+ *              the writing thread. At most one helper per group, less one, is ever used.
+ *              Must not be called concurrently with ltnsdi_audio_channels_write().
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[in]	unsigned int threads - Number of helper threads, 0 to disable.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_context_set_worker_threads(struct ltnsdi_context_s *ctx, unsigned int threads);
+
+/**
+ * @brief	Channels that have settled as unused (no SMPTE 337 lock, and PCM loss detection off)
+ *              skip all analysis, each buffer is only probed for any non zero word, which returns
+ *              the channel to full analysis. By default every buffer is probed, probing one buffer
+ *              in N trades a delay of up to N buffers in noticing a new signal for less work.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[in]	unsigned int buffers - Probe unused channels on one buffer in this many, 0 or 1 for every buffer.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_context_set_probe_interval(struct ltnsdi_context_s *ctx, unsigned int buffers);
+
+/* Optional work ltnsdi_context_set_load_shedding() may give up when analysis falls behind. */
+enum ltnsdi_shed_e
+{
+	LTNSDI_SHED_DBFS = 1,		/* Stop measuring dbFS, the last value is reported. */
+	LTNSDI_SHED_HUNT,		/* Detectors not yet locked to a SMPTE 337 stream hunt on one buffer in four. */
+	LTNSDI_SHED_PCM_DECIMATE,	/* PCM channels are analyzed, including loss detection, on one buffer in four. */
+	LTNSDI_SHED_MAX,
+};
+
+/**
+ * @brief	Keep analysis within a share of the real time each buffer represents. The time every write
+ *              spends analyzing is measured against the duration of its audio (at 48KHz). Each write over
+ *              budget sheds the next item of order, each run of writes well within budget restores
+ *              one. The current level, timings and overruns are reported in ltnsdi_status_s.load.
+ *              Must not be called concurrently with any other call on the context.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[in]	unsigned int budgetPercent - Share of the packet duration analysis may take, 0 (the default) to disable.
+ * @param[in]	const enum ltnsdi_shed_e *order - Work to shed, first item first, or NULL for
+ *              LTNSDI_SHED_DBFS, LTNSDI_SHED_HUNT then LTNSDI_SHED_PCM_DECIMATE.
+ * @param[in]	unsigned int count - Items in order, each item at most once.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_context_set_load_shedding(struct ltnsdi_context_s *ctx, unsigned int budgetPercent,
+	const enum ltnsdi_shed_e *order, unsigned int count);
+
+/**
+ * @brief	Decouple analysis from the thread delivering audio. With slots > 0, every subsequent
+ *              ltnsdi_audio_channels_write() only copies the buffer into a preallocated lock free
+ *              queue and returns, a library owned thread performs the analysis. When the queue is
+ *              full, or a buffer is larger than slotBytes, the buffer is dropped and counted.
+ *              Queue depth and drop counters are reported in ltnsdi_status_s.async.
+ *              slots 0 (the default) processes the buffer inside the write call. Any queued
+ *              buffers are processed before the mode changes.
+ *              Must not be called concurrently with any other call on the context.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[in]	unsigned int slots - Number of buffers the queue can hold, 0 to disable.
+ * @param[in]	uint32_t slotBytes - Largest buffer accepted, 0 for the largest DeckLink audio packet.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_context_set_async(struct ltnsdi_context_s *ctx, unsigned int slots, uint32_t slotBytes);
+
+/**
+ * @brief	Move channel aging (demoting PCM or SMPTE 337 channels silent for two seconds to unused),
+ *              bitrate rollover and publishing statistics for ltnsdi_status_alloc() off the write path,
+ *              onto a library owned thread woken every intervalMs. Time advances with the timestamps
+ *              of written buffers and, once writes stop, with the timer, so a stalled input is
+ *              reported as lost. Status reports lag by up to one interval. Intended for live input,
+ *              replaying faster than real time gives coarser bitrates. intervalMs 0 (the default)
+ *              does all of this on every write. Must not be called concurrently with any other call on the context.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[in]	unsigned int intervalMs - Housekeeping period, 0 to disable.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_context_set_housekeeping(struct ltnsdi_context_s *ctx, unsigned int intervalMs);
+
+/**
+ * @brief	Real-time mode, for writing from SCHED_FIFO capture threads. Every buffer the write path
+ *              could later need is allocated now, at its largest (SMPTE 337 detector carry buffers included,
+ *              any stream they're locked to is hunted for again), and all of the context's memory is
+ *              locked into RAM with mlock(). From then on writes make no heap allocations, no stdio
+ *              calls and take no lock another thread could be holding. Buffers written without a
+ *              timestamp are stamped from a clock that starts now and advances with the audio written
+ *              (48KHz), never from the system clock. Packets larger than the largest DeckLink packet
+ *              (2002 frames of 32bit audio) are refused rather than grow memory.
+ *              Fails (and stays disabled) if worker threads, housekeeping or load shedding are enabled,
+ *              each would break a guarantee, those calls fail in turn while real-time mode is enabled.
+ *              Also fails if the memory can't be locked, see RLIMIT_MEMLOCK. Configure with
+ *              --enable-realtime-check for a build that aborts if a guarantee is ever broken.
+ *              Must not be called concurrently with any other call on the context.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[in]	int enabled - Non-zero to enable, 0 (the default) to disable.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_context_set_realtime(struct ltnsdi_context_s *ctx, int enabled);
+
+/**
+ * @brief	Block until every buffer queued in asynchronous mode has been analyzed.
+ *              Returns immediately when asynchronous mode is disabled.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_audio_channels_flush(struct ltnsdi_context_s *ctx);
+
 /* Write many channels at once to the internal channels.
  * zero on success else < zero.
  * */
 int ltnsdi_audio_channels_write(struct ltnsdi_context_s *ctx, uint8_t *buf,
         uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame, uint32_t frameStrideBytes);
 
-/* Enable PCM loss detection per channel (0-15), with an allowable
+/**
+ * @brief	Identical to ltnsdi_audio_channels_write() but the caller supplies the time the buffer
+ *              was captured, for example converted from the DeckLink packet time, instead of the
+ *              library reading the system clock. Every per channel timestamp, timeout and bitrate
+ *              calculation is derived from ts, so recorded material can be replayed deterministically
+ *              and faster than real time. Timestamps must not go backwards. Dates in the status
+ *              report are rendered from these values.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[in]	const struct timeval *ts - Capture time of the first frame in buf.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_audio_channels_write_ts(struct ltnsdi_context_s *ctx, uint8_t *buf,
+        uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame, uint32_t frameStrideBytes,
+	const struct timeval *ts);
+
+/* Flags describing a channel in a single buffer, see struct ltnsdi_audio_result_channel_s. */
+#define LTNSDI_AUDIO_RESULT_TYPE_CHANGED	(1 << 0)	/* Type differs from the previous buffer. */
+#define LTNSDI_AUDIO_RESULT_PCM_LOSS		(1 << 1)	/* Silence beyond ltnsdi_audio_channels_analyze_pcm_limit(). */
+#define LTNSDI_AUDIO_RESULT_SMPTE337_LOCKED	(1 << 2)	/* The SMPTE 337 detector is locked to a stream. */
+#define LTNSDI_AUDIO_RESULT_IDLE		(1 << 3)	/* Not measured (settled as unused, or shed), peak and zeroCount are 0. */
+
+struct ltnsdi_audio_result_channel_s
+{
+	int32_t  peak;		/* Largest sample magnitude, in 16bit terms for 32bit words. */
+	uint32_t zeroCount;	/* Zero samples in the buffer. */
+	uint32_t type;		/* As ltnsdi_status_channel_s, 1 = PCM, 2 = SMPTE 337, 3 = UNUSED. */
+	uint32_t bursts;	/* SMPTE 337 bursts completed in this buffer. */
+	uint32_t flags;		/* LTNSDI_AUDIO_RESULT_* */
+};
+
+/* What a single write learned about each channel. */
+struct ltnsdi_audio_results_s
+{
+	uint32_t channelCount;	/* channelsPerFrame of the write, entries beyond it are left untouched. */
+	struct ltnsdi_audio_result_channel_s channels[LTNSDI_AUDIO_CHANNELS_MAX];
+};
+
+/**
+ * @brief	Identical to ltnsdi_audio_channels_write_ts(), additionally reporting what was learned
+ *              about every channel in this buffer before returning. Nothing is allocated or formatted,
+ *              the caller can react (switch to a backup feed, etc) from the same callback rather than
+ *              polling ltnsdi_status_alloc(). Not available in asynchronous mode, where analysis
+ *              happens after the call returns.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[in]	const struct timeval *ts - Capture time of the first frame, or NULL to use the system clock.
+ * @param[out]	struct ltnsdi_audio_results_s *results - Caller owned, filled in for channelsPerFrame channels.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_audio_channels_write_results(struct ltnsdi_context_s *ctx, uint8_t *buf,
+        uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame, uint32_t frameStrideBytes,
+	const struct timeval *ts, struct ltnsdi_audio_results_s *results);
+
+/* Sample formats accepted by ltnsdi_audio_channels_write_format(). */
+enum ltnsdi_audio_format_e
+{
+	LTNSDI_AUDIO_FORMAT_S32 = 0,	/* 32bit native endian words, audio in the most significant bits, as DeckLink delivers. */
+	LTNSDI_AUDIO_FORMAT_S16LE,	/* 16bit little endian. */
+	LTNSDI_AUDIO_FORMAT_S24BE,	/* Packed 3 byte big endian, AES67 / ST 2110-30 L24. */
+	LTNSDI_AUDIO_FORMAT_F32,	/* 32bit native endian float, full scale is +/- 1.0. */
+};
+
+/**
+ * @brief	Identical to ltnsdi_audio_channels_write_ts() for interleaved audio in formats other than
+ *              32bit words. Samples are converted, using the cpu's vector units, into the 32bit layout
+ *              and analyzed exactly as 32bit audio would be, including SMPTE 337 detection. Float
+ *              samples beyond full scale are clamped.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[in]	uint8_t *buf - Interleaved samples, starting with group 1 channel 0.
+ * @param[in]	uint32_t audioFrames - Number of frames in the buffer.
+ * @param[in]	enum ltnsdi_audio_format_e format - Format of every sample in buf.
+ * @param[in]	uint32_t channelsPerFrame - Number of channels in each frame, up to the context's channel count (at most LTNSDI_AUDIO_CHANNELS_MAX).
+ * @param[in]	uint32_t frameStrideBytes - Distance in bytes between the start of each frame.
+ * @param[in]	const struct timeval *ts - Capture time of the first frame, or NULL to use the system clock.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_audio_channels_write_format(struct ltnsdi_context_s *ctx, uint8_t *buf, uint32_t audioFrames,
+	enum ltnsdi_audio_format_e format, uint32_t channelsPerFrame, uint32_t frameStrideBytes,
+	const struct timeval *ts);
+
+struct ltnsdi_audio_plan_s;
+
+/**
+ * @brief	Prepare to write many buffers of the same layout, for example 16 channels of 32bit
+ *              words, 64 bytes per frame, as a DeckLink card delivers them. The layout is validated
+ *              and resolved to processing kernels once, common layouts get kernels with the stride
+ *              compiled in. Release the plan with ltnsdi_audio_plan_free() before the context.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[out]	struct ltnsdi_audio_plan_s **plan - Plan.
+ * @param[in]	enum ltnsdi_audio_format_e format - Format of every sample.
+ * @param[in]	uint32_t channelsPerFrame - Number of channels in each frame, up to the context's channel count (at most LTNSDI_AUDIO_CHANNELS_MAX).
+ * @param[in]	uint32_t frameStrideBytes - Distance in bytes between the start of each frame.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_audio_plan_alloc(struct ltnsdi_context_s *ctx, struct ltnsdi_audio_plan_s **plan,
+	enum ltnsdi_audio_format_e format, uint32_t channelsPerFrame, uint32_t frameStrideBytes);
+
+/**
+ * @brief	Write a buffer in the plan's layout, otherwise identical to ltnsdi_audio_channels_write_format().
+ * @param[in]	struct ltnsdi_audio_plan_s *plan - Plan.
+ * @param[in]	uint8_t *buf - Interleaved samples, starting with group 1 channel 0.
+ * @param[in]	uint32_t audioFrames - Number of frames in the buffer.
+ * @param[in]	const struct timeval *ts - Capture time of the first frame, or NULL to use the system clock.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_audio_plan_write(struct ltnsdi_audio_plan_s *plan, uint8_t *buf, uint32_t audioFrames,
+	const struct timeval *ts);
+
+/**
+ * @brief	Release a plan, see ltnsdi_audio_plan_alloc().
+ * @param[in]	struct ltnsdi_audio_plan_s *plan - Plan.
+ */
+void ltnsdi_audio_plan_free(struct ltnsdi_audio_plan_s *plan);
+
+/**
+ * @brief	Write audio delivered as one contiguous buffer per channel (planar), for example from
+ *              ST 2110-30 or file based sources, without interleaving it first. Samples are native
+ *              endian, 16bit, or 32bit words with the audio in the most significant bits exactly as
+ *              ltnsdi_audio_channels_write() expects. Channel n of the frame is planes[n], PCM and
+ *              SMPTE 337 analysis run directly on each plane. A NULL plane marks a channel the
+ *              source doesn't carry, it's left untouched.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[in]	uint8_t **planes - Array of channelCount buffers, each holding audioFrames samples.
+ * @param[in]	uint32_t audioFrames - Number of samples in each plane.
+ * @param[in]	uint32_t sampleDepth - 16 or 32.
+ * @param[in]	uint32_t channelCount - Number of planes, up to the context's channel count (at most LTNSDI_AUDIO_CHANNELS_MAX), starting with group 1 channel 0.
+ * @param[in]	const struct timeval *ts - Capture time of the first sample, or NULL to use the system clock.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_audio_channels_write_planar(struct ltnsdi_context_s *ctx, uint8_t **planes,
+	uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelCount, const struct timeval *ts);
+
+/* One packet of audio for ltnsdi_audio_channels_writev(), the arguments
+ * to ltnsdi_audio_channels_write_ts() in a struct.
+ */
+struct ltnsdi_audio_packet_s
+{
+	uint8_t *buf;
+	uint32_t audioFrames;
+	uint32_t sampleDepth;
+	uint32_t channelsPerFrame;
+	uint32_t frameStrideBytes;
+	struct timeval ts;		/* Capture time of the first frame in buf. */
+};
+
+/**
+ * @brief	Write several packets in a single call, for example when replaying recorded material or
+ *              catching up after a stall. Packets are analyzed in order, exactly as if each had been
+ *              passed to ltnsdi_audio_channels_write_ts(), but each group's lock is taken and its
+ *              statistics published once per batch rather than once per packet.
+ *              Packets may differ in frame count, depth, channel count and stride.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[in]	const struct ltnsdi_audio_packet_s *pkts - Array of packets, oldest first.
+ * @param[in]	unsigned int count - Number of packets in the array.
+ * @return      0 - Success
+ * @return      < 0 - Error, one or more packets could not be processed.
+ */
+int ltnsdi_audio_channels_writev(struct ltnsdi_context_s *ctx, const struct ltnsdi_audio_packet_s *pkts, unsigned int count);
+
+/**
+ * @brief	De-interleave a buffer of 32bit samples, in the same layout ltnsdi_audio_channels_write()
+ *              accepts, into one contiguous (planar) array per channel. Uses the cpu's
+ *              vector units where available.
+ * @param[in]	const uint8_t *buf - Interleaved samples, starting with the first channel.
+ * @param[in]	uint32_t audioFrames - Number of frames in the buffer.
+ * @param[in]	uint32_t channelsPerFrame - Number of channels to extract from each frame.
+ * @param[in]	uint32_t frameStrideBytes - Distance in bytes between the start of each frame.
+ * @param[out]	int32_t **planes - Array of channelsPerFrame destinations, each holding audioFrames words.
+ * @param[in]	int byteSwap - Non-zero to reverse the byte order of every word as it's copied.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_audio_deinterleave(const uint8_t *buf, uint32_t audioFrames, uint32_t channelsPerFrame,
+	uint32_t frameStrideBytes, int32_t **planes, int byteSwap);
+
+/* Most analyzers that can be added to a context, see ltnsdi_analyzer_add(). */
+#define LTNSDI_ANALYZERS_MAX	6
+
+/* One channel of one buffer, as handed to an analyzer's block callback. Valid only during the call. */
+struct ltnsdi_analyzer_block_s
+{
+	uint32_t channelNr;		/* 0 to the context's channel count - 1. */
+	uint32_t type;			/* As ltnsdi_status_channel_s, 1 = PCM, 2 = SMPTE 337, 3 = UNUSED. */
+	struct timeval ts;		/* Capture time of the buffer. */
+
+	/* Sample i is at samples + (i * stepBytes), a native endian word of sampleDepth bits, audio in
+	 * the most significant bits. 32bit samples are always contiguous (stepBytes 4), they've just
+	 * been copied out of the interleaved buffer and are still in cache.
+	 */
+	const uint8_t *samples;
+	uint32_t audioFrames;
+	uint32_t sampleDepth;		/* 16 or 32. */
+	uint32_t stepBytes;
+
+	/* Measured by the library's own pass over the samples, free for the analyzer to use. */
+	int32_t  peak;			/* Largest sample magnitude, in 16bit terms for 32bit words. */
+	uint32_t zeroCount;		/* Zero samples. */
+	uint32_t zeroRunTrailing;	/* Zero samples at the end of the buffer. */
+};
+
+/* A custom per channel analysis, run by the library on each channel's samples during its own pass
+ * over every buffer, rather than walking the buffer again after the write returns. Silence detection
+ * and dbFS measurement are built in analyzers of the same kind.
+ */
+struct ltnsdi_analyzer_s
+{
+	const char *name;
+
+	/* Optional. Called for each channel as the analyzer is added, whatever is stored in *channelState is
+	 * passed to the other callbacks for that channel. Return < 0 to fail ltnsdi_analyzer_add().
+	 */
+	int  (*init)(void *userContext, uint32_t channelNr, void **channelState);
+
+	/* Called for every buffer on each channel the analyzer was added to, unless the channel wasn't
+	 * measured (idle, see ltnsdi_context_set_probe_interval(), or shed). Runs on the thread analyzing
+	 * the buffer, holding the channel's group lock, so it must be quick and must not call back into
+	 * the context. In real-time mode it must not allocate or block either.
+	 */
+	void (*block)(void *channelState, const struct ltnsdi_analyzer_block_s *block);
+
+	/* Optional. Called for each channel as the analyzer is removed, or the context freed. */
+	void (*finalize)(void *channelState, uint32_t channelNr);
+};
+
+/**
+ * @brief	Run an analyzer on a set of channels, from the next buffer written onwards. The analyzer
+ *              is referenced, not copied, it must stay valid until removed. The same analyzer may be
+ *              added more than once with a different userContext.
+ *              Must not be called concurrently with any other call on the context.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[in]	const struct ltnsdi_analyzer_s *analyzer - Callbacks, block is required.
+ * @param[in]	void *userContext - Passed to init.
+ * @param[in]	uint64_t channelMask - Channels to analyze, bit 0 is the first channel.
+ * @return      0 - Success
+ * @return      < 0 - Error, including LTNSDI_ANALYZERS_MAX already added, or init failing for any channel.
+ */
+int ltnsdi_analyzer_add(struct ltnsdi_context_s *ctx, const struct ltnsdi_analyzer_s *analyzer, void *userContext,
+	uint64_t channelMask);
+
+/**
+ * @brief	Stop running an analyzer added with ltnsdi_analyzer_add(), calling its finalize callback
+ *              for each of its channels. Must not be called concurrently with any other call on the context.
+ * @param[in]	struct ltnsdi_context_s *ctx - Context.
+ * @param[in]	const struct ltnsdi_analyzer_s *analyzer - As added.
+ * @param[in]	void *userContext - As added.
+ * @return      0 - Success
+ * @return      < 0 - Error, no such analyzer.
+ */
+int ltnsdi_analyzer_remove(struct ltnsdi_context_s *ctx, const struct ltnsdi_analyzer_s *analyzer, void *userContext);
+
+/* Flags for ltnsdi_pool_enable(). */
+#define LTNSDI_POOL_HUGEPAGES	(1 << 0)	/* Back the pool with 2MB pages, reserved or transparent, where the system allows. */
+
+struct ltnsdi_pool_stats_s
+{
+	uint32_t enabled;
+	uint32_t arenas;		/* 2MB regions committed so far. */
+	uint32_t hugePageArenas;	/* Of those, backed by reserved huge pages. */
+	uint64_t bytesCommitted;
+	uint64_t bytesInUse;		/* Blocks currently handed out, at their block size. */
+	uint64_t allocations;
+	uint64_t frees;
+	uint64_t cacheHits;		/* Allocations served from the calling thread's cache, without a lock. */
+	uint64_t fallbacks;		/* Allocations larger than any block, or beyond the pool, served by the system allocator. */
+};
+
+/**
+ * @brief	Serve the working memory of every context in the process, the buffers SMPTE 337 detectors
+ *              assemble bursts straddling writes in, from one shared pool instead of the system allocator.
+ *              Blocks are powers of two up to 256KB, carved from 2MB arenas holding a single block size,
+ *              so growing carry buffers rarely move and memory doesn't fragment. Each thread caches recently
+ *              freed blocks, steady state allocation takes no lock. Memory allocated before the call
+ *              stays with the system allocator until released. Once enabled the pool stays enabled,
+ *              calling again has no effect. Best called once, before allocating any context.
+ * @param[in]	unsigned int flags - LTNSDI_POOL_* flags.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_pool_enable(unsigned int flags);
+
+/**
+ * @brief	Report the shared pool's usage, see ltnsdi_pool_enable(). All zero until it is enabled.
+ * @param[out]	struct ltnsdi_pool_stats_s *stats - Statistics.
+ * @return      0 - Success
+ * @return      < 0 - Error
+ */
+int ltnsdi_pool_stats(struct ltnsdi_pool_stats_s *stats);
+
+/**
+ * @brief	Instruction set the sample processing kernels were built for.
+ */
+enum ltnsdi_cpu_level_e
+{
+	LTNSDI_CPU_LEVEL_GENERIC = 0,	/**< Portable C. */
+	LTNSDI_CPU_LEVEL_SSE2,		/**< x86-64 baseline. */
+	LTNSDI_CPU_LEVEL_AVX2,
+	LTNSDI_CPU_LEVEL_AVX512,
+};
+
+/**
+ * @brief	The kernel level chosen for this process. The best level the cpu supports is picked
+ *              once, by the first ltnsdi_context_alloc(). Setting LTNSDI_CPU_LEVEL in the environment
+ *              to generic, sse2, avx2 or avx512 forces a lower level, for benchmarking.
+ * @return      enum ltnsdi_cpu_level_e - Level in use.
+ */
+enum ltnsdi_cpu_level_e ltnsdi_cpu_level(void);
+
+/**
+ * @brief	Printable name of a kernel level, as accepted by LTNSDI_CPU_LEVEL.
+ * @param[in]	enum ltnsdi_cpu_level_e level - Level.
+ * @return      const char * - Name.
+ */
+const char *ltnsdi_cpu_level_name(enum ltnsdi_cpu_level_e level);
+
+/* Enable PCM loss detection per channel (0 to the context's channel count - 1), with an allowable
  * limit of loss, and an ability to reset the accumulative counts. */
 int ltnsdi_audio_channels_analyze_pcm_enable(struct ltnsdi_context_s *ctx, unsigned int channelNr, int truefalse);
 int ltnsdi_audio_channels_analyze_pcm_limit(struct ltnsdi_context_s *ctx, unsigned int channelNr, unsigned int limit);
 int ltnsdi_audio_channels_analyze_pcm_reset(struct ltnsdi_context_s *ctx);
 int ltnsdi_audio_channels_analyze_pcm_console_dump(struct ltnsdi_context_s *ctx, int truefalse);
 
+struct ltnsdi_status_channel_s
+{
+	uint32_t groupNumber;
+	uint32_t channelNumber;
+	uint32_t LTNPairNumber;
+	uint32_t LTNChannelNumber;
+	uint32_t wordLength;
+
+	/* 1 = PCM
+	 * 2 = SMPTE 337
+	 * 3 = UNUSED
+	 */
+	uint32_t   type;
+	const char typeDescription[16];
+	struct timeval typeUpdated;
+	const char     typeUpdatedDescription[32];
+
+	uint64_t       buffersProcessed;
+	struct timeval lastBufferArrival;
+	const char     lastBufferArrivalDescription[32];
+	const char     lastBufferPayloadHeader[64];
+	double         bitratePs;
+	const char     bitratePsDescriptionKb[16];
+
+	/* PCM */
+	double     pcm_dbFS;
+	const char pcm_dbFSDescription[8];
+	const char pcm_channelDescription[32];
+	uint64_t   pcm_Hz;
+	uint64_t   pcm_missingAudioCount;
+
+	/* SMPTE 337 */
+	uint32_t   smpte337_dataMode;
+	uint32_t   smpte337_dataType;
+	const char smpte337_dataTypeDescription[64];
+	double     smpte337_burstPeriod;	/* Audio frames between bursts, zero until two have been seen. */
+	double     smpte337_burstJitter;	/* Smoothed deviation from that period, in audio frames. */
+	uint32_t   smpte337_burstTracking;	/* Non-zero while only the predicted burst position is checked. */
+	uint64_t   smpte337_burstMispredictions;	/* Bursts that weren't where they were due, each costing a full hunt. */
+};
+
 struct ltnsdi_status_s
 {
+	uint32_t channelCount;	/* As the context was allocated with. */
+	struct ltnsdi_status_channel_s *channels;	/* channelCount entries. */
+
+	/* Asynchronous write mode, see ltnsdi_context_set_async(). */
+	struct {
+		uint32_t enabled;
+		uint32_t slots;		/* Capacity of the queue. */
+		uint32_t depth;		/* Buffers waiting to be analyzed. */
+		uint32_t depthHighWater;
+		uint64_t enqueued;
+		uint64_t dropped;	/* Queue full, or buffer larger than a slot. */
+	} async;
+
+	/* Load shedding, see ltnsdi_context_set_load_shedding(). */
+	struct {
+		uint32_t enabled;
+		uint32_t level;		/* Items of the order currently shed, 0 when keeping up. */
+		uint32_t shed;		/* The same, as a bitmask of (1 << enum ltnsdi_shed_e). */
+		uint64_t budgetUs;	/* Of the most recent write. */
+		uint64_t lastUs;	/* Time the most recent write spent analyzing. */
+		uint64_t peakUs;
+		uint64_t overruns;	/* Writes that took longer than their budget. */
+	} load;
+
+	/* Memory held by the context, including any asynchronous queue. */
+	struct {
+		uint64_t totalBytes;
+		uint64_t detectorBytes;	/* SMPTE 337 detectors, each holds a carry buffer only while locked to a stream. */
+		uint32_t detectorBuffers;	/* Detectors currently holding a carry buffer. */
+	} memory;
+
+	/* Real-time mode, see ltnsdi_context_set_realtime(). */
 	struct {
-		uint32_t groupNumber;
-		uint32_t channelNumber;
-		uint32_t LTNPairNumber;
-		uint32_t LTNChannelNumber;
-		uint32_t wordLength;
-
-		/* 1 = PCM
-		 * 2 = SMPTE 337
-		 * 3 = UNUSED
-		 */
-		uint32_t   type;
-		const char typeDescription[16];
-		struct timeval typeUpdated;
-		const char     typeUpdatedDescription[32];
-
-		uint64_t       buffersProcessed;
-		struct timeval lastBufferArrival;
-		const char     lastBufferArrivalDescription[32];
-		const char     lastBufferPayloadHeader[64];
-		double         bitratePs;
-		const char     bitratePsDescriptionKb[16];
-
-		/* PCM */
-		double     pcm_dbFS;
-		const char pcm_dbFSDescription[8];
-		const char pcm_channelDescription[32];
-		uint64_t   pcm_Hz;
-		uint64_t   pcm_missingAudioCount;
-
-		/* SMPTE 337 */
-		uint32_t   smpte337_dataMode;
-		uint32_t   smpte337_dataType;
-		const char smpte337_dataTypeDescription[64];
-
-	} channels[16];
+		uint32_t enabled;
+		uint64_t lockedBytes;	/* Context memory locked into RAM. */
+	} realtime;
 };
 
 /**
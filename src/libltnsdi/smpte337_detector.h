@@ -32,7 +32,6 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <unistd.h>
-#include <libltnsdi/klringbuffer.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -40,6 +39,11 @@ extern "C" {
 
 struct smpte337_detector_s;
 
+/* Carry buffer size in real-time mode, fixed, see smpte337_detector_set_realtime(). Bursts larger than this
+ * are only found when they lie wholly within a single write.
+ */
+#define SMPTE337_DETECTOR_REALTIME_CARRY (64 * 1024)
+
 typedef void (*smpte337_detector_callback)(void *user_context,
 	struct smpte337_detector_s *ctx, 
 	uint8_t datamode, uint8_t datatype, uint32_t payload_bitCount,
@@ -47,29 +51,80 @@ typedef void (*smpte337_detector_callback)(void *user_context,
 
 struct smpte337_detector_s
 {
-	KLRingBuffer *rb;
+	/* Bursts that continue into the next write are assembled here, only allocated while locked to
+	 * a stream (wordLength != 0). Between bursts it holds the last few bytes written, which could
+	 * begin a preamble.
+	 */
+	uint8_t *carry;
+	size_t carrySize;
+	size_t carryUsed;
+	size_t burstBytes;	/* Of the burst being assembled in carry, 0 when there isn't one. */
 
 	smpte337_detector_callback cb;
 	void *cbContext;
 
 	/*  0. The framework should attempt to determine the wordlength,
 	 *     looking for the specific syncword1/2 patterns before
-	 *     committing any data to the ring buffers.
+	 *     committing any data to the carry buffer.
 	 * 16. Detected operating on 16bit words.
 	 * 20. Detected operating on 20bit words.
 	 * 24. Detected operating on 24bit words.
 	 */
 	uint32_t wordLength;
 	uint32_t spanCount;
+	uint32_t nibble;	/* 20bit words, the nibble left over from an odd word count, plus 0x10. */
+
+	/* Burst period tracking, positions are bytes of the packed stream since we locked. */
+	uint64_t streamBytes;	/* Parsed so far. */
+	uint64_t bursts;
+	uint64_t lastBurst;	/* Where the last burst began. */
+	uint64_t periodBytes;	/* Between the last two bursts, 0 until measured. */
+	double   jitterBytes;	/* Smoothed difference between successive periods. */
+	uint32_t tracking;	/* Only the position the next burst is due at is checked. */
+	uint64_t mispredictions;	/* Bursts that weren't where they were due, not reset with the stream. */
+
+	/* Real-time mode, words are packed into the caller's payload buffer rather than on the stack. */
+	uint32_t realtime;
+	uint8_t *payload;
+	size_t payloadSize;
 };
 
 struct smpte337_detector_s *smpte337_detector_alloc(smpte337_detector_callback cb, void *cbContext);
 
 void smpte337_detector_free(struct smpte337_detector_s *ctx);
 
+/* Drop any stream the detector is locked to, release its carry buffer (outside real-time mode) and hunt again. */
+void smpte337_detector_reset(struct smpte337_detector_s *ctx);
+
+/* Real-time use, payload is a buffer of at least SMPTE337_DETECTOR_REALTIME_CARRY bytes, owned by the
+ * caller and only used during writes, which may be shared by detectors that are never written concurrently.
+ * The carry buffer is allocated now, at a fixed size, and kept across resets, so writes never allocate, and
+ * nothing is ever printed. Any stream the detector is locked to is dropped. A NULL payload returns
+ * the detector to normal use. Returns 0 on success, -1 if the carry buffer can't be allocated.
+ */
+int smpte337_detector_set_realtime(struct smpte337_detector_s *ctx, uint8_t *payload, size_t payloadSize);
+
+/* Bytes of memory the detector currently holds, its carry buffer included. */
+size_t smpte337_detector_memory(struct smpte337_detector_s *ctx);
+
+/* Bursts repeat at a steady period, 1536 frames for AC-3, a video frame for Dolby E. Once two successive
+ * periods agree, only the position the next burst is due at is checked, everything in between is skipped,
+ * until a burst isn't where it was due and every byte is hunted through again. The last period and its
+ * smoothed jitter, in audio frames, 0 until measured, and how often tracking has fallen back to a hunt.
+ * Returns 1 while tracking, 0 while hunting.
+ */
+int smpte337_detector_period(struct smpte337_detector_s *ctx, double *periodFrames, double *jitterFrames,
+	uint64_t *mispredictions);
+
 size_t smpte337_detector_write(struct smpte337_detector_s *ctx, uint8_t *buf,
 	uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame, uint32_t frameStrideBytes);
 
+/* As smpte337_detector_write() but for a channel held in its own contiguous buffer.
+ * nextPlane is the following channel, needed for bitstreams that span two channels, may be NULL.
+ */
+size_t smpte337_detector_write_planar(struct smpte337_detector_s *ctx, const uint8_t *plane, const uint8_t *nextPlane,
+	uint32_t audioFrames, uint32_t sampleDepth);
+
 #ifdef __cplusplus
 };
 #endif
@@ -35,11 +35,22 @@
 
 int ltnsdi_context_alloc(struct ltnsdi_context_s **ctx)
 {
+	return ltnsdi_context_alloc_channels(ctx, SDI_AUDIO_CHANNELS_DEFAULT);
+}
+
+int ltnsdi_context_alloc_channels(struct ltnsdi_context_s **ctx, uint32_t channelCount)
+{
+	if (channelCount == 0 || channelCount > LTNSDI_AUDIO_CHANNELS_MAX)
+		return -EINVAL;
+
 	struct ltnsdi_context_s *p = calloc(1, sizeof(struct ltnsdi_context_s));
 	if (!p)
 		return -ENOMEM;
 
-	if (sdiaudio_channels_alloc((struct sdiaudio_channels_s **)&p->priv) < 0) {
+	/* Settle on the cpu's kernels now rather than on the first write. */
+	sdiaudio_kernels_init();
+
+	if (sdiaudio_channels_alloc((struct sdiaudio_channels_s **)&p->priv, channelCount) < 0) {
 		free(p);
 		return -1;
 	}
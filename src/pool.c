@@ -0,0 +1,469 @@
+/*
+ * Copyright (c) LiveTimeNet, Inc. 2017. All Rights Reserved.
+ *
+ * Address: LTN Global Communications, Inc.
+ *          Historic Savage Mill
+ *          Box 2020
+ *          8600 Foundry Street
+ *          Savage, MD 20763
+ *
+ * Contact: sales@ltnglobal.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "pool.h"
+#include "realtime.h"
+
+/* Blocks are powers of two from 64 bytes to 256KB, the largest a detector carry buffer grows to.
+ * Each 2MB arena (one huge page) only ever holds blocks of a single size, the size of any
+ * block is found from the arena it falls in. Every arena lives inside a single range of
+ * address space reserved up front, so any pointer outside it belongs to the system allocator.
+ */
+#define POOL_CLASS_MIN_SHIFT 6
+#define POOL_CLASS_MAX_SHIFT 18
+#define POOL_CLASSES (POOL_CLASS_MAX_SHIFT - POOL_CLASS_MIN_SHIFT + 1)
+
+#define POOL_ARENA_SHIFT 21
+#define POOL_ARENA_SIZE (1UL << POOL_ARENA_SHIFT)
+#define POOL_ARENAS 512
+
+/* Most each thread keeps cached per block size, before handing blocks back to the pool. */
+#define POOL_CACHE_BYTES (512 * 1024)
+
+struct pool_block_s
+{
+	struct pool_block_s *next;
+};
+
+struct pool_class_s
+{
+	pthread_mutex_t mutex;
+	struct pool_block_s *free;
+
+	/* Uncarved remainder of the newest arena of this size. */
+	uint8_t *bump;
+	uint8_t *bumpEnd;
+} __attribute__((aligned(64)));
+
+/* Only written by the owning thread, summed by ltnsdi_pool_stats(). */
+struct pool_counters_s
+{
+	uint64_t allocations;
+	uint64_t frees;
+	uint64_t cacheHits;
+	uint64_t fallbacks;
+	int64_t  bytesInUse;	/* Blocks freed on another thread than allocated them make this negative. */
+};
+
+struct pool_cache_s
+{
+	struct pool_block_s *free[POOL_CLASSES];
+	uint32_t count[POOL_CLASSES];
+	struct pool_counters_s counters;
+
+	struct pool_cache_s *prev, *next;
+};
+
+static struct
+{
+	int enabled;
+	unsigned int flags;
+	uint8_t *base;
+
+	/* Protected by mutex, along with the list of caches and the counters of exited threads. */
+	pthread_mutex_t mutex;
+	uint32_t arenas;
+	uint32_t hugeArenas;
+	uint8_t arenaClass[POOL_ARENAS];
+	struct pool_cache_s *caches;
+	struct pool_counters_s retired;
+	pthread_key_t key;
+
+	struct pool_class_s classes[POOL_CLASSES];
+} g_pool = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static __thread struct pool_cache_s *t_cache;
+
+#define POOL_COUNT(c, field, n) \
+	__atomic_store_n(&(c)->counters.field, (c)->counters.field + (n), __ATOMIC_RELAXED)
+
+static __inline__ int pool_class(size_t size)
+{
+	if (size > (1UL << POOL_CLASS_MAX_SHIFT))
+		return -1;
+	if (size <= (1UL << POOL_CLASS_MIN_SHIFT))
+		return 0;
+
+	return (64 - __builtin_clzl(size - 1)) - POOL_CLASS_MIN_SHIFT;
+}
+
+static __inline__ size_t pool_class_size(int cls)
+{
+	return 1UL << (cls + POOL_CLASS_MIN_SHIFT);
+}
+
+static __inline__ uint32_t pool_cache_limit(int cls)
+{
+	uint32_t n = POOL_CACHE_BYTES / pool_class_size(cls);
+	if (n > 64)
+		n = 64;
+	if (n < 2)
+		n = 2;
+
+	return n;
+}
+
+static __inline__ int pool_owns(const void *p)
+{
+	const uint8_t *base = __atomic_load_n(&g_pool.base, __ATOMIC_RELAXED);
+
+	return base && (const uint8_t *)p >= base && (const uint8_t *)p < base + ((size_t)POOL_ARENAS * POOL_ARENA_SIZE);
+}
+
+static __inline__ int pool_block_class(const void *p)
+{
+	return g_pool.arenaClass[((const uint8_t *)p - g_pool.base) >> POOL_ARENA_SHIFT];
+}
+
+static void pool_counters_add(struct pool_counters_s *dst, const struct pool_counters_s *src)
+{
+	dst->allocations += __atomic_load_n(&src->allocations, __ATOMIC_RELAXED);
+	dst->frees += __atomic_load_n(&src->frees, __ATOMIC_RELAXED);
+	dst->cacheHits += __atomic_load_n(&src->cacheHits, __ATOMIC_RELAXED);
+	dst->fallbacks += __atomic_load_n(&src->fallbacks, __ATOMIC_RELAXED);
+	dst->bytesInUse += __atomic_load_n(&src->bytesInUse, __ATOMIC_RELAXED);
+}
+
+/* Hand a chain of blocks, head to tail, back to the pool. */
+static void pool_class_give(int cls, struct pool_block_s *head, struct pool_block_s *tail)
+{
+	struct pool_class_s *pc = &g_pool.classes[cls];
+
+	pthread_mutex_lock(&pc->mutex);
+	tail->next = pc->free;
+	pc->free = head;
+	pthread_mutex_unlock(&pc->mutex);
+}
+
+/* Map the next arena of the reservation for blocks of this size. Must hold the class mutex. */
+static int pool_arena_commit(int cls)
+{
+	struct pool_class_s *pc = &g_pool.classes[cls];
+
+	pthread_mutex_lock(&g_pool.mutex);
+
+	if (g_pool.arenas == POOL_ARENAS) {
+		pthread_mutex_unlock(&g_pool.mutex);
+		return -1;
+	}
+
+	uint8_t *arena = g_pool.base + ((size_t)g_pool.arenas * POOL_ARENA_SIZE);
+	void *p = MAP_FAILED;
+
+	if (g_pool.flags & LTNSDI_POOL_HUGEPAGES) {
+		p = mmap(arena, POOL_ARENA_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED)
+			g_pool.hugeArenas++;
+	}
+	if (p == MAP_FAILED) {
+		p = mmap(arena, POOL_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+		if (p == MAP_FAILED) {
+			pthread_mutex_unlock(&g_pool.mutex);
+			return -1;
+		}
+
+		/* No reserved huge pages, transparent ones are the next best thing. */
+		if (g_pool.flags & LTNSDI_POOL_HUGEPAGES)
+			madvise(arena, POOL_ARENA_SIZE, MADV_HUGEPAGE);
+	}
+
+	g_pool.arenaClass[g_pool.arenas++] = cls;
+
+	pthread_mutex_unlock(&g_pool.mutex);
+
+	pc->bump = arena;
+	pc->bumpEnd = arena + POOL_ARENA_SIZE;
+
+	return 0;
+}
+
+/* Take up to count blocks from the pool into the cache, returns the first of them. */
+static struct pool_block_s *pool_class_take(struct pool_cache_s *c, int cls, uint32_t count)
+{
+	struct pool_class_s *pc = &g_pool.classes[cls];
+	size_t size = pool_class_size(cls);
+	struct pool_block_s *first = NULL;
+
+	pthread_mutex_lock(&pc->mutex);
+
+	for (uint32_t i = 0; i < count; i++) {
+		struct pool_block_s *b = pc->free;
+		if (b) {
+			pc->free = b->next;
+		} else {
+			if (pc->bump + size > pc->bumpEnd && pool_arena_commit(cls) < 0)
+				break;
+			b = (struct pool_block_s *)pc->bump;
+			pc->bump += size;
+		}
+
+		if (!first) {
+			first = b;
+		} else {
+			b->next = c->free[cls];
+			c->free[cls] = b;
+			c->count[cls]++;
+		}
+	}
+
+	pthread_mutex_unlock(&pc->mutex);
+
+	return first;
+}
+
+/* A thread is exiting, return its cached blocks and keep its counters. */
+static void pool_cache_release(void *p)
+{
+	struct pool_cache_s *c = p;
+
+	for (int cls = 0; cls < POOL_CLASSES; cls++) {
+		struct pool_block_s *head = c->free[cls];
+		if (!head)
+			continue;
+
+		struct pool_block_s *tail = head;
+		while (tail->next)
+			tail = tail->next;
+		pool_class_give(cls, head, tail);
+	}
+
+	pthread_mutex_lock(&g_pool.mutex);
+	pool_counters_add(&g_pool.retired, &c->counters);
+	if (c->prev)
+		c->prev->next = c->next;
+	else
+		g_pool.caches = c->next;
+	if (c->next)
+		c->next->prev = c->prev;
+	pthread_mutex_unlock(&g_pool.mutex);
+
+	t_cache = NULL;
+	free(c);
+}
+
+static struct pool_cache_s *pool_cache(void)
+{
+	if (t_cache)
+		return t_cache;
+
+	struct pool_cache_s *c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+
+	pthread_mutex_lock(&g_pool.mutex);
+	c->next = g_pool.caches;
+	if (c->next)
+		c->next->prev = c;
+	g_pool.caches = c;
+	pthread_mutex_unlock(&g_pool.mutex);
+
+	pthread_setspecific(g_pool.key, c);
+	t_cache = c;
+
+	return c;
+}
+
+void *ltnsdi_pool_alloc(size_t size)
+{
+	ltnsdi_realtime_check("heap allocation");
+
+	if (!__atomic_load_n(&g_pool.enabled, __ATOMIC_ACQUIRE))
+		return malloc(size);
+
+	struct pool_cache_s *c = pool_cache();
+	if (!c)
+		return malloc(size);
+
+	int cls = pool_class(size);
+	if (cls < 0) {
+		POOL_COUNT(c, fallbacks, 1);
+		return malloc(size);
+	}
+
+	struct pool_block_s *b = c->free[cls];
+	if (b) {
+		c->free[cls] = b->next;
+		c->count[cls]--;
+		POOL_COUNT(c, cacheHits, 1);
+	} else {
+		/* Refill half the cache while we hold the lock. */
+		b = pool_class_take(c, cls, 1 + (pool_cache_limit(cls) / 2));
+		if (!b) {
+			POOL_COUNT(c, fallbacks, 1);
+			return malloc(size);
+		}
+	}
+
+	POOL_COUNT(c, allocations, 1);
+	POOL_COUNT(c, bytesInUse, (int64_t)pool_class_size(cls));
+
+	return b;
+}
+
+void ltnsdi_pool_free(void *p)
+{
+	ltnsdi_realtime_check("heap free");
+
+	if (!p)
+		return;
+
+	if (!pool_owns(p)) {
+		free(p);
+		return;
+	}
+
+	int cls = pool_block_class(p);
+	struct pool_block_s *b = p;
+
+	struct pool_cache_s *c = pool_cache();
+	if (!c) {
+		pool_class_give(cls, b, b);
+		return;
+	}
+
+	POOL_COUNT(c, frees, 1);
+	POOL_COUNT(c, bytesInUse, -(int64_t)pool_class_size(cls));
+
+	b->next = c->free[cls];
+	c->free[cls] = b;
+
+	/* Cache full, give half of it back in one go. */
+	if (++c->count[cls] > pool_cache_limit(cls)) {
+		uint32_t n = c->count[cls] / 2;
+		struct pool_block_s *head = c->free[cls], *tail = head;
+		for (uint32_t i = 1; i < n; i++)
+			tail = tail->next;
+
+		c->free[cls] = tail->next;
+		c->count[cls] -= n;
+		pool_class_give(cls, head, tail);
+	}
+}
+
+void *ltnsdi_pool_realloc(void *p, size_t size)
+{
+	ltnsdi_realtime_check("heap reallocation");
+
+	if (!p)
+		return ltnsdi_pool_alloc(size);
+
+	if (!pool_owns(p))
+		return realloc(p, size);
+
+	/* Anything that still belongs in the same size of block stays where it is. */
+	int cls = pool_block_class(p);
+	if (pool_class(size) == cls)
+		return p;
+
+	void *n = ltnsdi_pool_alloc(size);
+	if (!n)
+		return NULL;
+
+	size_t have = pool_class_size(cls);
+	memcpy(n, p, size < have ? size : have);
+	ltnsdi_pool_free(p);
+
+	return n;
+}
+
+int ltnsdi_pool_enable(unsigned int flags)
+{
+	pthread_mutex_lock(&g_pool.mutex);
+
+	if (g_pool.enabled) {
+		pthread_mutex_unlock(&g_pool.mutex);
+		return 0;
+	}
+
+	/* Reserve the address space of every arena, aligned to an arena, committing nothing yet. */
+	size_t len = ((size_t)POOL_ARENAS + 1) * POOL_ARENA_SIZE;
+	uint8_t *p = mmap(NULL, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED) {
+		pthread_mutex_unlock(&g_pool.mutex);
+		return -1;
+	}
+
+	uint8_t *base = (uint8_t *)(((uintptr_t)p + POOL_ARENA_SIZE - 1) & ~(POOL_ARENA_SIZE - 1));
+	if (base > p)
+		munmap(p, base - p);
+	munmap(base + ((size_t)POOL_ARENAS * POOL_ARENA_SIZE), (p + len) - (base + ((size_t)POOL_ARENAS * POOL_ARENA_SIZE)));
+
+	if (pthread_key_create(&g_pool.key, pool_cache_release) != 0) {
+		munmap(base, (size_t)POOL_ARENAS * POOL_ARENA_SIZE);
+		pthread_mutex_unlock(&g_pool.mutex);
+		return -1;
+	}
+
+	for (int cls = 0; cls < POOL_CLASSES; cls++)
+		pthread_mutex_init(&g_pool.classes[cls].mutex, NULL);
+
+	g_pool.flags = flags;
+	__atomic_store_n(&g_pool.base, base, __ATOMIC_RELAXED);
+	__atomic_store_n(&g_pool.enabled, 1, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&g_pool.mutex);
+
+	return 0;
+}
+
+int ltnsdi_pool_stats(struct ltnsdi_pool_stats_s *stats)
+{
+	if (!stats)
+		return -1;
+
+	memset(stats, 0, sizeof(*stats));
+
+	pthread_mutex_lock(&g_pool.mutex);
+
+	if (g_pool.enabled) {
+		struct pool_counters_s sum = g_pool.retired;
+		for (struct pool_cache_s *c = g_pool.caches; c; c = c->next)
+			pool_counters_add(&sum, &c->counters);
+
+		stats->enabled = 1;
+		stats->arenas = g_pool.arenas;
+		stats->hugePageArenas = g_pool.hugeArenas;
+		stats->bytesCommitted = (uint64_t)g_pool.arenas * POOL_ARENA_SIZE;
+		stats->bytesInUse = sum.bytesInUse > 0 ? sum.bytesInUse : 0;
+		stats->allocations = sum.allocations;
+		stats->frees = sum.frees;
+		stats->cacheHits = sum.cacheHits;
+		stats->fallbacks = sum.fallbacks;
+	}
+
+	pthread_mutex_unlock(&g_pool.mutex);
+
+	return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) LiveTimeNet, Inc. 2017. All Rights Reserved.
+ *
+ * Address: LTN Global Communications, Inc.
+ *          Historic Savage Mill
+ *          Box 2020
+ *          8600 Foundry Street
+ *          Savage, MD 20763
+ *
+ * Contact: sales@ltnglobal.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/**
+ * @file	pool.h
+ * @author	Steven Toth <stoth@ltnglobal.com>
+ * @copyright	Copyright (c) LiveTimeNet, Inc. 2017. All Rights Reserved.
+ * @brief	Process wide pool of fixed size blocks, for working memory shared by every context.
+ */
+
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <stddef.h>
+#include <libltnsdi/ltnsdi.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Drop in replacements for malloc, realloc and free. Until ltnsdi_pool_enable() is called they
+ * are exactly that, afterwards they're served from the pool. Memory from either source may be
+ * released by ltnsdi_pool_free(), whenever it was allocated.
+ */
+void *ltnsdi_pool_alloc(size_t size);
+void *ltnsdi_pool_realloc(void *p, size_t size);
+void  ltnsdi_pool_free(void *p);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _POOL_H */
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) LiveTimeNet, Inc. 2017. All Rights Reserved.
+ *
+ * Address: LTN Global Communications, Inc.
+ *          Historic Savage Mill
+ *          Box 2020
+ *          8600 Foundry Street
+ *          Savage, MD 20763
+ *
+ * Contact: sales@ltnglobal.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/**
+ * @file	realtime.h
+ * @author	Steven Toth <stoth@ltnglobal.com>
+ * @copyright	Copyright (c) LiveTimeNet, Inc. 2017. All Rights Reserved.
+ * @brief	Checks of the guarantees real-time mode makes, see ltnsdi_context_set_realtime().
+ */
+
+#ifndef _REALTIME_H
+#define _REALTIME_H
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Built with --enable-realtime-check, every place the library allocates, writes to stdio, reads
+ * the clock or could wait on a lock is checked first. On a thread analyzing buffers for a context
+ * in real-time mode that's a broken guarantee, and the process is aborted. Otherwise the checks
+ * compile away.
+ */
+#if LTNSDI_REALTIME_CHECK
+
+extern __thread int ltnsdi_realtime_thread;
+
+void ltnsdi_realtime_violation(const char *what) __attribute__((noreturn));
+
+#define ltnsdi_realtime_check(what) \
+	do { if (ltnsdi_realtime_thread) ltnsdi_realtime_violation(what); } while (0)
+
+/* Mark this thread as analyzing for a real-time context (or not), returns the previous state for ltnsdi_realtime_end(). */
+static __inline__ int ltnsdi_realtime_begin(int enabled)
+{
+	int was = ltnsdi_realtime_thread;
+	ltnsdi_realtime_thread = enabled;
+	return was;
+}
+
+static __inline__ void ltnsdi_realtime_end(int was)
+{
+	ltnsdi_realtime_thread = was;
+}
+
+/* pthread_mutex_lock(), for locks a real-time thread must never have to wait for. */
+static __inline__ void ltnsdi_realtime_mutex_lock(pthread_mutex_t *mutex)
+{
+	if (!ltnsdi_realtime_thread)
+		pthread_mutex_lock(mutex);
+	else
+	if (pthread_mutex_trylock(mutex) != 0)
+		ltnsdi_realtime_violation("contended lock");
+}
+
+#else
+
+#define ltnsdi_realtime_check(what) do { } while (0)
+
+static __inline__ int ltnsdi_realtime_begin(int enabled)
+{
+	return 0;
+}
+
+static __inline__ void ltnsdi_realtime_end(int was)
+{
+}
+
+#define ltnsdi_realtime_mutex_lock(mutex) pthread_mutex_lock(mutex)
+
+#endif
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* _REALTIME_H */
@@ -21,140 +21,124 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <libltnsdi/smpte337_detector.h>
 
+#include "audio_kernels.h"
+#include "pool.h"
+#include "realtime.h"
+
+/* Diagnostics, never printed in real-time mode. */
+#define detector_log(ctx, f, ...) \
+	do { \
+		if (!(ctx)->realtime) { \
+			ltnsdi_realtime_check("stdio"); \
+			fprintf(f, __VA_ARGS__); \
+		} \
+	} while (0)
+
+/* Bursts straddling writes are assembled in the carry buffer, which starts small and grows to fit. */
+#define CARRY_INITIAL (8 * 1024)
+#define CARRY_MAX (256 * 1024)
+
 struct smpte337_detector_s *smpte337_detector_alloc(smpte337_detector_callback cb, void *cbContext)
 {
 	struct smpte337_detector_s *ctx = calloc(1, sizeof(*ctx));
 	if (!ctx)
 		return NULL;
 
+	/* The carry buffer is allocated once we lock to a stream, most channels never carry one. */
 	ctx->spanCount = 1;
 	ctx->cb = cb;
 	ctx->cbContext = cbContext;
-	ctx->rb = rb_new_threadsafe(32 * 1024, 256 * 1024);
-	if (!ctx->rb) {
-		free(ctx);
-		return NULL;
-	}
 
 	return ctx;
 }
 
 void smpte337_detector_free(struct smpte337_detector_s *ctx)
 {
-	rb_free(ctx->rb);
+	if (ctx->carry)
+		ltnsdi_pool_free(ctx->carry);
 	free(ctx);
 }
 
-static void handleCallback(struct smpte337_detector_s *ctx, uint8_t datamode, uint8_t datatype,
-	uint32_t payload_bitCount, uint8_t *payload)
+void smpte337_detector_reset(struct smpte337_detector_s *ctx)
 {
-	ctx->cb(ctx->cbContext, ctx, datamode, datatype, payload_bitCount, payload);
+	if (ctx->carry && !ctx->realtime) {
+		ltnsdi_pool_free(ctx->carry);
+		ctx->carry = NULL;
+		ctx->carrySize = 0;
+	}
+	ctx->carryUsed = 0;
+	ctx->burstBytes = 0;
+	ctx->wordLength = 0;
+	ctx->spanCount = 1;
+	ctx->nibble = 0;
+	ctx->streamBytes = 0;
+	ctx->bursts = 0;
+	ctx->lastBurst = 0;
+	ctx->periodBytes = 0;
+	ctx->jitterBytes = 0;
+	ctx->tracking = 0;
 }
 
-/* 16b mode is largely untested, fair wanring. */
-static size_t smpte337_detector_write_16b(struct smpte337_detector_s *ctx, uint8_t *buf,
-	uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame,
-	uint32_t frameStrideBytes,
-	uint32_t spanCount)
+int smpte337_detector_set_realtime(struct smpte337_detector_s *ctx, uint8_t *payload, size_t payloadSize)
 {
-	size_t consumed = 0;
+	/* Either way, start over without a carry buffer. */
+	ctx->realtime = 0;
+	ctx->payload = NULL;
+	ctx->payloadSize = 0;
+	smpte337_detector_reset(ctx);
 
-	uint16_t *p = (uint16_t *)buf;
-	for (int i = 0; i < audioFrames; i++) {
+	if (!payload)
+		return 0;
 
-		uint16_t *q = p;
-		for (int k = 0; k < spanCount; k++) {
-			/* Sample in N words into a byte orientied buffer */
-			uint8_t *x = (uint8_t *)q;
+	/* Allocated at its largest, so it never grows, and never shrinks. */
+	ctx->carry = ltnsdi_pool_alloc(SMPTE337_DETECTOR_REALTIME_CARRY);
+	if (!ctx->carry)
+		return -1;
+	ctx->carrySize = SMPTE337_DETECTOR_REALTIME_CARRY;
 
-			/* Flush the word into the fifo MSB first */
-			int didOverflow = 0;
-			rb_write_with_state(ctx->rb, ((const char *)x) + 1, 1, &didOverflow);
-			if (didOverflow) {
-				fprintf(stderr, "overflow occured.\n");
-			}
-			rb_write_with_state(ctx->rb, ((const char *)x) + 0, 1, &didOverflow);
-			if (didOverflow) {
-				fprintf(stderr, "overflow occured.\n");
-			}
-			q++;
-			consumed += 2;
-		}
+	ctx->realtime = 1;
+	ctx->payload = payload;
+	ctx->payloadSize = payloadSize;
 
-		p += (frameStrideBytes / sizeof(uint16_t));
-	}
-	return consumed;
+	return 0;
 }
 
-static size_t smpte337_detector_write_32b(struct smpte337_detector_s *ctx, uint8_t *buf,
-	uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame,
-	uint32_t frameStrideBytes,
-	uint32_t spanCount)
+size_t smpte337_detector_memory(struct smpte337_detector_s *ctx)
 {
-	size_t consumed = 0;
+	return sizeof(*ctx) + ctx->carrySize;
+}
 
-	uint32_t *p = (uint32_t *)buf;
-	for (int i = 0; i < audioFrames; i++) {
-
-		uint32_t *q = p;
-		for (int k = 0; k < spanCount; k++) {
-			/* Sample in N words into a byte orientied buffer */
-			uint8_t *x = (uint8_t *)q;
-
-			if (ctx->wordLength == 16) {
-				/* Flush the word into the fifo MSB first */
-				int didOverflow = 0;
-				rb_write_with_state(ctx->rb, ((const char *)x) + 3, 1, &didOverflow);
-				if (didOverflow) {
-					fprintf(stderr, "overflow occured.\n");
-				}
-				rb_write_with_state(ctx->rb, ((const char *)x) + 2, 1, &didOverflow);
-				if (didOverflow) {
-					fprintf(stderr, "overflow occured.\n");
-				}
-				consumed += 2;
-			} else
-			if (ctx->wordLength == 24) {
-				/* Flush the word into the fifo MSB first */
-				int didOverflow = 0;
-				rb_write_with_state(ctx->rb, ((const char *)x) + 3, 1, &didOverflow);
-				if (didOverflow) {
-					fprintf(stderr, "overflow occured.\n");
-				}
-				rb_write_with_state(ctx->rb, ((const char *)x) + 2, 1, &didOverflow);
-				if (didOverflow) {
-					fprintf(stderr, "overflow occured.\n");
-				}
-				rb_write_with_state(ctx->rb, ((const char *)x) + 1, 1, &didOverflow);
-				if (didOverflow) {
-					fprintf(stderr, "overflow occured.\n");
-				}
-				consumed += 3;
-			}
-			q++;
-		}
+static void handleCallback(struct smpte337_detector_s *ctx, uint8_t datamode, uint8_t datatype,
+	uint32_t payload_bitCount, uint8_t *payload)
+{
+	ctx->cb(ctx->cbContext, ctx, datamode, datatype, payload_bitCount, payload);
+}
 
-		p += (frameStrideBytes / sizeof(uint32_t));
-	}
-	return consumed;
+static __inline__ uint32_t word32(const uint8_t *p)
+{
+	return *(const uint32_t *)p;
 }
 
-static int smpte337_detector_hunt_syncwords(struct smpte337_detector_s *ctx, uint8_t *buf,
-	uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame,
-	uint32_t frameStrideBytes,
+/* span[1] may be NULL, in which case only single channel streams are hunted for. */
+static int smpte337_detector_hunt_syncwords(struct smpte337_detector_s *ctx, const uint8_t **span,
+	uint32_t audioFrames, uint32_t stepBytes,
 	uint32_t spanCount, uint32_t *actualSpanCount)
 {
 	if (spanCount == 1) {
-		uint32_t *p = (uint32_t *)buf;
-		for (int i = 0; i < audioFrames - 1; i++) {
+		for (uint32_t i = 0; i + 1 < audioFrames; i++) {
+			/* Skip straight to the next word that could be a Pa. */
+			i += sdiaudio_find_syncword_32b(span[0] + (i * stepBytes), audioFrames - 1 - i, stepBytes);
+			if (i + 1 >= audioFrames)
+				break;
 
 /* Customer streams show the data spacs a single channel. */
-			uint32_t Pa = *p;
-			uint32_t Pb = *(p + (frameStrideBytes / sizeof(uint32_t)));
+			uint32_t Pa = word32(span[0] + (i * stepBytes));
+			uint32_t Pb = word32(span[0] + ((i + 1) * stepBytes));
 
 #if 0
 			if (Pa || Pb || Pn)
@@ -173,21 +157,21 @@ static int smpte337_detector_hunt_syncwords(struct smpte337_detector_s *ctx, uin
 				*actualSpanCount = 1;
 				return 24;
 			}
-
-			p += (frameStrideBytes / sizeof(uint32_t));
 		}
 	}
 
 	spanCount++;
-	if (spanCount == 2) {
+	if (spanCount == 2 && span[1]) {
 /* MRD4400 outputs the bitstream across both channels. */
 /* Eg.. 00 00 72 f8 00 00 1f 4e */
-		uint32_t *p = (uint32_t *)buf;
-		for (int i = 0; i < audioFrames - 1; i++) {
+		for (uint32_t i = 0; i + 1 < audioFrames; i++) {
+			i += sdiaudio_find_syncword_32b(span[0] + (i * stepBytes), audioFrames - 1 - i, stepBytes);
+			if (i + 1 >= audioFrames)
+				break;
 
 /* Customer streams show the data spacs a single channel. */
-			uint32_t Pa = *p;
-			uint32_t Pb = *(p + 1);
+			uint32_t Pa = word32(span[0] + (i * stepBytes));
+			uint32_t Pb = word32(span[1] + (i * stepBytes));
 
 #if 0
 			if (Pa || Pb)
@@ -206,159 +190,345 @@ static int smpte337_detector_hunt_syncwords(struct smpte337_detector_s *ctx, uin
 				*actualSpanCount = 2;
 				return 24;
 			}
-
-			p += (frameStrideBytes / sizeof(uint32_t));
 		}
 	}
 
 	return 0;
 }
 
-static void run_detector(struct smpte337_detector_s *ctx)
+/* Room for a burst of bytes in the carry buffer, grown outside real-time mode. */
+static int carry_reserve(struct smpte337_detector_s *ctx, size_t bytes)
 {
-	int skipped = 0;
-
-#define PEEK_LEN 16
-	uint8_t dat[PEEK_LEN];
-	while(1) {
-		if (rb_used(ctx->rb) < PEEK_LEN)
-			break;
-
-		if (rb_peek(ctx->rb, (char *)&dat[0], PEEK_LEN) < PEEK_LEN)
-			break;
-
-		/* Find the supported patterns - In this case, AC3 only in 16bit mode */
-		/* See SMPTE 337M 2015 spec table 6.
-		 * Pa = dat0/1
-		 * Pb = dat2/3 ... etc
-		 */
-		if (dat[0] == 0x96 && dat[1] == 0xf8 && dat[2] == 0x72 && dat[3] == 0xa5 && dat[4] == 0x4e && dat[5] == 0x1f) {
-			/* Confirmed.... pa = 24bit, pb = 24bit */
-#if 1
-			for (int h = 0; h < 12; h++)
-				printf("%02x ", dat[h]);
-			printf("\n");
-
-			printf("mode = %d, type = %d\n", (dat[8] >> 5) & 0x03, (dat[8] & 0x1f));
-#endif
-			/* Check the burst_info.... Make sure we find AC3 */
-			//if ((dat[8] & 0x1f) == 0x01)
-			if (1)
-			{
-				/* Bits 0-4 datatype, 1 = AC3 */
-				/* Bits 5-6 datamode, 2 = 24bit */
-				/* Bits   7 errorflg, 0 = no error */
-				uint32_t payload_bitCount = (dat[9] << 16) | dat[10] << 8 | dat[11];
-				uint32_t payload_byteCount = payload_bitCount / 8;
-printf("bitcount = %d\n", payload_bitCount);
-				
-				if (rb_used(ctx->rb) >= (12 + payload_byteCount)) {
-					char *payload = NULL;
-					size_t l = rb_read_alloc(ctx->rb, &payload, 12 + payload_byteCount);
-					if (l != (12 + payload_byteCount)) {
-						fprintf(stderr, "[smpte337_detector] Warning, rb read failure.\n");
-
-						/* Intensionally flush the ring and start acquisition again. */
-						rb_empty(ctx->rb);
-					} else {
-						handleCallback(ctx, (dat[8] >> 5) & 0x03, dat[8] & 0x1f,
-							payload_bitCount, (uint8_t *)payload + 12);
-					}
-					if (payload)
-						free(payload);
-				} else {
-					/* Not enough data in the ring buffer, come back next time. */
-					break;
-				}
-
-			} else {
-				fprintf(stderr, "[smpte337_detector] Does not support datatype 0x%02x in %d bit words, skipping.\n",
-					dat[7] & 0x1f, ctx->wordLength);
-				rb_discard(ctx->rb, 1); /* Pop a byte, and continue the search */
-				skipped++;
+	if (bytes <= ctx->carrySize)
+		return 0;
+	if (ctx->realtime || bytes > CARRY_MAX)
+		return -1;
+
+	size_t size = ctx->carrySize ? ctx->carrySize : CARRY_INITIAL;
+	while (size < bytes)
+		size *= 2;
+	if (size > CARRY_MAX)
+		size = CARRY_MAX;
+
+	uint8_t *p = ltnsdi_pool_realloc(ctx->carry, size);
+	if (!p)
+		return -1;
+
+	ctx->carry = p;
+	ctx->carrySize = size;
+	return 0;
+}
+
+/* Pa through Pd, the burst header, is four words. */
+static __inline__ size_t header_bytes(uint32_t wordLength)
+{
+	return wordLength / 2;
+}
+
+/* Decode the burst_info (Pc) and length code (Pd) of a header, returns the bytes of the whole burst.
+ * See SMPTE 337M 2015 table 6. Bits 0-4 datatype, 5-6 datamode, 7 errorflag.
+ */
+static size_t burst_info(const uint8_t *h, uint32_t wordLength, uint32_t *Pc, uint32_t *payload_bitCount)
+{
+	if (wordLength == 24) {
+		*Pc = (h[6] << 16) | (h[7] << 8) | h[8];
+		*payload_bitCount = (h[9] << 16) | (h[10] << 8) | h[11];
+	} else
+	if (wordLength == 20) {
+		/* Pc and Pd share byte 7. */
+		*Pc = (h[5] << 12) | (h[6] << 4) | (h[7] >> 4);
+		*payload_bitCount = ((h[7] & 0x0f) << 16) | (h[8] << 8) | h[9];
+	} else {
+		*Pc = (h[4] << 8) | h[5];
+		*payload_bitCount = (h[6] << 8) | h[7];
+	}
+
+	return header_bytes(wordLength) + (*payload_bitCount / 8);
+}
+
+static void burst_complete(struct smpte337_detector_s *ctx, uint8_t *burst, uint32_t wordLength)
+{
+	uint32_t Pc, payload_bitCount;
+	burst_info(burst, wordLength, &Pc, &payload_bitCount);
+
+	handleCallback(ctx, (Pc >> 5) & 0x03, Pc & 0x1f, payload_bitCount, burst + header_bytes(wordLength));
+}
+
+/* How far from where it's due a tracked burst may start, twice the jitter seen so far, and a couple of words. */
+#define TRACK_SLACK 16
+
+static __inline__ uint64_t track_window(struct smpte337_detector_s *ctx)
+{
+	return (uint64_t)(2 * ctx->jitterBytes) + TRACK_SLACK;
+}
+
+/* Measure the period up to a burst starting at byte at of the stream, tracking once successive periods agree. */
+static void burst_found(struct smpte337_detector_s *ctx, uint64_t at)
+{
+	if (ctx->bursts++ && at > ctx->lastBurst) {
+		uint64_t period = at - ctx->lastBurst;
+		if (ctx->periodBytes) {
+			double d = period > ctx->periodBytes ? period - ctx->periodBytes : ctx->periodBytes - period;
+			ctx->tracking = d <= track_window(ctx);
+
+			/* As RFC 3550 interarrival jitter, a sixteenth of each new deviation. */
+			ctx->jitterBytes += (d - ctx->jitterBytes) / 16;
+		}
+		ctx->periodBytes = period;
+	}
+	ctx->lastBurst = at;
+}
+
+/* Find and deliver every burst in the next bytes of the packed stream. Bursts lying wholly
+ * within buf are handed to the callback in place. Only the end of buf is ever copied, into
+ * the carry buffer: the start of a burst that continues into the next write, or the last few
+ * bytes, which could begin a preamble.
+ */
+static void smpte337_detector_parse_stream(struct smpte337_detector_s *ctx, uint8_t *buf, size_t bytes,
+	uint32_t wordLength)
+{
+	size_t hdr = header_bytes(wordLength);
+	size_t pos = 0;
+
+	/* A preamble may have begun in the last few bytes of the previous write, look across the join. */
+	if (ctx->carryUsed && !ctx->burstBytes) {
+		uint8_t join[2 * 12];
+		size_t tail = ctx->carryUsed;
+		size_t n = bytes < hdr ? bytes : hdr;
+		memcpy(join, ctx->carry, tail);
+		memcpy(join + tail, buf, n);
+		ctx->carryUsed = 0;
+
+		size_t o = sdiaudio_find_preamble(join, tail + n, wordLength);
+		if (o < tail && o + hdr <= tail + n) {
+			uint32_t Pc, payload_bitCount;
+			size_t burst = burst_info(join + o, wordLength, &Pc, &payload_bitCount);
+			if (carry_reserve(ctx, burst) == 0) {
+				burst_found(ctx, ctx->streamBytes - tail + o);
+				memcpy(ctx->carry, join + o, hdr);
+				ctx->carryUsed = hdr;
+				ctx->burstBytes = burst;
+				pos = o + hdr - tail;
 			}
 		} else
-		if (dat[0] == 0xF8 && dat[1] == 0x72 && dat[2] == 0x4e && dat[3] == 0x1f) {
-			/* Confirmed.... pa = 16bit, pb = 16bit */
-
-			/* Check the burst_info.... */
-			//if ((dat[5] & 0x1f) == 0x01)
-			if (1)
-			{
-				/* Bits 0-4 datatype, 1 = AC3 */
-				/* Bits 5-6 datamode, 0 = 16bit */
-				/* Bits   7 errorflg, 0 = no error */
-				uint32_t payload_bitCount = (dat[6] << 8) | dat[7];
-				uint32_t payload_byteCount = payload_bitCount / 8;
-				
-				if (rb_used(ctx->rb) >= (8 + payload_byteCount)) {
-					char *payload = NULL;
-					size_t l = rb_read_alloc(ctx->rb, &payload, 8 + payload_byteCount);
-					if (l != (8 + payload_byteCount)) {
-						fprintf(stderr, "[smpte337_detector] Warning, rb read failure.\n");
-
-						/* Intensionally flush the ring and start acquisition again. */
-						rb_empty(ctx->rb);
-					} else {
-						handleCallback(ctx, (dat[5] >> 5) & 0x03, dat[5] & 0x1f,
-							payload_bitCount, (uint8_t *)payload + 8);
-					}
-					if (payload)
-						free(payload);
-				} else {
-					/* Not enough data in the ring buffer, come back next time. */
-					break;
-				}
-
-			} else {
-				fprintf(stderr, "[smpte337_detector] Does not support datatype 0x%02x in %d bit words, skipping.\n",
-					dat[5] & 0x1f, ctx->wordLength);
-				rb_discard(ctx->rb, 1); /* Pop a byte, and continue the search */
-				skipped++;
+		if (bytes < hdr) {
+			/* Too little was written to tell, keep the lot. */
+			size_t keep = tail + n < hdr - 1 ? tail + n : hdr - 1;
+			memcpy(ctx->carry, join + tail + n - keep, keep);
+			ctx->carryUsed = keep;
+			return;
+		}
+	}
+
+	while (1) {
+		if (ctx->burstBytes) {
+			/* Complete the burst being assembled in the carry buffer. */
+			size_t n = ctx->burstBytes - ctx->carryUsed;
+			if (n > bytes - pos)
+				n = bytes - pos;
+			memcpy(ctx->carry + ctx->carryUsed, buf + pos, n);
+			ctx->carryUsed += n;
+			pos += n;
+			if (ctx->carryUsed < ctx->burstBytes)
+				return;
+
+			burst_complete(ctx, ctx->carry, wordLength);
+			ctx->carryUsed = 0;
+			ctx->burstBytes = 0;
+		}
+
+		/* Bursts arriving steadily, only look where the next is due, skipping everything before it. */
+		size_t start = pos, end = bytes;
+		if (ctx->tracking) {
+			uint64_t window = track_window(ctx);
+			uint64_t due = ctx->lastBurst + ctx->periodBytes;
+			uint64_t first = due > window ? due - window : 0;
+			uint64_t last = due + window + hdr;
+			if (first >= ctx->streamBytes + bytes) {
+				/* Not due in this write. */
+				ctx->carryUsed = 0;
+				return;
 			}
-		} else {
-			rb_discard(ctx->rb, 1); /* Pop a byte, and continue the search */
-			skipped++;
+			if (first > ctx->streamBytes + pos)
+				pos = first - ctx->streamBytes;
+			if (last < ctx->streamBytes + bytes)
+				end = last > ctx->streamBytes + pos ? last - ctx->streamBytes : pos;
+		}
+
+		size_t o = pos + sdiaudio_find_preamble(buf + pos, end - pos, wordLength);
+		if (o + hdr > end && end < bytes) {
+			/* Not where it was due, hunt through everything again. */
+			ctx->tracking = 0;
+			ctx->mispredictions++;
+			pos = start;
+			continue;
+		}
+		if (o + hdr > bytes) {
+			/* No more headers, keep whatever could yet begin one. */
+			size_t keep = bytes - pos < hdr - 1 ? bytes - pos : hdr - 1;
+			memcpy(ctx->carry, buf + bytes - keep, keep);
+			ctx->carryUsed = keep;
+			return;
 		}
 
-	} /* while */
+		uint32_t Pc, payload_bitCount;
+		size_t burst = burst_info(buf + o, wordLength, &Pc, &payload_bitCount);
+		if (o + burst <= bytes) {
+			burst_found(ctx, ctx->streamBytes + o);
+			burst_complete(ctx, buf + o, wordLength);
+			pos = o + burst;
+			continue;
+		}
+
+		if (carry_reserve(ctx, burst) < 0) {
+			detector_log(ctx, stderr, "[smpte337_detector] Warning, %zu byte burst is too large, skipping.\n", burst);
+			pos = o + 1;
+			continue;
+		}
+
+		/* Continues into the next write. */
+		burst_found(ctx, ctx->streamBytes + o);
+		memcpy(ctx->carry, buf + o, hdr);
+		ctx->carryUsed = hdr;
+		ctx->burstBytes = burst;
+		pos = o + hdr;
+	}
 }
 
-size_t smpte337_detector_write(struct smpte337_detector_s *ctx, uint8_t *buf,
-	uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame,
-	uint32_t frameStrideBytes)
+static void smpte337_detector_parse(struct smpte337_detector_s *ctx, uint8_t *buf, size_t bytes,
+	uint32_t wordLength)
 {
-	if ((!buf) || (!audioFrames) || (!channelsPerFrame) || (!frameStrideBytes) ||
-		((sampleDepth != 16) && (sampleDepth != 32))) {
-		return 0;
+	smpte337_detector_parse_stream(ctx, buf, bytes, wordLength);
+	ctx->streamBytes += bytes;
+}
+
+int smpte337_detector_period(struct smpte337_detector_s *ctx, double *periodFrames, double *jitterFrames,
+	uint64_t *mispredictions)
+{
+	double bitsPerFrame = ctx->wordLength * ctx->spanCount;
+
+	*periodFrames = bitsPerFrame ? (ctx->periodBytes * 8) / bitsPerFrame : 0;
+	*jitterFrames = bitsPerFrame ? (ctx->jitterBytes * 8) / bitsPerFrame : 0;
+	*mispredictions = ctx->mispredictions;
+
+	return ctx->tracking;
+}
+
+/* The samplers below don't care how the audio is laid out. Word k of the span
+ * in frame i lives at span[k] + (i * stepBytes). For interleaved buffers span[1]
+ * is simply the next channel in the frame, for planar buffers it's the next
+ * channel's plane and stepBytes is the word size, unit stride.
+ */
+
+/* Frames packed at a time, 2048 frames of 24bit words spanning two channels is 12KB. */
+#define PACK_FRAMES 2048
+#define PACK_BYTES ((PACK_FRAMES * 2 * 3) + 1)
+
+/* Pack the words of a whole packet into the MSB first byte stream, PACK_BYTES at a time,
+ * then parse them where they lie.
+ */
+static size_t smpte337_detector_pack(struct smpte337_detector_s *ctx, const uint8_t **span,
+	uint32_t audioFrames, uint32_t sampleDepth, uint32_t stepBytes, uint32_t spanCount, uint8_t *packed)
+{
+	size_t consumed = 0;
+
+	for (uint32_t i = 0; i < audioFrames; i += PACK_FRAMES) {
+		uint32_t frames = audioFrames - i < PACK_FRAMES ? audioFrames - i : PACK_FRAMES;
+		const uint8_t *s[2] = { span[0] + (i * stepBytes), spanCount > 1 ? span[1] + (i * stepBytes) : NULL };
+
+		size_t bytes;
+		if (sampleDepth == 16)
+			bytes = sdiaudio_pack_words_16b(packed, s, spanCount, frames, stepBytes);
+		else
+			bytes = sdiaudio_pack_words_32b(packed, s, spanCount, frames, stepBytes, ctx->wordLength, &ctx->nibble);
+
+		/* 16bit samples only carry 16bit words. */
+		smpte337_detector_parse(ctx, packed, bytes, sampleDepth == 16 ? 16 : ctx->wordLength);
+		consumed += bytes;
 	}
+	return consumed;
+}
 
+/* 16bit samples can only carry 16bit words, span[1] may be NULL. */
+static int smpte337_detector_hunt_syncwords_16b(struct smpte337_detector_s *ctx, const uint8_t **span,
+	uint32_t audioFrames, uint32_t stepBytes,
+	uint32_t spanCount, uint32_t *actualSpanCount)
+{
+	for (int i = 0; i < audioFrames - 1; i++) {
+		uint16_t Pa = *(const uint16_t *)(span[0] + (i * stepBytes));
+		if (Pa != 0xf872)
+			continue;
+
+		if (spanCount == 1 && *(const uint16_t *)(span[0] + ((i + 1) * stepBytes)) == 0x4e1f) {
+			*actualSpanCount = 1;
+			return 16;
+		}
+		if (span[1] && *(const uint16_t *)(span[1] + (i * stepBytes)) == 0x4e1f) {
+			*actualSpanCount = 2;
+			return 16;
+		}
+	}
+
+	return 0;
+}
+
+static size_t smpte337_detector_write_span(struct smpte337_detector_s *ctx, const uint8_t **huntSpan, const uint8_t **span,
+	uint32_t audioFrames, uint32_t sampleDepth, uint32_t stepBytes, int huntWords16)
+{
 	if (ctx->wordLength == 0) {
 		uint32_t asc = 0;
-		int ret = smpte337_detector_hunt_syncwords(ctx, buf, audioFrames, sampleDepth,
-			channelsPerFrame, frameStrideBytes, ctx->spanCount, &asc);
-		if (ret > 0) {
+		int ret;
+		if (huntWords16)
+			ret = smpte337_detector_hunt_syncwords_16b(ctx, huntSpan, audioFrames, stepBytes, ctx->spanCount, &asc);
+		else
+			ret = smpte337_detector_hunt_syncwords(ctx, huntSpan, audioFrames, stepBytes, ctx->spanCount, &asc);
+		if (ret > 0 && !ctx->carry)
+			carry_reserve(ctx, CARRY_INITIAL);
+		if (ret > 0 && ctx->carry) {
 			ctx->wordLength = ret;
 			ctx->spanCount = asc;
-			printf("Syncronized with %dbit words, spancount = %d\n", ctx->wordLength, ctx->spanCount);
 		}
 	}
 
 	if (ctx->wordLength == 0)
 		return 0;
 
-	size_t ret = 0;
-	if (sampleDepth == 16) {
-		ret = smpte337_detector_write_16b(ctx, buf, audioFrames, sampleDepth,
-			channelsPerFrame, frameStrideBytes, ctx->spanCount);
-	} else
-	if (sampleDepth == 32) {
-		ret = smpte337_detector_write_32b(ctx, buf, audioFrames, sampleDepth,
-			channelsPerFrame, frameStrideBytes, ctx->spanCount);
+	/* Locked to a stream spanning two channels, but we weren't given the second. */
+	if (ctx->spanCount > 1 && !span[1])
+		return 0;
+
+	/* Packed into the caller's buffer in real-time mode, otherwise on the stack. */
+	if (ctx->payloadSize >= PACK_BYTES)
+		return smpte337_detector_pack(ctx, span, audioFrames, sampleDepth, stepBytes, ctx->spanCount, ctx->payload);
+
+	uint8_t packed[PACK_BYTES];
+	return smpte337_detector_pack(ctx, span, audioFrames, sampleDepth, stepBytes, ctx->spanCount, packed);
+}
+
+size_t smpte337_detector_write(struct smpte337_detector_s *ctx, uint8_t *buf,
+	uint32_t audioFrames, uint32_t sampleDepth, uint32_t channelsPerFrame,
+	uint32_t frameStrideBytes)
+{
+	if ((!buf) || (!audioFrames) || (!channelsPerFrame) || (!frameStrideBytes) ||
+		((sampleDepth != 16) && (sampleDepth != 32))) {
+		return 0;
+	}
+
+	/* The interleaved syncword hunt has always compared 32bit words, the samplers step by the sample size. */
+	const uint8_t *huntSpan[2] = { buf, buf + sizeof(uint32_t) };
+	const uint8_t *span[2] = { buf, buf + (sampleDepth / 8) };
+
+	return smpte337_detector_write_span(ctx, huntSpan, span, audioFrames, sampleDepth, frameStrideBytes, 0);
+}
+
+size_t smpte337_detector_write_planar(struct smpte337_detector_s *ctx, const uint8_t *plane, const uint8_t *nextPlane,
+	uint32_t audioFrames, uint32_t sampleDepth)
+{
+	if ((!plane) || (!audioFrames) || ((sampleDepth != 16) && (sampleDepth != 32))) {
+		return 0;
 	}
 
-	/* Now all the fifo contains byte stream re-ordered data, run the detector. */
-	run_detector(ctx);
+	const uint8_t *span[2] = { plane, nextPlane };
 
-	return ret;
+	return smpte337_detector_write_span(ctx, span, span, audioFrames, sampleDepth, sampleDepth / 8, sampleDepth == 16);
 }
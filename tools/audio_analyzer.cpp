@@ -182,7 +182,7 @@ static void sdi_monitor_stats_dump_curses()
 		return;
 	}
 
-	for (int i = 0; i < g_supportedAudioChannelCount; i++) {
+	for (uint32_t i = 0; i < status->channelCount; i++) {
 		if (status->channels[i].channelNumber == 1)
 			linecount++;
 
@@ -235,9 +235,23 @@ static void sdi_monitor_stats_dump_curses()
 	mvprintw(linecount++, 0, "    4  3: UNUSED");
 #endif
 	}
+	linecount++;
+	if (status->async.enabled) {
+		mvprintw(linecount++, 0, "Async queue: depth %u/%u (peak %u)  queued %" PRIu64 "  dropped %" PRIu64,
+			status->async.depth, status->async.slots, status->async.depthHighWater,
+			status->async.enqueued, status->async.dropped);
+	}
+	if (status->load.enabled) {
+		mvprintw(linecount++, 0, "Load: shed level %u  last %" PRIu64 "us of %" PRIu64 "us (peak %" PRIu64 "us)  overruns %" PRIu64,
+			status->load.level, status->load.lastUs, status->load.budgetUs, status->load.peakUs,
+			status->load.overruns);
+	}
+	mvprintw(linecount++, 0, "Memory: %" PRIu64 "KB  (SMPTE 337 detectors %" PRIu64 "KB, %u carry buffers)",
+		status->memory.totalBytes / 1024, status->memory.detectorBytes / 1024, status->memory.detectorBuffers);
+	if (status->realtime.enabled)
+		mvprintw(linecount++, 0, "Real-time: %" PRIu64 "KB locked", status->realtime.lockedBytes / 1024);
 	ltnsdi_status_free(g_sdi_ctx, status);
 
-	linecount++;
 	attron(COLOR_PAIR(2));
         //mvprintw(linecount++, 0, "q)uit r)eset e)xpand E)xpand all");
 	mvprintw(linecount++, 0, "q)uit r)eset missing");
@@ -276,8 +290,8 @@ static void sdi_monitor_stats_dump()
 	printf("LTNSDI_AUDIO_ANALYZER (%s)\n", g_hostname);
 	printf(" Pair  Channel  Len           \n");
 	printf("   Nr       Nr  bit Type           Description   Buffers  LastBuffer           Payload                    dbFS Mode Type Description\n");
-	for (int i = 0; i < g_supportedAudioChannelCount; i++) {
-		printf("    %d       %2d   %2d 0x%02x  %20s  %8" PRIu64 "  %s  %s %s     %d    %d %s  missing: %d\n",
+	for (uint32_t i = 0; i < status->channelCount; i++) {
+		printf("    %d       %2d   %2d 0x%02x  %20s  %8" PRIu64 "  %s  %s %s     %d    %d %s  missing: %d  period: %.1f%s mispredicted: %" PRIu64 "\n",
 			status->channels[i].LTNPairNumber,
 			status->channels[i].LTNChannelNumber,
 			status->channels[i].wordLength,
@@ -290,11 +304,29 @@ static void sdi_monitor_stats_dump()
 			status->channels[i].smpte337_dataMode,
 			status->channels[i].smpte337_dataType,
 			status->channels[i].smpte337_dataTypeDescription,
-			status->channels[i].pcm_missingAudioCount);
+			status->channels[i].pcm_missingAudioCount,
+			status->channels[i].smpte337_burstPeriod,
+			status->channels[i].smpte337_burstTracking ? " locked" : "",
+			status->channels[i].smpte337_burstMispredictions);
 
 		if (status->channels[i].channelNumber == 4)
 			printf("\n");
 	}
+	if (status->async.enabled) {
+		printf("Async queue: depth %u/%u (peak %u) queued %" PRIu64 " dropped %" PRIu64 "\n",
+			status->async.depth, status->async.slots, status->async.depthHighWater,
+			status->async.enqueued, status->async.dropped);
+	}
+	if (status->load.enabled) {
+		printf("Load: shed level %u last %" PRIu64 "us of %" PRIu64 "us (peak %" PRIu64 "us) overruns %" PRIu64 "\n",
+			status->load.level, status->load.lastUs, status->load.budgetUs, status->load.peakUs,
+			status->load.overruns);
+	}
+	printf("Memory: %" PRIu64 "KB (SMPTE 337 detectors %" PRIu64 "KB, %u carry buffers)\n",
+		status->memory.totalBytes / 1024, status->memory.detectorBytes / 1024, status->memory.detectorBuffers);
+	if (status->realtime.enabled)
+		printf("Real-time: %" PRIu64 "KB locked\n", status->realtime.lockedBytes / 1024);
+	printf("Kernels: %s\n", ltnsdi_cpu_level_name(ltnsdi_cpu_level()));
 
 	ltnsdi_status_free(g_sdi_ctx, status);
 }
@@ -585,7 +617,10 @@ static int usage(const char *progname, int status)
 #if HAVE_CURSES_H
 		"    -M              Display an interactive UI.\n"
 #endif
-		"    -Z <1-16>       Enable PCM loss detection on a channel\n"
+		"    -A <number>     Analyze audio on a background thread, queueing up to <number> packets (def: 0, inline)\n"
+		"    -B <percent>    Shed optional analysis when it takes more than <percent> of each packets duration (def: 0, never)\n"
+		"    -R              Real-time mode, analysis memory is allocated up front and locked, see RLIMIT_MEMLOCK\n"
+		"    -Z <1-64>       Enable PCM loss detection on a channel\n"
 		"    -z <number>     Couple with -Z, acceptible level of audio lost samples before reporting error, (def: 24)\n"
 		"                    Use 24 for CM5000 testing (720p59.94).\n"
 		"                    Use 48 for TestPattern testing (720p59.94).\n"
@@ -623,14 +658,26 @@ static int _main(int argc, char *argv[])
 	bool wantHelp = false;
 	bool wantDisplayModes = false;
 	HRESULT result;
-	unsigned int analyzeBitmask = 0;
+	uint64_t analyzeBitmask = 0;
 	unsigned int audioLossLimit = 24;
+	unsigned int asyncSlots = 0;
+	unsigned int loadBudget = 0;
+	int realtime = 0;
 
 	pthread_mutex_init(&sleepMutex, NULL);
 	pthread_cond_init(&sleepCond, NULL);
 
-	while ((ch = getopt(argc, argv, "?h3c:s:f:a:m:n:p:t:vV:I:i:l:LP:MSZ:z:")) != -1) {
+	while ((ch = getopt(argc, argv, "?h3A:B:c:s:f:a:m:n:p:t:vV:I:i:l:LP:MRSZ:z:")) != -1) {
 		switch (ch) {
+		case 'A':
+			asyncSlots = atoi(optarg);
+			break;
+		case 'B':
+			loadBudget = atoi(optarg);
+			break;
+		case 'R':
+			realtime = 1;
+			break;
 		case 'm':
 			g_videoModeIndex = atoi(optarg);
 			break;
@@ -666,11 +713,11 @@ static int _main(int argc, char *argv[])
 			break;
 		case 'Z':
 			v = atoi(optarg);
-			if (v < 1 || v > 16) {
-				fprintf(stderr, "Invalid argument for Z '%s': Valid values 1-16\n", optarg);
+			if (v < 1 || v > LTNSDI_AUDIO_CHANNELS_MAX) {
+				fprintf(stderr, "Invalid argument for Z '%s': Valid values 1-%d\n", optarg, LTNSDI_AUDIO_CHANNELS_MAX);
 				goto bail;
 			}
-			analyzeBitmask |= (1 << (v - 1));
+			analyzeBitmask |= (1ULL << (v - 1));
 			break;
 		case 'z':
 			audioLossLimit = atoi(optarg);
@@ -785,18 +832,34 @@ static int _main(int argc, char *argv[])
 		goto bail;
 	}
 
-	if (ltnsdi_context_alloc(&g_sdi_ctx) < 0) {
+	/* Size the analysis for however many channels the card delivers. */
+	if (ltnsdi_context_alloc_channels(&g_sdi_ctx, g_supportedAudioChannelCount) < 0) {
 		fprintf(stderr, "Error allocating a general SDI context.\n");
 		goto bail;
 	}
 
+	if (asyncSlots && ltnsdi_context_set_async(g_sdi_ctx, asyncSlots, 0) < 0) {
+		fprintf(stderr, "Error enabling asynchronous analysis.\n");
+		goto bail;
+	}
+
+	if (loadBudget && ltnsdi_context_set_load_shedding(g_sdi_ctx, loadBudget, NULL, 0) < 0) {
+		fprintf(stderr, "Error enabling load shedding.\n");
+		goto bail;
+	}
+
+	if (realtime && ltnsdi_context_set_realtime(g_sdi_ctx, 1) < 0) {
+		fprintf(stderr, "Error enabling real-time mode, it can't be combined with -B and memory must be lockable.\n");
+		goto bail;
+	}
+
 	if (g_monitor_mode)
 		ltnsdi_audio_channels_analyze_pcm_console_dump(g_sdi_ctx, 0);
 	else
 		ltnsdi_audio_channels_analyze_pcm_console_dump(g_sdi_ctx, 1);
 
 	for (int i = 0; i < g_supportedAudioChannelCount; i++) {
-		if (analyzeBitmask & (1 << i)) {
+		if (analyzeBitmask & (1ULL << i)) {
 			ltnsdi_audio_channels_analyze_pcm_enable(g_sdi_ctx, i, 1);
 			ltnsdi_audio_channels_analyze_pcm_limit(g_sdi_ctx, i, audioLossLimit);
 		}
@@ -26,8 +26,22 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
 #include <libltnsdi/ltnsdi.h>
 
+#if LTNSDI_DEMO_ALLOCATIONS
+#include "demo_allocations.h"
+#else
+/* Built into a tool without the allocation counter, nothing is ever counted. */
+static int g_countAllocations = 0;
+static unsigned int g_allocationCount = 0;
+#endif
+
 
 #define DATA_MODE_16BIT 0
 #define DATA_MODE_24BIT 2
@@ -228,22 +242,1892 @@ static int test_16bitPCM_G1C0_G1C1(struct ltnsdi_context_s *ctx)
 	return ret;
 }
 
-int demo_main(int argc, char *argv[])
+/* 16bit big endian containers, a channel only ever carrying negative samples is still PCM. */
+static int test_16bitPCM_negative(void)
 {
+	int ret = 0;
+
 	struct ltnsdi_context_s *ctx;
-	if (ltnsdi_context_alloc(&ctx) < 0) {
-		fprintf(stderr, "Error allocating a general SDI context.\n");
+	if (ltnsdi_context_alloc(&ctx) < 0)
 		return -1;
+
+	uint32_t channels = 4;
+	uint32_t audioFrames = 1600;
+	uint16_t *buf = calloc(audioFrames, channels * sizeof(uint16_t));
+	for (int j = 0; j < audioFrames; j++) {
+		uint16_t x = -((j % 1000) + 1);
+		buf[(j * channels) + 1] = (x >> 8) | (x << 8);
 	}
-	printf("Allocated a SDI helper context.\n");
 
-	int results = 0;
-	//results += test_16bitPayload_in_32bit_words_G1C0(ctx);
-	//results += test_24bitPayload_in_32bit_words_G1C0(ctx);
-	results += test_16bitPCM_G1C0_G1C1(ctx);
+	/* Long enough for an empty looking channel to be flagged unused. */
+	for (int i = 0; i < 200; i++) {
+		if (ltnsdi_audio_channels_write(ctx, (uint8_t *)buf, audioFrames, 16, channels, channels * sizeof(uint16_t)) < 0)
+			ret = -1;
+	}
+
+	struct ltnsdi_status_s *status;
+	if (ltnsdi_status_alloc(ctx, &status) < 0)
+		return -1;
+	if (status->channels[1].type != 1 || status->channels[0].type == 1) {
+		fprintf(stderr, "%s() types %d %d, expected the negative channel to be PCM\n", __func__,
+			status->channels[0].type, status->channels[1].type);
+		ret = -1;
+	}
+	ltnsdi_status_free(ctx, status);
 
 	ltnsdi_context_free(ctx);
-	printf("Free'd the SDI helper context.\n");
+	free(buf);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* Replay three seconds of PCM with synthetic timestamps, far faster than real time,
+ * and make sure bitrates and channel timeouts follow the supplied clock.
+ */
+static int test_caller_timestamps(void)
+{
+	int ret = 0;
+
+	struct ltnsdi_context_s *ctx;
+	if (ltnsdi_context_alloc(&ctx) < 0)
+		return -1;
+
+	uint32_t channels = 16;
+	uint32_t wordLength = 32;
+	uint32_t stride = (wordLength / 8) * channels;
+	uint32_t audioFrames = 1600;
+	uint32_t packetsPerSecond = 30;
+
+	uint32_t *buf = calloc(audioFrames, stride);
+	for (int j = 0; j < audioFrames; j++)
+		buf[j * channels] = ((j & 0x3fff) + 1) << 16; /* Channel 0 only */
+
+	struct timeval ts = { 1000, 0 };
+	for (int i = 0; i <= packetsPerSecond * 2; i++) {
+		ts.tv_sec = 1000 + (i / packetsPerSecond);
+		ts.tv_usec = (i % packetsPerSecond) * (1000000 / packetsPerSecond);
+		if (ltnsdi_audio_channels_write_ts(ctx, (uint8_t *)buf, audioFrames, wordLength, channels, stride, &ts) < 0)
+			ret = -1;
+	}
+
+	/* A full second of 16bit samples was accounted for during second 1001. */
+	struct ltnsdi_status_s *status;
+	if (ltnsdi_status_alloc(ctx, &status) < 0)
+		return -1;
+	if (status->channels[0].type != 1 || status->channels[0].bitratePs != (packetsPerSecond * audioFrames * 16)) {
+		fprintf(stderr, "%s() expected PCM at %d b/s, got type %d at %.0f b/s\n", __func__,
+			packetsPerSecond * audioFrames * 16, status->channels[0].type, status->channels[0].bitratePs);
+		ret = -1;
+	}
+	ltnsdi_status_free(ctx, status);
+
+	/* Three seconds later, the channel has timed out. */
+	ts.tv_sec += 3;
+	ltnsdi_audio_channels_write_ts(ctx, (uint8_t *)buf, audioFrames, wordLength, channels, stride, &ts);
+	if (ltnsdi_status_alloc(ctx, &status) < 0)
+		return -1;
+	if (status->channels[0].type != 3 || status->channels[0].typeUpdated.tv_sec != ts.tv_sec) {
+		fprintf(stderr, "%s() expected channel to time out, got type %d\n", __func__, status->channels[0].type);
+		ret = -1;
+	}
+	ltnsdi_status_free(ctx, status);
+
+	free(buf);
+	ltnsdi_context_free(ctx);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+struct snapshot_reader_s
+{
+	struct ltnsdi_context_s *ctx;
+	int running;
+	int errors;
+	int reads;
+};
+
+static void *snapshot_reader_thread(void *p)
+{
+	struct snapshot_reader_s *r = (struct snapshot_reader_s *)p;
+	uint64_t last = 0;
+
+	while (__atomic_load_n(&r->running, __ATOMIC_ACQUIRE)) {
+		struct ltnsdi_status_s *status;
+		if (ltnsdi_status_alloc(r->ctx, &status) < 0) {
+			r->errors++;
+			break;
+		}
+
+		/* Channel 0 is always PCM once the first buffer lands, and its buffer count only climbs. */
+		if (status->channels[0].buffersProcessed) {
+			if (status->channels[0].type != 1 || status->channels[0].wordLength != 16 ||
+				status->channels[0].buffersProcessed < last)
+				r->errors++;
+			last = status->channels[0].buffersProcessed;
+		}
+		ltnsdi_status_free(r->ctx, status);
+		r->reads++;
+	}
+
+	return NULL;
+}
+
+/* Status readers run concurrently with the writer, and must always see a consistent snapshot. */
+static int test_status_snapshot(void)
+{
+	int ret = 0;
+
+	struct snapshot_reader_s r = { 0 };
+	if (ltnsdi_context_alloc(&r.ctx) < 0)
+		return -1;
+
+	uint32_t channels = 16;
+	uint32_t wordLength = 32;
+	uint32_t stride = (wordLength / 8) * channels;
+	uint32_t audioFrames = 1602;
+
+	uint32_t *buf = calloc(audioFrames, stride);
+	for (int j = 0; j < audioFrames; j++)
+		buf[j * channels] = ((j & 0x3fff) + 1) << 16;
+
+	r.running = 1;
+	pthread_t tid;
+	pthread_create(&tid, NULL, snapshot_reader_thread, &r);
+
+	for (int i = 0; i < 2000; i++)
+		ltnsdi_audio_channels_write(r.ctx, (uint8_t *)buf, audioFrames, wordLength, channels, stride);
+
+	__atomic_store_n(&r.running, 0, __ATOMIC_RELEASE);
+	pthread_join(tid, NULL);
+
+	if (r.errors) {
+		fprintf(stderr, "%s() %d inconsistent snapshots from %d reads\n", __func__, r.errors, r.reads);
+		ret = -1;
+	} else
+		printf("%s() passed.\n", __func__);
+
+	free(buf);
+	ltnsdi_context_free(r.ctx);
+
+	return ret;
+}
+
+/* Compare the vectorized de-interleave against a trivial reference, for awkward shapes. */
+static int test_deinterleave(void)
+{
+	int ret = 0;
+
+	uint32_t channelCounts[] = { 1, 2, 3, 4, 6, 8, 12, 13, 16 };
+	uint32_t frameCounts[] = { 1, 7, 8, 9, 1601, 1602 };
+
+	for (int x = 0; x < sizeof(channelCounts) / sizeof(channelCounts[0]); x++) {
+		for (int y = 0; y < sizeof(frameCounts) / sizeof(frameCounts[0]); y++) {
+			for (int pad = 0; pad <= 1; pad++) {
+				for (int byteSwap = 0; byteSwap <= 1; byteSwap++) {
+					uint32_t channels = channelCounts[x];
+					uint32_t audioFrames = frameCounts[y];
+					uint32_t stride = (channels + pad) * sizeof(uint32_t);
+
+					uint32_t *buf = malloc(audioFrames * stride);
+					for (int i = 0; i < audioFrames * (channels + pad); i++)
+						buf[i] = (i * 2654435761u) ^ 0x01020304;
+
+					int32_t *planes[16];
+					for (int c = 0; c < channels; c++)
+						planes[c] = malloc(audioFrames * sizeof(int32_t));
+
+					if (ltnsdi_audio_deinterleave((uint8_t *)buf, audioFrames, channels, stride, planes, byteSwap) < 0)
+						ret = -1;
+
+					for (int c = 0; c < channels; c++) {
+						for (int f = 0; f < audioFrames; f++) {
+							uint32_t v = buf[(f * (channels + pad)) + c];
+							if (byteSwap)
+								v = __builtin_bswap32(v);
+							if ((uint32_t)planes[c][f] != v) {
+								fprintf(stderr, "%s() mismatch channels %d frames %d stride %d swap %d @ c%d f%d\n",
+									__func__, channels, audioFrames, stride, byteSwap, c, f);
+								ret = -1;
+								break;
+							}
+						}
+						free(planes[c]);
+					}
+					free(buf);
+				}
+			}
+		}
+	}
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* Groups processed by helper threads must end up exactly where the inline path does. */
+static int test_worker_threads(void)
+{
+	int ret = 0;
+
+	struct ltnsdi_context_s *inl, *par;
+	if (ltnsdi_context_alloc(&inl) < 0)
+		return -1;
+	if (ltnsdi_context_alloc(&par) < 0)
+		return -1;
+	if (ltnsdi_context_set_worker_threads(par, 3) < 0) {
+		fprintf(stderr, "%s() unable to start worker threads\n", __func__);
+		return -1;
+	}
+
+	uint32_t channels = 16;
+	uint32_t wordLength = 32;
+	uint32_t stride = (wordLength / 8) * channels;
+	uint32_t audioFrames = 1601;
+
+	/* Every channel gets a different level, channels 5 and 11 stay silent. */
+	uint32_t *buf = calloc(audioFrames, stride);
+	for (int j = 0; j < audioFrames; j++) {
+		for (int c = 0; c < channels; c++) {
+			if (c == 5 || c == 11)
+				continue;
+			buf[(j * channels) + c] = (((j * (c + 1)) & 0x3fff) + c) << 16;
+		}
+	}
+
+	struct timeval ts = { 2000, 0 };
+	for (int i = 0; i < 90; i++) {
+		ts.tv_sec = 2000 + (i / 30);
+		ts.tv_usec = (i % 30) * (1000000 / 30);
+		if (ltnsdi_audio_channels_write_ts(inl, (uint8_t *)buf, audioFrames, wordLength, channels, stride, &ts) < 0)
+			ret = -1;
+		if (ltnsdi_audio_channels_write_ts(par, (uint8_t *)buf, audioFrames, wordLength, channels, stride, &ts) < 0)
+			ret = -1;
+	}
+
+	struct ltnsdi_status_s *a, *b;
+	if (ltnsdi_status_alloc(inl, &a) < 0 || ltnsdi_status_alloc(par, &b) < 0)
+		return -1;
+
+	for (int i = 0; i < channels; i++) {
+		if (a->channels[i].type != b->channels[i].type ||
+			a->channels[i].wordLength != b->channels[i].wordLength ||
+			a->channels[i].buffersProcessed != b->channels[i].buffersProcessed ||
+			a->channels[i].bitratePs != b->channels[i].bitratePs ||
+			a->channels[i].pcm_dbFS != b->channels[i].pcm_dbFS) {
+			fprintf(stderr, "%s() channel %d differs between inline and worker modes\n", __func__, i);
+			ret = -1;
+		}
+	}
+	if (a->channels[0].type != 1 || a->channels[5].type == 1) {
+		fprintf(stderr, "%s() unexpected channel types %d / %d\n", __func__,
+			a->channels[0].type, a->channels[5].type);
+		ret = -1;
+	}
+
+	ltnsdi_status_free(inl, a);
+	ltnsdi_status_free(par, b);
+
+	free(buf);
+	ltnsdi_context_free(par);
+	ltnsdi_context_free(inl);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* Buffers queued in async mode must be analyzed exactly as the inline path would,
+ * even though the caller reuses its buffer as soon as the write returns.
+ */
+static int test_async_write(void)
+{
+	int ret = 0;
+
+	struct ltnsdi_context_s *inl, *asy;
+	if (ltnsdi_context_alloc(&inl) < 0)
+		return -1;
+	if (ltnsdi_context_alloc(&asy) < 0)
+		return -1;
+	if (ltnsdi_context_set_async(asy, 64, 0) < 0) {
+		fprintf(stderr, "%s() unable to enable async mode\n", __func__);
+		return -1;
+	}
+
+	uint32_t channels = 16;
+	uint32_t wordLength = 32;
+	uint32_t stride = (wordLength / 8) * channels;
+	uint32_t audioFrames = 1600;
+	int packets = 60;
+
+	uint32_t *pattern = calloc(audioFrames, stride);
+	uint32_t *buf = calloc(audioFrames, stride);
+	for (int j = 0; j < audioFrames; j++) {
+		for (int c = 0; c < 8; c++)
+			pattern[(j * channels) + c] = (((j * (c + 3)) & 0x1fff) + 1) << 16;
+	}
+
+	struct timeval ts = { 3000, 0 };
+	for (int i = 0; i < packets; i++) {
+		ts.tv_sec = 3000 + (i / 30);
+		ts.tv_usec = (i % 30) * (1000000 / 30);
+
+		memcpy(buf, pattern, audioFrames * stride);
+		if (ltnsdi_audio_channels_write_ts(inl, (uint8_t *)buf, audioFrames, wordLength, channels, stride, &ts) < 0)
+			ret = -1;
+		if (ltnsdi_audio_channels_write_ts(asy, (uint8_t *)buf, audioFrames, wordLength, channels, stride, &ts) < 0)
+			ret = -1;
+
+		/* The library must have taken its own copy. */
+		memset(buf, 0xff, audioFrames * stride);
+	}
+
+	/* Larger than a slot, dropped rather than analyzed. */
+	uint8_t *big = calloc(3000, stride);
+	if (ltnsdi_audio_channels_write_ts(asy, big, 3000, wordLength, channels, stride, &ts) == 0)
+		ret = -1;
+	free(big);
+
+	ltnsdi_audio_channels_flush(asy);
+
+	struct ltnsdi_status_s *a, *b;
+	if (ltnsdi_status_alloc(inl, &a) < 0 || ltnsdi_status_alloc(asy, &b) < 0)
+		return -1;
+
+	for (int i = 0; i < channels; i++) {
+		if (a->channels[i].type != b->channels[i].type ||
+			a->channels[i].buffersProcessed != b->channels[i].buffersProcessed ||
+			a->channels[i].bitratePs != b->channels[i].bitratePs ||
+			a->channels[i].pcm_dbFS != b->channels[i].pcm_dbFS) {
+			fprintf(stderr, "%s() channel %d differs between inline and async modes\n", __func__, i);
+			ret = -1;
+		}
+	}
+	if (a->async.enabled || !b->async.enabled || b->async.enqueued != packets ||
+		b->async.dropped != 1 || b->async.depth != 0 || b->async.slots != 64) {
+		fprintf(stderr, "%s() unexpected queue stats, enqueued %" PRIu64 " dropped %" PRIu64 " depth %d\n", __func__,
+			b->async.enqueued, b->async.dropped, b->async.depth);
+		ret = -1;
+	}
+
+	ltnsdi_status_free(inl, a);
+	ltnsdi_status_free(asy, b);
+
+	free(buf);
+	free(pattern);
+	ltnsdi_context_free(asy);
+	ltnsdi_context_free(inl);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* A batch written with writev() must end up exactly where individual writes do. */
+static int test_writev(void)
+{
+	int ret = 0;
+
+	struct ltnsdi_context_s *one, *vec;
+	if (ltnsdi_context_alloc(&one) < 0)
+		return -1;
+	if (ltnsdi_context_alloc(&vec) < 0)
+		return -1;
+
+	uint32_t wordLength = 32;
+	int packets = 45;
+
+	/* Alternate between 16 and 8 channel packets of varying length. */
+	struct ltnsdi_audio_packet_s pkts[45];
+	for (int i = 0; i < packets; i++) {
+		struct ltnsdi_audio_packet_s *p = &pkts[i];
+
+		p->channelsPerFrame = (i & 1) ? 8 : 16;
+		p->sampleDepth = wordLength;
+		p->frameStrideBytes = p->channelsPerFrame * (wordLength / 8);
+		p->audioFrames = 1600 + (i % 3);
+		p->ts.tv_sec = 4000 + (i / 30);
+		p->ts.tv_usec = (i % 30) * (1000000 / 30);
+		p->buf = calloc(p->audioFrames, p->frameStrideBytes);
+
+		uint32_t *w = (uint32_t *)p->buf;
+		for (int j = 0; j < p->audioFrames; j++) {
+			for (int c = 0; c < p->channelsPerFrame; c += 3)
+				w[(j * p->channelsPerFrame) + c] = (uint32_t)(((j * (c + i + 1)) & 0x7fff) + 1) << 16;
+		}
+
+		if (ltnsdi_audio_channels_write_ts(one, p->buf, p->audioFrames, p->sampleDepth,
+			p->channelsPerFrame, p->frameStrideBytes, &p->ts) < 0)
+			ret = -1;
+	}
+
+	if (ltnsdi_audio_channels_writev(vec, pkts, packets) < 0)
+		ret = -1;
+
+	/* An invalid packet rejects the whole batch. */
+	struct ltnsdi_audio_packet_s bad[2] = { pkts[0], pkts[1] };
+	bad[1].channelsPerFrame = 17;
+	if (ltnsdi_audio_channels_writev(vec, bad, 2) == 0)
+		ret = -1;
+
+	struct ltnsdi_status_s *a, *b;
+	if (ltnsdi_status_alloc(one, &a) < 0 || ltnsdi_status_alloc(vec, &b) < 0)
+		return -1;
+
+	for (int i = 0; i < 16; i++) {
+		if (a->channels[i].type != b->channels[i].type ||
+			a->channels[i].buffersProcessed != b->channels[i].buffersProcessed ||
+			a->channels[i].bitratePs != b->channels[i].bitratePs ||
+			a->channels[i].pcm_dbFS != b->channels[i].pcm_dbFS) {
+			fprintf(stderr, "%s() channel %d differs between write and writev\n", __func__, i);
+			ret = -1;
+		}
+	}
+
+	ltnsdi_status_free(one, a);
+	ltnsdi_status_free(vec, b);
+
+	for (int i = 0; i < packets; i++)
+		free(pkts[i].buf);
+	ltnsdi_context_free(vec);
+	ltnsdi_context_free(one);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
 
+	return ret;
+}
+
+/* Word n of a repeating 16bit SMPTE 337 burst, in the top half of a 32bit sample. */
+static uint32_t smpte337_burst_word_16b(uint64_t n, uint32_t period, uint8_t dataType, uint16_t payloadBits)
+{
+	uint32_t k = n % period;
+	uint16_t hdr[4] = { 0xf872, 0x4e1f, (DATA_MODE_16BIT << 5) | dataType, payloadBits };
+
+	if (k < 4)
+		return (uint32_t)hdr[k] << 16;
+	if (k < 4 + (payloadBits / 16))
+		return ((k * 2654435761u) >> 7) & 0xffff0000;
 	return 0;
 }
+
+/* Planar writes must end up exactly where the same audio written interleaved does. */
+static int test_write_planar(void)
+{
+	int ret = 0;
+
+	struct ltnsdi_context_s *inl, *pla;
+	if (ltnsdi_context_alloc(&inl) < 0)
+		return -1;
+	if (ltnsdi_context_alloc(&pla) < 0)
+		return -1;
+
+	uint32_t channels = 16;
+	uint32_t stride = channels * sizeof(uint32_t);
+	uint32_t audioFrames = 1600;
+
+	uint32_t *buf = calloc(audioFrames, stride);
+	int32_t *plane[16];
+	uint8_t *planes[16];
+	for (int c = 0; c < channels; c++) {
+		plane[c] = calloc(audioFrames, sizeof(int32_t));
+		planes[c] = (uint8_t *)plane[c];
+	}
+
+	uint64_t t = 0;
+	struct timeval ts = { 5000, 0 };
+	for (int i = 0; i < 60; i++) {
+		for (int j = 0; j < audioFrames; j++, t++) {
+			uint32_t *fr = &buf[j * channels];
+			fr[0] = (((t * 7) & 0x3fff) + 1) << 16;				/* PCM */
+			fr[2] = smpte337_burst_word_16b(t, 3072, 1, 6144);		/* AC3, one channel */
+			fr[6] = smpte337_burst_word_16b(t * 2, 3072, 7, 2000);		/* AAC, spanning channels 6 and 7 */
+			fr[7] = smpte337_burst_word_16b((t * 2) + 1, 3072, 7, 2000);
+			fr[9] = (((t * 3) & 0xfff) + 1) << 16;				/* PCM */
+
+			for (int c = 0; c < channels; c++)
+				plane[c][j] = fr[c];
+		}
+
+		ts.tv_sec = 5000 + (i / 30);
+		ts.tv_usec = (i % 30) * (1000000 / 30);
+		if (ltnsdi_audio_channels_write_ts(inl, (uint8_t *)buf, audioFrames, 32, channels, stride, &ts) < 0)
+			ret = -1;
+		if (ltnsdi_audio_channels_write_planar(pla, planes, audioFrames, 32, channels, &ts) < 0)
+			ret = -1;
+	}
+
+	struct ltnsdi_status_s *a, *b;
+	if (ltnsdi_status_alloc(inl, &a) < 0 || ltnsdi_status_alloc(pla, &b) < 0)
+		return -1;
+
+	for (int i = 0; i < channels; i++) {
+		if (a->channels[i].type != b->channels[i].type ||
+			a->channels[i].wordLength != b->channels[i].wordLength ||
+			a->channels[i].buffersProcessed != b->channels[i].buffersProcessed ||
+			a->channels[i].bitratePs != b->channels[i].bitratePs ||
+			a->channels[i].smpte337_dataType != b->channels[i].smpte337_dataType ||
+			a->channels[i].pcm_dbFS != b->channels[i].pcm_dbFS) {
+			fprintf(stderr, "%s() channel %d differs between interleaved and planar writes\n", __func__, i);
+			ret = -1;
+		}
+	}
+	if (b->channels[0].type != 1 || b->channels[2].type != 2 || b->channels[6].type != 2) {
+		fprintf(stderr, "%s() unexpected channel types %d %d %d\n", __func__,
+			b->channels[0].type, b->channels[2].type, b->channels[6].type);
+		ret = -1;
+	}
+
+	ltnsdi_status_free(inl, a);
+	ltnsdi_status_free(pla, b);
+
+	for (int c = 0; c < channels; c++)
+		free(plane[c]);
+	free(buf);
+	ltnsdi_context_free(pla);
+	ltnsdi_context_free(inl);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* The same audio in every supported input format must be analyzed identically. */
+static int test_write_formats(void)
+{
+	int ret = 0;
+
+	uint32_t channels = 8;
+	uint32_t audioFrames = 1601;
+
+	/* Reference in 32bit words, using only the top 16 bits so every format carries it exactly. */
+	int32_t *ref = calloc(audioFrames, channels * sizeof(int32_t));
+	int16_t *s16 = calloc(audioFrames, channels * sizeof(int16_t));
+	uint8_t *s24 = calloc(audioFrames, (channels + 1) * 3);	/* One channel of padding per frame. */
+	float *f32 = calloc(audioFrames, channels * sizeof(float));
+
+	struct ltnsdi_context_s *ctx[4];
+	for (int k = 0; k < 4; k++) {
+		if (ltnsdi_context_alloc(&ctx[k]) < 0)
+			return -1;
+	}
+
+	uint64_t t = 0;
+	struct timeval ts = { 6000, 0 };
+	for (int i = 0; i < 60; i++) {
+		for (int j = 0; j < audioFrames; j++, t++) {
+			int32_t *fr = &ref[j * channels];
+			fr[0] = (int32_t)((uint32_t)(((t * 5) & 0x7fff) - 0x4000) << 16);	/* PCM, both signs */
+			fr[2] = smpte337_burst_word_16b(t, 3072, 1, 6144);			/* AC3 */
+			fr[5] = (int32_t)((uint32_t)((t & 0xff) + 1) << 16);			/* Quiet PCM */
+
+			for (int c = 0; c < channels; c++) {
+				int32_t x = fr[c];
+				s16[(j * channels) + c] = x >> 16;
+				uint8_t *p = &s24[(j * (channels + 1) * 3) + (c * 3)];
+				p[0] = x >> 24;
+				p[1] = x >> 16;
+				p[2] = x >> 8;
+				f32[(j * channels) + c] = (float)x / 2147483648.0f;
+			}
+		}
+
+		ts.tv_sec = 6000 + (i / 30);
+		ts.tv_usec = (i % 30) * (1000000 / 30);
+		if (ltnsdi_audio_channels_write_ts(ctx[0], (uint8_t *)ref, audioFrames, 32, channels, channels * 4, &ts) < 0 ||
+			ltnsdi_audio_channels_write_format(ctx[1], (uint8_t *)s16, audioFrames, LTNSDI_AUDIO_FORMAT_S16LE,
+				channels, channels * 2, &ts) < 0 ||
+			ltnsdi_audio_channels_write_format(ctx[2], s24, audioFrames, LTNSDI_AUDIO_FORMAT_S24BE,
+				channels, (channels + 1) * 3, &ts) < 0 ||
+			ltnsdi_audio_channels_write_format(ctx[3], (uint8_t *)f32, audioFrames, LTNSDI_AUDIO_FORMAT_F32,
+				channels, channels * 4, &ts) < 0)
+			ret = -1;
+	}
+
+	struct ltnsdi_status_s *status[4];
+	for (int k = 0; k < 4; k++) {
+		if (ltnsdi_status_alloc(ctx[k], &status[k]) < 0)
+			return -1;
+	}
+
+	for (int k = 1; k < 4; k++) {
+		for (int i = 0; i < channels; i++) {
+			if (status[0]->channels[i].type != status[k]->channels[i].type ||
+				status[0]->channels[i].wordLength != status[k]->channels[i].wordLength ||
+				status[0]->channels[i].bitratePs != status[k]->channels[i].bitratePs ||
+				status[0]->channels[i].smpte337_dataType != status[k]->channels[i].smpte337_dataType ||
+				status[0]->channels[i].pcm_dbFS != status[k]->channels[i].pcm_dbFS) {
+				fprintf(stderr, "%s() format %d channel %d differs from 32bit input\n", __func__, k, i);
+				ret = -1;
+			}
+		}
+	}
+	if (status[0]->channels[0].type != 1 || status[0]->channels[2].type != 2 || status[0]->channels[5].type != 1) {
+		fprintf(stderr, "%s() unexpected channel types\n", __func__);
+		ret = -1;
+	}
+
+	for (int k = 0; k < 4; k++) {
+		ltnsdi_status_free(ctx[k], status[k]);
+		ltnsdi_context_free(ctx[k]);
+	}
+
+	/* Full scale floats, and beyond, clamp to 0dbFS rather than wrapping negative. */
+	float loud[32];
+	for (int j = 0; j < 32; j++)
+		loud[j] = (j & 1) ? 4.0f : 1.0f;
+
+	struct ltnsdi_context_s *fctx;
+	struct ltnsdi_status_s *fs;
+	if (ltnsdi_context_alloc(&fctx) < 0)
+		return -1;
+	if (ltnsdi_audio_channels_write_format(fctx, (uint8_t *)loud, 16, LTNSDI_AUDIO_FORMAT_F32, 2, 8, NULL) < 0)
+		ret = -1;
+	if (ltnsdi_status_alloc(fctx, &fs) < 0)
+		return -1;
+	for (int c = 0; c < 2; c++) {
+		if (fs->channels[c].type != 1 || fs->channels[c].pcm_dbFS != 0.0) {
+			fprintf(stderr, "%s() channel %d expected 0dbFS, got %f\n", __func__, c, fs->channels[c].pcm_dbFS);
+			ret = -1;
+		}
+	}
+	ltnsdi_status_free(fctx, fs);
+	ltnsdi_context_free(fctx);
+
+	free(f32);
+	free(s24);
+	free(s16);
+	free(ref);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+static int test_audio_plan(void)
+{
+	int ret = 0;
+
+	/* 16 channels in 64 bytes (DeckLink), 8 in 32, and 6 channels padded out to 32 bytes. */
+	const uint32_t layouts[][2] = { { 16, 64 }, { 8, 32 }, { 6, 32 } };
+	uint32_t audioFrames = 1601;	/* Odd, so every kernel has a tail. */
+
+	for (int l = 0; l < 3; l++) {
+		uint32_t channels = layouts[l][0];
+		uint32_t stride = layouts[l][1];
+		int32_t *buf = calloc(audioFrames, stride);
+
+		struct ltnsdi_context_s *ctx[2];
+		struct ltnsdi_audio_plan_s *plan;
+		if (ltnsdi_context_alloc(&ctx[0]) < 0 || ltnsdi_context_alloc(&ctx[1]) < 0)
+			return -1;
+		if (ltnsdi_audio_plan_alloc(ctx[1], &plan, LTNSDI_AUDIO_FORMAT_S32, channels, stride) < 0)
+			return -1;
+
+		uint64_t t = 0;
+		struct timeval ts = { 7000, 0 };
+		for (int i = 0; i < 60; i++) {
+			for (int j = 0; j < audioFrames; j++, t++) {
+				int32_t *fr = &buf[j * (stride / 4)];
+				fr[0] = (int32_t)((uint32_t)(((t * 5) & 0x7fff) - 0x4000) << 16);	/* PCM */
+				fr[2] = smpte337_burst_word_16b(t, 3072, 1, 6144);			/* AC3 */
+				fr[channels - 1] = (int32_t)((uint32_t)((t & 0xff) + 1) << 16);	/* Quiet PCM */
+				if (channels > 8)
+					fr[9] = smpte337_burst_word_16b(t, 3072, 1, 6144);
+			}
+
+			ts.tv_sec = 7000 + (i / 30);
+			ts.tv_usec = (i % 30) * (1000000 / 30);
+			if (ltnsdi_audio_channels_write_ts(ctx[0], (uint8_t *)buf, audioFrames, 32, channels, stride, &ts) < 0 ||
+				ltnsdi_audio_plan_write(plan, (uint8_t *)buf, audioFrames, &ts) < 0)
+				ret = -1;
+		}
+
+		struct ltnsdi_status_s *status[2];
+		if (ltnsdi_status_alloc(ctx[0], &status[0]) < 0 || ltnsdi_status_alloc(ctx[1], &status[1]) < 0)
+			return -1;
+
+		for (int i = 0; i < channels; i++) {
+			if (status[0]->channels[i].type != status[1]->channels[i].type ||
+				status[0]->channels[i].wordLength != status[1]->channels[i].wordLength ||
+				status[0]->channels[i].bitratePs != status[1]->channels[i].bitratePs ||
+				status[0]->channels[i].smpte337_dataType != status[1]->channels[i].smpte337_dataType ||
+				status[0]->channels[i].pcm_dbFS != status[1]->channels[i].pcm_dbFS) {
+				fprintf(stderr, "%s() layout %d channel %d differs from an unplanned write\n", __func__, l, i);
+				ret = -1;
+			}
+		}
+		if (status[1]->channels[0].type != 1 || status[1]->channels[2].type != 2 ||
+			(channels > 8 && status[1]->channels[9].type != 2)) {
+			fprintf(stderr, "%s() layout %d unexpected channel types\n", __func__, l);
+			ret = -1;
+		}
+
+		ltnsdi_status_free(ctx[0], status[0]);
+		ltnsdi_status_free(ctx[1], status[1]);
+		ltnsdi_audio_plan_free(plan);
+		ltnsdi_context_free(ctx[0]);
+		ltnsdi_context_free(ctx[1]);
+		free(buf);
+	}
+
+	/* Layouts that can't be described are refused up front. */
+	struct ltnsdi_context_s *ctx;
+	struct ltnsdi_audio_plan_s *plan;
+	if (ltnsdi_context_alloc(&ctx) < 0)
+		return -1;
+	if (ltnsdi_audio_plan_alloc(ctx, &plan, LTNSDI_AUDIO_FORMAT_S32, 8, 16) == 0 ||
+		ltnsdi_audio_plan_alloc(ctx, &plan, LTNSDI_AUDIO_FORMAT_S32, 17, 68) == 0) {
+		fprintf(stderr, "%s() accepted an invalid layout\n", __func__);
+		ret = -1;
+	}
+	ltnsdi_context_free(ctx);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+static int test_cpu_level(void)
+{
+	int ret = 0;
+
+	enum ltnsdi_cpu_level_e level = ltnsdi_cpu_level();
+	if (level < LTNSDI_CPU_LEVEL_GENERIC || level > LTNSDI_CPU_LEVEL_AVX512) {
+		fprintf(stderr, "%s() level %d out of range\n", __func__, level);
+		return -1;
+	}
+
+	/* A forced level is honoured, unless the cpu can't run it. */
+	const char *force = getenv("LTNSDI_CPU_LEVEL");
+	if (force && strcmp(force, ltnsdi_cpu_level_name(level)) != 0)
+		fprintf(stderr, "%s() LTNSDI_CPU_LEVEL=%s, running %s\n", __func__, force, ltnsdi_cpu_level_name(level));
+
+	if (strcmp(ltnsdi_cpu_level_name(99), "unknown") != 0)
+		ret = -1;
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+static int test_channel_count(void)
+{
+	int ret = 0;
+
+	uint32_t channels = 64;
+	uint32_t audioFrames = 1601;
+	int32_t *buf = calloc(audioFrames, channels * sizeof(int32_t));
+
+	/* Quad link, analyzed inline and by a pool of workers. */
+	struct ltnsdi_context_s *ctx[2];
+	for (int k = 0; k < 2; k++) {
+		if (ltnsdi_context_alloc_channels(&ctx[k], channels) < 0)
+			return -1;
+	}
+	if (ltnsdi_context_set_worker_threads(ctx[1], 7) < 0)
+		ret = -1;
+
+	uint64_t t = 0;
+	struct timeval ts = { 8000, 0 };
+	for (int i = 0; i < 60; i++) {
+		for (int j = 0; j < audioFrames; j++, t++) {
+			int32_t *fr = &buf[j * channels];
+			fr[0] = (int32_t)((uint32_t)(((t * 5) & 0x7fff) - 0x4000) << 16);
+			fr[2] = smpte337_burst_word_16b(t, 3072, 1, 6144);
+			fr[41] = smpte337_burst_word_16b(t, 3072, 1, 6144);
+			fr[63] = (int32_t)((uint32_t)((t & 0xff) + 1) << 16);
+		}
+
+		ts.tv_sec = 8000 + (i / 30);
+		ts.tv_usec = (i % 30) * (1000000 / 30);
+		for (int k = 0; k < 2; k++) {
+			if (ltnsdi_audio_channels_write_ts(ctx[k], (uint8_t *)buf, audioFrames, 32, channels, channels * 4, &ts) < 0)
+				ret = -1;
+		}
+	}
+
+	/* More channels than the context was sized for. */
+	if (ltnsdi_audio_channels_write_ts(ctx[0], (uint8_t *)buf, audioFrames / 2, 32, 65, 65 * 4, &ts) == 0)
+		ret = -1;
+
+	struct ltnsdi_status_s *status[2];
+	for (int k = 0; k < 2; k++) {
+		if (ltnsdi_status_alloc(ctx[k], &status[k]) < 0)
+			return -1;
+	}
+
+	if (status[0]->channelCount != channels || status[1]->channelCount != channels)
+		ret = -1;
+
+	for (int i = 0; i < channels; i++) {
+		/* A 337 channel's pair is reported as 337 too. */
+		uint32_t expected = (i == 0 || i == 63) ? 1 : (i == 2 || i == 3 || i == 40 || i == 41) ? 2 : 3;
+		if (status[0]->channels[i].type != expected || status[1]->channels[i].type != expected ||
+			status[0]->channels[i].bitratePs != status[1]->channels[i].bitratePs) {
+			fprintf(stderr, "%s() channel %d type %d/%d expected %d\n", __func__, i,
+				status[0]->channels[i].type, status[1]->channels[i].type, expected);
+			ret = -1;
+		}
+	}
+	if (status[0]->channels[63].groupNumber != 16 || status[0]->channels[63].channelNumber != 4 ||
+		status[0]->channels[63].LTNPairNumber != 32) {
+		fprintf(stderr, "%s() channel 63 misnumbered\n", __func__);
+		ret = -1;
+	}
+
+	for (int k = 0; k < 2; k++) {
+		ltnsdi_status_free(ctx[k], status[k]);
+		ltnsdi_context_free(ctx[k]);
+	}
+	free(buf);
+
+	/* Counts are rounded up to whole groups, and bounded. */
+	struct ltnsdi_context_s *c6;
+	struct ltnsdi_status_s *s6;
+	if (ltnsdi_context_alloc_channels(&c6, 6) < 0 || ltnsdi_status_alloc(c6, &s6) < 0)
+		return -1;
+	if (s6->channelCount != 8)
+		ret = -1;
+	ltnsdi_status_free(c6, s6);
+	ltnsdi_context_free(c6);
+
+	if (ltnsdi_context_alloc_channels(&c6, 0) == 0 || ltnsdi_context_alloc_channels(&c6, LTNSDI_AUDIO_CHANNELS_MAX + 1) == 0)
+		ret = -1;
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+static int test_unused_probe(void)
+{
+	int ret = 0;
+
+	uint32_t channels = 16;
+	uint32_t audioFrames = 1601;
+	int32_t *buf = calloc(audioFrames, channels * sizeof(int32_t));
+
+	/* Fully analyzed (loss detection keeps channels from idling), the default, and probing one buffer in 8. */
+	struct ltnsdi_context_s *ctx[3];
+	for (int k = 0; k < 3; k++) {
+		if (ltnsdi_context_alloc(&ctx[k]) < 0)
+			return -1;
+	}
+	ltnsdi_audio_channels_analyze_pcm_console_dump(ctx[0], 0);
+	for (int i = 0; i < channels; i++) {
+		ltnsdi_audio_channels_analyze_pcm_limit(ctx[0], i, audioFrames);
+		ltnsdi_audio_channels_analyze_pcm_enable(ctx[0], i, 1);
+	}
+	ltnsdi_context_set_probe_interval(ctx[2], 8);
+
+	/* Channel 0 throughout, 7 and 10 wake up after a while. */
+	uint64_t t = 0;
+	struct timeval ts = { 9000, 0 };
+	for (int i = 0; i < 90; i++) {
+		for (int j = 0; j < audioFrames; j++, t++) {
+			int32_t *fr = &buf[j * channels];
+			fr[0] = (int32_t)((uint32_t)(((t * 5) & 0x7fff) - 0x4000) << 16);
+			if (i >= 40) {
+				fr[7] = (int32_t)((uint32_t)((t & 0xff) + 1) << 16);
+				fr[10] = smpte337_burst_word_16b(t, 3072, 1, 6144);
+			}
+		}
+
+		ts.tv_sec = 9000 + (i / 30);
+		ts.tv_usec = (i % 30) * (1000000 / 30);
+		for (int k = 0; k < 3; k++) {
+			if (ltnsdi_audio_channels_write_ts(ctx[k], (uint8_t *)buf, audioFrames, 32, channels, channels * 4, &ts) < 0)
+				ret = -1;
+		}
+	}
+
+	struct ltnsdi_status_s *status[3];
+	for (int k = 0; k < 3; k++) {
+		if (ltnsdi_status_alloc(ctx[k], &status[k]) < 0)
+			return -1;
+	}
+
+	for (int k = 1; k < 3; k++) {
+		for (int i = 0; i < channels; i++) {
+			if (status[0]->channels[i].type != status[k]->channels[i].type ||
+				status[0]->channels[i].wordLength != status[k]->channels[i].wordLength ||
+				status[0]->channels[i].smpte337_dataType != status[k]->channels[i].smpte337_dataType ||
+				status[0]->channels[i].pcm_dbFS != status[k]->channels[i].pcm_dbFS ||
+				(k == 1 && status[0]->channels[i].bitratePs != status[k]->channels[i].bitratePs)) {
+				fprintf(stderr, "%s() context %d channel %d differs from full analysis\n", __func__, k, i);
+				ret = -1;
+			}
+		}
+	}
+	if (status[1]->channels[7].type != 1 || status[1]->channels[10].type != 2 || status[1]->channels[4].type != 3) {
+		fprintf(stderr, "%s() unexpected channel types\n", __func__);
+		ret = -1;
+	}
+
+	for (int k = 0; k < 3; k++) {
+		ltnsdi_status_free(ctx[k], status[k]);
+		ltnsdi_context_free(ctx[k]);
+	}
+	free(buf);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* Per buffer results must agree with what the status report says once the writes are done. */
+static int test_write_results(void)
+{
+	int ret = 0;
+
+	struct ltnsdi_context_s *ctx;
+	if (ltnsdi_context_alloc(&ctx) < 0)
+		return -1;
+
+	uint32_t channels = 16;
+	uint32_t audioFrames = 1600;
+	uint32_t *buf = calloc(audioFrames, channels * sizeof(uint32_t));
+
+	struct ltnsdi_audio_results_s r;
+	uint32_t bursts = 0, changed = 0;
+
+	uint64_t t = 0;
+	struct timeval ts = { 11000, 0 };
+	for (int i = 0; i < 60; i++) {
+		for (int j = 0; j < audioFrames; j++, t++) {
+			uint32_t *fr = &buf[j * channels];
+			fr[0] = (((t * 7) & 0x3fff) + 1) << 16;				/* PCM */
+			fr[2] = smpte337_burst_word_16b(t, 3072, 1, 6144);		/* AC3 */
+		}
+
+		ts.tv_sec = 11000 + (i / 30);
+		ts.tv_usec = (i % 30) * (1000000 / 30);
+		if (ltnsdi_audio_channels_write_results(ctx, (uint8_t *)buf, audioFrames, 32, channels,
+			channels * sizeof(uint32_t), &ts, &r) < 0)
+			ret = -1;
+
+		if (r.channelCount != channels || r.channels[0].peak == 0 || (i > 2 && r.channels[2].type != 2)) {
+			fprintf(stderr, "%s() buffer %d unexpected results\n", __func__, i);
+			ret = -1;
+		}
+		if (r.channels[0].flags & LTNSDI_AUDIO_RESULT_TYPE_CHANGED)
+			changed++;
+		bursts += r.channels[2].bursts;
+	}
+
+	struct ltnsdi_status_s *status;
+	if (ltnsdi_status_alloc(ctx, &status) < 0)
+		return -1;
+
+	for (int i = 0; i < channels; i++) {
+		if (r.channels[i].type != status->channels[i].type) {
+			fprintf(stderr, "%s() channel %d type %d, status says %d\n", __func__, i,
+				r.channels[i].type, status->channels[i].type);
+			ret = -1;
+		}
+	}
+	if (changed != 1 || bursts == 0 || bursts != status->channels[2].buffersProcessed ||
+		!(r.channels[2].flags & LTNSDI_AUDIO_RESULT_SMPTE337_LOCKED) ||
+		!(r.channels[5].flags & LTNSDI_AUDIO_RESULT_IDLE)) {
+		fprintf(stderr, "%s() changed %d bursts %d (status %" PRIu64 ") flags %x %x\n", __func__, changed, bursts,
+			status->channels[2].buffersProcessed, r.channels[2].flags, r.channels[5].flags);
+		ret = -1;
+	}
+	ltnsdi_status_free(ctx, status);
+
+	/* Results can't be returned once analysis moves to another thread. */
+	ltnsdi_context_set_async(ctx, 4, 0);
+	if (ltnsdi_audio_channels_write_results(ctx, (uint8_t *)buf, audioFrames, 32, channels,
+		channels * sizeof(uint32_t), &ts, &r) == 0)
+		ret = -1;
+
+	free(buf);
+	ltnsdi_context_free(ctx);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* With housekeeping, a channel is reported lost once writes stop, without another buffer arriving. */
+static int test_housekeeping(void)
+{
+	int ret = 0;
+
+	struct ltnsdi_context_s *ctx;
+	if (ltnsdi_context_alloc(&ctx) < 0)
+		return -1;
+	if (ltnsdi_context_set_housekeeping(ctx, 5) < 0)
+		return -1;
+
+	uint32_t channels = 16;
+	uint32_t audioFrames = 1600;
+	uint32_t *buf = calloc(audioFrames, channels * sizeof(uint32_t));
+
+	/* A second of PCM on channel 0, then one silent buffer just short of the two second timeout. */
+	uint64_t t = 0;
+	struct timeval ts = { 12000, 0 };
+	for (int i = 0; i <= 30; i++) {
+		for (int j = 0; j < audioFrames; j++, t++)
+			buf[j * channels] = (i == 30) ? 0 : (((t * 7) & 0x3fff) + 1) << 16;
+
+		if (i == 30) {
+			ts.tv_sec = 12001;
+			ts.tv_usec = 950000;
+		} else
+			ts.tv_usec = i * (1000000 / 30);
+		if (ltnsdi_audio_channels_write_ts(ctx, (uint8_t *)buf, audioFrames, 32, channels, channels * 4, &ts) < 0)
+			ret = -1;
+	}
+
+	/* Stalled from here, the housekeeper has to notice on its own. */
+	uint32_t type = 0;
+	for (int i = 0; i < 200 && type != 3; i++) {
+		usleep(10 * 1000);
+		struct ltnsdi_status_s *status;
+		if (ltnsdi_status_alloc(ctx, &status) < 0)
+			return -1;
+		type = status->channels[0].type;
+		ltnsdi_status_free(ctx, status);
+	}
+	if (type != 3) {
+		fprintf(stderr, "%s() channel 0 type %d, expected it to age out\n", __func__, type);
+		ret = -1;
+	}
+
+	if (ltnsdi_context_set_housekeeping(ctx, 0) < 0)
+		ret = -1;
+
+	free(buf);
+	ltnsdi_context_free(ctx);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* Shedding must follow the configured order, back off when disabled, and never stop channels being identified. */
+static int test_load_shedding(void)
+{
+	int ret = 0;
+
+	struct ltnsdi_context_s *ctx[2];
+	for (int k = 0; k < 2; k++) {
+		if (ltnsdi_context_alloc(&ctx[k]) < 0)
+			return -1;
+	}
+
+	enum ltnsdi_shed_e dup[] = { LTNSDI_SHED_HUNT, LTNSDI_SHED_HUNT };
+	enum ltnsdi_shed_e bad[] = { LTNSDI_SHED_MAX };
+	if (ltnsdi_context_set_load_shedding(ctx[0], 50, dup, 2) == 0 || ltnsdi_context_set_load_shedding(ctx[0], 50, bad, 1) == 0) {
+		fprintf(stderr, "%s() invalid orders accepted\n", __func__);
+		ret = -1;
+	}
+
+	enum ltnsdi_shed_e order[] = { LTNSDI_SHED_PCM_DECIMATE, LTNSDI_SHED_HUNT };
+	if (ltnsdi_context_set_load_shedding(ctx[0], 1, order, 2) < 0)
+		ret = -1;
+
+	uint32_t channels = 16;
+	uint32_t audioFrames = 1600;
+	uint32_t *buf = calloc(audioFrames, channels * sizeof(uint32_t));
+
+	uint64_t t = 0;
+	struct timeval ts = { 13000, 0 };
+	for (int i = 0; i < 90; i++) {
+		for (int j = 0; j < audioFrames; j++, t++) {
+			uint32_t *fr = &buf[j * channels];
+			fr[0] = (((t * 7) & 0x3fff) + 1) << 16;				/* PCM */
+			fr[2] = smpte337_burst_word_16b(t, 3072, 1, 6144);		/* AC3 */
+		}
+
+		ts.tv_sec = 13000 + (i / 30);
+		ts.tv_usec = (i % 30) * (1000000 / 30);
+		for (int k = 0; k < 2; k++) {
+			if (ltnsdi_audio_channels_write_ts(ctx[k], (uint8_t *)buf, audioFrames, 32, channels, channels * 4, &ts) < 0)
+				ret = -1;
+		}
+
+		/* A single frame has a budget of 200ns at 1%, far less than any write takes. */
+		if (ltnsdi_audio_channels_write_ts(ctx[0], (uint8_t *)buf, 1, 32, channels, channels * 4, &ts) < 0)
+			ret = -1;
+	}
+
+	struct ltnsdi_status_s *status[2];
+	for (int k = 0; k < 2; k++) {
+		if (ltnsdi_status_alloc(ctx[k], &status[k]) < 0)
+			return -1;
+	}
+
+	uint32_t mask = 0;
+	for (int i = 0; i < status[0]->load.level && i < 2; i++)
+		mask |= 1 << order[i];
+	if (!status[0]->load.enabled || status[1]->load.enabled || status[0]->load.level > 2 ||
+		status[0]->load.shed != mask || (status[0]->load.overruns && !status[0]->load.level) ||
+		status[0]->load.peakUs < status[0]->load.lastUs) {
+		fprintf(stderr, "%s() unexpected load, level %d shed %x overruns %" PRIu64 "\n", __func__,
+			status[0]->load.level, status[0]->load.shed, status[0]->load.overruns);
+		ret = -1;
+	}
+	for (int i = 0; i < channels; i++) {
+		if (status[0]->channels[i].type != status[1]->channels[i].type) {
+			fprintf(stderr, "%s() channel %d type %d, without shedding %d\n", __func__, i,
+				status[0]->channels[i].type, status[1]->channels[i].type);
+			ret = -1;
+		}
+	}
+
+	for (int k = 0; k < 2; k++)
+		ltnsdi_status_free(ctx[k], status[k]);
+
+	/* Disabled, everything is restored. */
+	ltnsdi_context_set_load_shedding(ctx[0], 0, NULL, 0);
+	if (ltnsdi_status_alloc(ctx[0], &status[0]) < 0)
+		return -1;
+	if (status[0]->load.enabled || status[0]->load.level || status[0]->load.shed) {
+		fprintf(stderr, "%s() shedding still active once disabled\n", __func__);
+		ret = -1;
+	}
+	ltnsdi_status_free(ctx[0], status[0]);
+
+	free(buf);
+	for (int k = 0; k < 2; k++)
+		ltnsdi_context_free(ctx[k]);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* A detector only holds a carry buffer while locked to a stream, and gives it up once the channel goes unused. */
+static int test_lazy_detectors(void)
+{
+	int ret = 0;
+
+	struct ltnsdi_context_s *ctx;
+	if (ltnsdi_context_alloc(&ctx) < 0)
+		return -1;
+
+	uint32_t channels = 16;
+	uint32_t audioFrames = 1600;
+	uint32_t *buf = calloc(audioFrames, channels * sizeof(uint32_t));
+
+	/* AC3 for two seconds, silence for three, then AC3 again. */
+	uint32_t buffers[3] = { 0 }, types[3] = { 0 };
+	uint64_t bytes[3] = { 0 };
+
+	struct ltnsdi_status_s *status;
+	if (ltnsdi_status_alloc(ctx, &status) < 0)
+		return -1;
+	uint64_t idleBytes = status->memory.totalBytes;
+	if (status->memory.detectorBuffers != 0 || idleBytes == 0) {
+		fprintf(stderr, "%s() %d carry buffers allocated before any audio\n", __func__, status->memory.detectorBuffers);
+		ret = -1;
+	}
+	ltnsdi_status_free(ctx, status);
+
+	uint64_t t = 0;
+	struct timeval ts = { 14000, 0 };
+	for (int i = 0; i < 210; i++) {
+		int carrying = i < 60 || i >= 150;
+		for (int j = 0; j < audioFrames; j++, t++)
+			buf[(j * channels) + 2] = carrying ? smpte337_burst_word_16b(t, 3072, 1, 6144) : 0;
+
+		ts.tv_sec = 14000 + (i / 30);
+		ts.tv_usec = (i % 30) * (1000000 / 30);
+		if (ltnsdi_audio_channels_write_ts(ctx, (uint8_t *)buf, audioFrames, 32, channels, channels * 4, &ts) < 0)
+			ret = -1;
+
+		if (i == 59 || i == 149 || i == 209) {
+			int k = i == 59 ? 0 : i == 149 ? 1 : 2;
+			if (ltnsdi_status_alloc(ctx, &status) < 0)
+				return -1;
+			buffers[k] = status->memory.detectorBuffers;
+			bytes[k] = status->memory.totalBytes;
+			types[k] = status->channels[2].type;
+			ltnsdi_status_free(ctx, status);
+		}
+	}
+
+	if (buffers[0] != 1 || buffers[1] != 0 || buffers[2] != 1 || types[0] != 2 || types[1] != 3 || types[2] != 2 ||
+		bytes[0] <= idleBytes || bytes[1] >= bytes[0]) {
+		fprintf(stderr, "%s() carry buffers %d %d %d types %d %d %d\n", __func__, buffers[0], buffers[1], buffers[2],
+			types[0], types[1], types[2]);
+		ret = -1;
+	}
+
+	free(buf);
+	ltnsdi_context_free(ctx);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* Word n of a repeating SMPTE 337 burst of 16, 20 or 24bit words, in the top bits of a 32bit sample.
+ * The payload is a fixed byte pattern, packed MSB first across payloadWords words.
+ */
+static uint32_t smpte337_burst_word(uint64_t n, uint32_t period, uint32_t wordLength, uint8_t dataType,
+	uint32_t payloadWords)
+{
+	uint32_t k = n % period;
+	uint32_t mask = (1 << wordLength) - 1;
+	uint32_t dataMode = (wordLength - 16) / 4;
+	uint32_t hdr[4] = { 0x96f872 & mask, 0xa54e1f & mask, (dataMode << 5) | dataType, payloadWords * wordLength };
+
+	if (k < 4)
+		return hdr[k] << (32 - wordLength);
+	if (k >= 4 + payloadWords)
+		return 0;
+
+	uint32_t w = 0;
+	for (uint32_t b = 0; b < wordLength; b++) {
+		uint32_t bit = ((k - 4) * wordLength) + b;
+		uint8_t byte = ((bit / 8) * 37) + 11;
+		w = (w << 1) | ((byte >> (7 - (bit % 8))) & 1);
+	}
+	return w << (32 - wordLength);
+}
+
+/* Bursts in 16, 20 and 24bit words are found whatever the layout, a stream on one channel at an
+ * odd word offset, spanning a pair of channels, written interleaved or planar.
+ */
+static int test_smpte337_word_lengths(void)
+{
+	int ret = 0;
+
+	uint32_t channels = 16;
+	uint32_t audioFrames = 1600;
+	uint32_t period = 3072, payloadWords = 256;
+	uint32_t *buf = calloc(audioFrames, channels * sizeof(uint32_t));
+	uint32_t *pair = calloc(audioFrames, 2 * sizeof(uint32_t));
+	int32_t *plane[16];
+	uint8_t *planes[16];
+	for (int c = 0; c < channels; c++) {
+		plane[c] = calloc(audioFrames, sizeof(int32_t));
+		planes[c] = (uint8_t *)plane[c];
+	}
+
+	for (uint32_t wordLength = 16; wordLength <= 24; wordLength += 4) {
+		struct ltnsdi_context_s *inl, *pla, *stereo;
+		if (ltnsdi_context_alloc(&inl) < 0 || ltnsdi_context_alloc(&pla) < 0 || ltnsdi_context_alloc(&stereo) < 0)
+			return -1;
+
+		uint32_t expected[2] = { 0 }, found[3][2] = { { 0 } };
+		struct ltnsdi_audio_results_s r;
+
+		uint64_t t = 0;
+		struct timeval ts = { 17000, 0 };
+		for (int i = 0; i < 12; i++) {
+			for (int j = 0; j < audioFrames; j++, t++) {
+				uint32_t *fr = &buf[j * channels];
+				fr[1] = smpte337_burst_word(t + 3, period, wordLength, 1, payloadWords);		/* One channel */
+				fr[4] = smpte337_burst_word(t * 2, period, wordLength, 1, payloadWords);		/* Spanning 4 and 5 */
+				fr[5] = smpte337_burst_word((t * 2) + 1, period, wordLength, 1, payloadWords);
+
+				for (int c = 0; c < channels; c++)
+					plane[c][j] = fr[c];
+				pair[(j * 2) + 0] = fr[4];
+				pair[(j * 2) + 1] = fr[5];
+
+				/* Bursts that complete within the writes. */
+				if ((t + 3) % period == 0 && t + 4 + payloadWords <= 12 * audioFrames)
+					expected[0]++;
+				if ((t * 2) % period == 0 && (t * 2) + 4 + payloadWords <= 2 * 12 * audioFrames)
+					expected[1]++;
+			}
+
+			ts.tv_usec = i * (1000000 / 30);
+			if (ltnsdi_audio_channels_write_results(inl, (uint8_t *)buf, audioFrames, 32, channels,
+				channels * sizeof(uint32_t), &ts, &r) < 0)
+				ret = -1;
+			found[0][0] += r.channels[1].bursts;
+			found[0][1] += r.channels[4].bursts;
+
+			if (ltnsdi_audio_channels_write_planar(pla, planes, audioFrames, 32, channels, &ts) < 0)
+				ret = -1;
+
+			if (ltnsdi_audio_channels_write_results(stereo, (uint8_t *)pair, audioFrames, 32, 2,
+				2 * sizeof(uint32_t), &ts, &r) < 0)
+				ret = -1;
+			found[2][1] += r.channels[0].bursts;
+		}
+
+		struct ltnsdi_status_s *status;
+		if (ltnsdi_status_alloc(pla, &status) < 0)
+			return -1;
+		found[1][0] = status->channels[1].buffersProcessed;
+		found[1][1] = status->channels[4].buffersProcessed;
+		if (status->channels[1].wordLength != wordLength || status->channels[4].wordLength != wordLength) {
+			fprintf(stderr, "%s() %d bit words, planar status %d/%d bit words\n", __func__, wordLength,
+				status->channels[1].wordLength, status->channels[4].wordLength);
+			ret = -1;
+		}
+		ltnsdi_status_free(pla, status);
+		found[2][0] = expected[0];
+
+		for (int k = 0; k < 3; k++) {
+			if (found[k][0] != expected[0] || found[k][1] != expected[1]) {
+				fprintf(stderr, "%s() %d bit words, layout %d found %d/%d bursts, expected %d/%d\n", __func__,
+					wordLength, k, found[k][0], found[k][1], expected[0], expected[1]);
+				ret = -1;
+			}
+		}
+
+		ltnsdi_context_free(stereo);
+		ltnsdi_context_free(pla);
+		ltnsdi_context_free(inl);
+	}
+
+	for (int c = 0; c < channels; c++)
+		free(plane[c]);
+	free(pair);
+	free(buf);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* Bursts and preambles straddling writes of any size, down to a single frame, are still found. */
+static int test_smpte337_uneven_writes(void)
+{
+	int ret = 0;
+
+	uint32_t channels = 4;
+	uint32_t period = 1536, payloadWords = 512;
+	uint32_t *buf = calloc(period + 8, channels * sizeof(uint32_t));
+
+	for (uint32_t wordLength = 16; wordLength <= 24; wordLength += 4) {
+		struct ltnsdi_context_s *ctx;
+		if (ltnsdi_context_alloc(&ctx) < 0)
+			return -1;
+
+		uint32_t expected = 0, found = 0;
+		struct ltnsdi_audio_results_s r;
+
+		uint64_t t = 0;
+		struct timeval ts = { 18000, 0 };
+		for (uint32_t b = 1; b < 32; b++) {
+			/* End a write a few frames either side of each Pa, then write a single frame. */
+			uint64_t end = (b * period) + (b % 7) - 2;
+			for (int k = 0; k < 2; k++, end++) {
+				uint32_t audioFrames = end - t;
+				for (int j = 0; j < audioFrames; j++, t++) {
+					buf[(j * channels) + 1] = smpte337_burst_word(t, period, wordLength, 1, payloadWords);
+					if (t % period == 0)
+						expected++;
+				}
+
+				ts.tv_sec = 18000 + (t / 48000);
+				ts.tv_usec = ((t % 48000) * 1000000) / 48000;
+				if (ltnsdi_audio_channels_write_results(ctx, (uint8_t *)buf, audioFrames, 32, channels,
+					channels * sizeof(uint32_t), &ts, &r) < 0)
+					ret = -1;
+				found += r.channels[1].bursts;
+			}
+		}
+
+		/* The last burst began, but hasn't been completed. */
+		if (found + 1 != expected) {
+			fprintf(stderr, "%s() %d bit words, found %d bursts, expected %d\n", __func__, wordLength, found, expected - 1);
+			ret = -1;
+		}
+
+		ltnsdi_context_free(ctx);
+	}
+
+	free(buf);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* Once locked to the burst period the detector only checks where the next burst is due. It reports
+ * that period, and when the stream jumps phase it loses lock, hunts, and finds every burst regardless.
+ */
+static int test_smpte337_burst_period(void)
+{
+	int ret = 0;
+
+	uint32_t channels = 4, audioFrames = 1000;
+	uint32_t period = 1536, payloadWords = 512;
+	uint64_t jump = (60 * period) + 1000, shift = 100;
+	uint32_t *buf = calloc(audioFrames, channels * sizeof(uint32_t));
+
+	struct ltnsdi_context_s *ctx;
+	if (ltnsdi_context_alloc(&ctx) < 0)
+		return -1;
+
+	uint32_t expected = 0, found = 0;
+	struct ltnsdi_audio_results_s r;
+	struct ltnsdi_status_s *status;
+
+	uint64_t t = 0;
+	struct timeval ts = { 19000, 0 };
+	for (int i = 0; i < 150; i++) {
+		for (int j = 0; j < audioFrames; j++, t++) {
+			uint64_t n = t < jump ? t : t + shift;
+			buf[(j * channels) + 1] = smpte337_burst_word(n, period, 16, 1, payloadWords);
+			if (n % period == 3 + payloadWords)
+				expected++;
+		}
+
+		ts.tv_sec = 19000 + (t / 48000);
+		ts.tv_usec = ((t % 48000) * 1000000) / 48000;
+		if (ltnsdi_audio_channels_write_results(ctx, (uint8_t *)buf, audioFrames, 32, channels,
+			channels * sizeof(uint32_t), &ts, &r) < 0)
+			ret = -1;
+		found += r.channels[1].bursts;
+
+		/* Locked before the jump, and again by the end, having mispredicted the burst after it. */
+		if (i == 50 || i == 149) {
+			if (ltnsdi_status_alloc(ctx, &status) < 0)
+				return -1;
+			if (status->channels[1].smpte337_burstPeriod != period || !status->channels[1].smpte337_burstTracking ||
+				status->channels[1].smpte337_burstMispredictions != (i == 50 ? 0 : 1)) {
+				fprintf(stderr, "%s() after %" PRIu64 " frames, period %.1f tracking %d mispredicted %" PRIu64 "\n",
+					__func__, t, status->channels[1].smpte337_burstPeriod, status->channels[1].smpte337_burstTracking,
+					status->channels[1].smpte337_burstMispredictions);
+				ret = -1;
+			}
+			ltnsdi_status_free(ctx, status);
+		}
+	}
+
+	if (found != expected) {
+		fprintf(stderr, "%s() found %d bursts, expected %d\n", __func__, found, expected);
+		ret = -1;
+	}
+
+	ltnsdi_context_free(ctx);
+	free(buf);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* A custom analyzer, counting what it's handed per channel and checking it against what was written. */
+struct test_analyzer_channel_s
+{
+	uint32_t channelNr;
+	uint64_t blocks;
+	uint64_t frames;
+	uint64_t mismatches;
+	int32_t peak;
+	int finalized;
+};
+
+static struct test_analyzer_channel_s g_testAnalyzer[16];
+
+static int test_analyzer_init(void *userContext, uint32_t channelNr, void **channelState)
+{
+	/* Refuse a channel, to exercise the rollback. */
+	if (userContext && channelNr == *(uint32_t *)userContext)
+		return -1;
+
+	struct test_analyzer_channel_s *s = &g_testAnalyzer[channelNr];
+	memset(s, 0, sizeof(*s));
+	s->channelNr = channelNr;
+	*channelState = s;
+	return 0;
+}
+
+static void test_analyzer_block(void *channelState, const struct ltnsdi_analyzer_block_s *block)
+{
+	struct test_analyzer_channel_s *s = channelState;
+
+	s->blocks++;
+	s->frames += block->audioFrames;
+	s->peak = block->peak;
+	if (block->channelNr != s->channelNr || block->sampleDepth != 32 || block->stepBytes != 4)
+		s->mismatches++;
+
+	/* Every channel was written with the frame number, scaled by the channel number. */
+	for (uint32_t i = 0; i < block->audioFrames; i++) {
+		int32_t x = *(const int32_t *)(block->samples + (i * block->stepBytes));
+		if (x != (int32_t)(((i & 0x3ff) * (s->channelNr + 1)) << 16))
+			s->mismatches++;
+	}
+}
+
+static void test_analyzer_finalize(void *channelState, uint32_t channelNr)
+{
+	struct test_analyzer_channel_s *s = channelState;
+	s->finalized++;
+}
+
+static const struct ltnsdi_analyzer_s test_analyzer = {
+	.name = "test",
+	.init = test_analyzer_init,
+	.block = test_analyzer_block,
+	.finalize = test_analyzer_finalize,
+};
+
+/* Analyzers see the samples of exactly the channels they were added to, for every buffer, and the
+ * built in dbFS analysis carries on alongside them.
+ */
+static int test_analyzers(void)
+{
+	int ret = 0;
+
+	struct ltnsdi_context_s *ctx;
+	if (ltnsdi_context_alloc(&ctx) < 0)
+		return -1;
+
+	uint32_t channels = 16;
+	uint32_t audioFrames = 1600;
+	uint32_t *buf = calloc(audioFrames, channels * sizeof(uint32_t));
+	for (int j = 0; j < audioFrames; j++) {
+		for (int i = 0; i < channels; i++)
+			buf[(j * channels) + i] = ((j & 0x3ff) * (i + 1)) << 16;
+	}
+
+	/* Channels 1, 6 and 9, spanning three groups. A failed init on channel 9 adds nothing. */
+	uint64_t mask = (1 << 1) | (1 << 6) | (1 << 9);
+	uint32_t refuse = 9;
+	if (ltnsdi_analyzer_add(ctx, &test_analyzer, &refuse, mask) == 0 || g_testAnalyzer[1].finalized != 1 ||
+		g_testAnalyzer[6].finalized != 1 || ltnsdi_analyzer_remove(ctx, &test_analyzer, &refuse) == 0) {
+		fprintf(stderr, "%s() failed init wasn't rolled back\n", __func__);
+		ret = -1;
+	}
+
+	if (ltnsdi_analyzer_add(ctx, &test_analyzer, NULL, mask) < 0 ||
+		ltnsdi_analyzer_add(ctx, &test_analyzer, NULL, mask) == 0 ||
+		ltnsdi_analyzer_add(ctx, &test_analyzer, NULL, 1ULL << channels) == 0) {
+		fprintf(stderr, "%s() add didn't validate\n", __func__);
+		ret = -1;
+	}
+
+	struct timeval ts = { 16000, 0 };
+	for (int i = 0; i < 10; i++) {
+		ts.tv_usec = i * (1000000 / 30);
+		if (ltnsdi_audio_channels_write_ts(ctx, (uint8_t *)buf, audioFrames, 32, channels, channels * 4, &ts) < 0)
+			ret = -1;
+	}
+
+	for (int i = 0; i < channels; i++) {
+		struct test_analyzer_channel_s *s = &g_testAnalyzer[i];
+		int wanted = (mask >> i) & 1;
+		if ((wanted && (s->blocks != 10 || s->frames != 10 * audioFrames || s->mismatches || s->peak == 0)) ||
+			(!wanted && s->blocks)) {
+			fprintf(stderr, "%s() channel %d saw %" PRIu64 " blocks, %" PRIu64 " mismatches\n", __func__, i,
+				s->blocks, s->mismatches);
+			ret = -1;
+		}
+	}
+
+	struct ltnsdi_status_s *status;
+	if (ltnsdi_status_alloc(ctx, &status) < 0)
+		return -1;
+	if (status->channels[6].type != 1 || status->channels[6].pcm_dbFS >= 0.0 || status->channels[6].pcm_dbFS < -90.0) {
+		fprintf(stderr, "%s() channel 6 type %d dbFS %f\n", __func__, status->channels[6].type, status->channels[6].pcm_dbFS);
+		ret = -1;
+	}
+	ltnsdi_status_free(ctx, status);
+
+	/* Removed, each channel is finalized once and sees no more buffers. */
+	if (ltnsdi_analyzer_remove(ctx, &test_analyzer, NULL) < 0)
+		ret = -1;
+	ts.tv_sec++;
+	ltnsdi_audio_channels_write_ts(ctx, (uint8_t *)buf, audioFrames, 32, channels, channels * 4, &ts);
+	if (g_testAnalyzer[1].finalized != 1 || g_testAnalyzer[9].finalized != 1 || g_testAnalyzer[6].blocks != 10) {
+		fprintf(stderr, "%s() not finalized on removal\n", __func__);
+		ret = -1;
+	}
+
+	/* No more than LTNSDI_ANALYZERS_MAX on any channel, whatever is left is finalized with the context. */
+	uint32_t contexts[LTNSDI_ANALYZERS_MAX + 1];
+	for (int k = 0; k <= LTNSDI_ANALYZERS_MAX; k++) {
+		contexts[k] = 100 + k;
+		int r = ltnsdi_analyzer_add(ctx, &test_analyzer, &contexts[k], 1 << 2);
+		if ((k < LTNSDI_ANALYZERS_MAX && r < 0) || (k == LTNSDI_ANALYZERS_MAX && r == 0)) {
+			fprintf(stderr, "%s() analyzer %d of %d %s\n", __func__, k + 1, LTNSDI_ANALYZERS_MAX, r < 0 ? "refused" : "accepted");
+			ret = -1;
+		}
+	}
+
+	free(buf);
+	ltnsdi_context_free(ctx);
+
+	if (g_testAnalyzer[2].finalized != LTNSDI_ANALYZERS_MAX) {
+		fprintf(stderr, "%s() %d finalized with the context\n", __func__, g_testAnalyzer[2].finalized);
+		ret = -1;
+	}
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+/* In real-time mode nothing is allocated as detectors lock, lose and regain a stream, and buffers
+ * without a timestamp are stamped from the audio written rather than the clock.
+ */
+static int test_realtime(void)
+{
+#if defined(__GLIBC__)
+	int ret = 0;
+
+	struct ltnsdi_context_s *ctx;
+	if (ltnsdi_context_alloc(&ctx) < 0)
+		return -1;
+
+	struct timeval start;
+	gettimeofday(&start, NULL);
+	if (ltnsdi_context_set_realtime(ctx, 1) < 0) {
+		ltnsdi_context_free(ctx);
+		if (errno == ENOMEM || errno == EPERM) {
+			printf("%s() skipped, memory can't be locked here.\n", __func__);
+			return 0;
+		}
+		return -1;
+	}
+
+	/* Each would break a guarantee. */
+	if (ltnsdi_context_set_worker_threads(ctx, 3) == 0 || ltnsdi_context_set_housekeeping(ctx, 10) == 0 ||
+		ltnsdi_context_set_load_shedding(ctx, 50, NULL, 0) == 0) {
+		fprintf(stderr, "%s() enabled a mode real-time mode can't support\n", __func__);
+		ret = -1;
+	}
+
+	uint32_t channels = 16;
+	uint32_t audioFrames = 1600;
+	uint32_t *buf = calloc(audioFrames * 2, channels * sizeof(uint32_t));
+	int16_t *pcm = calloc(audioFrames, channels * sizeof(int16_t));
+	for (int j = 0; j < audioFrames; j++)
+		pcm[(j * channels) + 5] = j & 0x7fff;
+
+	/* AC3 for two seconds, silence for three, then AC3 again. */
+	uint32_t types[3] = { 0 };
+	struct ltnsdi_status_s *status;
+	struct timeval last = { 0, 0 };
+
+	uint64_t t = 0;
+	g_allocationCount = 0;
+	for (int i = 0; i < 210; i++) {
+		int carrying = i < 60 || i >= 150;
+		for (int j = 0; j < audioFrames; j++, t++)
+			buf[(j * channels) + 2] = carrying ? smpte337_burst_word_16b(t, 3072, 1, 6144) : 0;
+
+		g_countAllocations = 1;
+		if (ltnsdi_audio_channels_write(ctx, (uint8_t *)buf, audioFrames, 32, channels, channels * 4) < 0)
+			ret = -1;
+		g_countAllocations = 0;
+
+		if (i == 59 || i == 149 || i == 209) {
+			if (ltnsdi_status_alloc(ctx, &status) < 0)
+				return -1;
+			types[i == 59 ? 0 : i == 149 ? 1 : 2] = status->channels[2].type;
+			last = status->channels[2].lastBufferArrival;
+			ltnsdi_status_free(ctx, status);
+		}
+	}
+
+	/* Converted, and then one too large to take without growing memory. */
+	g_countAllocations = 1;
+	if (ltnsdi_audio_channels_write_format(ctx, (uint8_t *)pcm, audioFrames, LTNSDI_AUDIO_FORMAT_S16LE,
+		channels, channels * 2, NULL) < 0)
+		ret = -1;
+	int refused = ltnsdi_audio_channels_write(ctx, (uint8_t *)buf, audioFrames * 2, 32, channels, channels * 4) < 0;
+	g_countAllocations = 0;
+
+	if (g_allocationCount || !refused) {
+		fprintf(stderr, "%s() write path made %d heap allocations, oversized packet %s\n", __func__,
+			g_allocationCount, refused ? "refused" : "accepted");
+		ret = -1;
+	}
+
+	if (types[0] != 2 || types[1] != 3 || types[2] != 2) {
+		fprintf(stderr, "%s() types %d %d %d\n", __func__, types[0], types[1], types[2]);
+		ret = -1;
+	}
+
+	/* The last buffer was stamped 209 packets of audio after the mode was enabled. */
+	struct timeval elapsed;
+	timersub(&last, &start, &elapsed);
+	int64_t us = (elapsed.tv_sec * 1000000LL) + elapsed.tv_usec;
+	int64_t expected = (209LL * audioFrames * 1000000) / 48000;
+	if (us < expected || us > expected + 1000000) {
+		fprintf(stderr, "%s() last buffer stamped %" PRId64 "us in, expected %" PRId64 "us\n", __func__, us, expected);
+		ret = -1;
+	}
+
+	if (ltnsdi_status_alloc(ctx, &status) < 0)
+		return -1;
+	if (!status->realtime.enabled || status->realtime.lockedBytes < status->memory.detectorBytes ||
+		status->memory.detectorBuffers != channels) {
+		fprintf(stderr, "%s() %" PRIu64 " bytes locked, %d carry buffers\n", __func__, status->realtime.lockedBytes,
+			status->memory.detectorBuffers);
+		ret = -1;
+	}
+	ltnsdi_status_free(ctx, status);
+
+	/* Back to normal, the idle carry buffers are released and the other modes are available again. */
+	if (ltnsdi_context_set_realtime(ctx, 0) < 0 || ltnsdi_context_set_worker_threads(ctx, 3) < 0)
+		ret = -1;
+	if (ltnsdi_status_alloc(ctx, &status) < 0)
+		return -1;
+	if (status->realtime.enabled || status->realtime.lockedBytes || status->memory.detectorBuffers != 0) {
+		fprintf(stderr, "%s() still real-time after disabling, %d carry buffers\n", __func__, status->memory.detectorBuffers);
+		ret = -1;
+	}
+	ltnsdi_status_free(ctx, status);
+
+	free(pcm);
+	free(buf);
+	ltnsdi_context_free(ctx);
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+#else
+	return 0;
+#endif
+}
+
+/* Once the pool is enabled, carry buffers come from it and go back to it. Enabling is
+ * process wide, so this runs last.
+ */
+static int test_pool(void)
+{
+	int ret = 0;
+
+	struct ltnsdi_pool_stats_s before, during, after;
+	if (ltnsdi_pool_enable(LTNSDI_POOL_HUGEPAGES) < 0 || ltnsdi_pool_stats(&before) < 0)
+		return -1;
+
+	struct ltnsdi_context_s *ctx[2];
+	for (int k = 0; k < 2; k++) {
+		if (ltnsdi_context_alloc(&ctx[k]) < 0)
+			return -1;
+	}
+	ltnsdi_context_set_worker_threads(ctx[1], 3);
+
+	uint32_t channels = 16;
+	uint32_t audioFrames = 1600;
+	uint32_t *buf = calloc(audioFrames, channels * sizeof(uint32_t));
+
+	uint64_t t = 0;
+	struct timeval ts = { 15000, 0 };
+	for (int i = 0; i < 60; i++) {
+		for (int j = 0; j < audioFrames; j++, t++) {
+			uint32_t *fr = &buf[j * channels];
+			fr[2] = smpte337_burst_word_16b(t, 3072, 1, 6144);		/* AC3 */
+			fr[9] = smpte337_burst_word_16b(t + 100, 3072, 1, 6144);
+			fr[14] = smpte337_burst_word_16b(t + 200, 3072, 1, 6144);
+		}
+
+		ts.tv_sec = 15000 + (i / 30);
+		ts.tv_usec = (i % 30) * (1000000 / 30);
+		for (int k = 0; k < 2; k++) {
+			if (ltnsdi_audio_channels_write_ts(ctx[k], (uint8_t *)buf, audioFrames, 32, channels, channels * 4, &ts) < 0)
+				ret = -1;
+		}
+	}
+
+	struct ltnsdi_status_s *status;
+	for (int k = 0; k < 2; k++) {
+		if (ltnsdi_status_alloc(ctx[k], &status) < 0)
+			return -1;
+		if (status->channels[2].type != 2 || status->channels[9].type != 2 || status->channels[14].type != 2) {
+			fprintf(stderr, "%s() context %d, SMPTE 337 not detected\n", __func__, k);
+			ret = -1;
+		}
+		ltnsdi_status_free(ctx[k], status);
+	}
+
+	ltnsdi_pool_stats(&during);
+
+	free(buf);
+	for (int k = 0; k < 2; k++)
+		ltnsdi_context_free(ctx[k]);
+
+	ltnsdi_pool_stats(&after);
+
+	/* Six carry buffers, bursts are parsed where they lie rather than read into allocations. */
+	if (!during.enabled || during.arenas == 0 || during.allocations != 6 ||
+		during.cacheHits == 0 || during.bytesInUse < 6 * 8 * 1024 ||
+		after.bytesInUse != before.bytesInUse || after.allocations - before.allocations != after.frees - before.frees) {
+		fprintf(stderr, "%s() unexpected pool stats, allocations %" PRIu64 " frees %" PRIu64 " hits %" PRIu64
+			" in use %" PRIu64 " / %" PRIu64 "\n", __func__, during.allocations, during.frees, during.cacheHits,
+			during.bytesInUse, after.bytesInUse);
+		ret = -1;
+	}
+
+	if (ret == 0)
+		printf("%s() passed.\n", __func__);
+
+	return ret;
+}
+
+int demo_main(int argc, char *argv[])
+{
+	struct ltnsdi_context_s *ctx;
+	if (ltnsdi_context_alloc(&ctx) < 0) {
+		fprintf(stderr, "Error allocating a general SDI context.\n");
+		return -1;
+	}
+	printf("Allocated a SDI helper context.\n");
+
+	int results = 0;
+	//results += test_16bitPayload_in_32bit_words_G1C0(ctx);
+	//results += test_24bitPayload_in_32bit_words_G1C0(ctx);
+	results += test_16bitPCM_G1C0_G1C1(ctx);
+	results += test_16bitPCM_negative();
+#if LTNSDI_DEMO_ALLOCATIONS
+	results += test_zero_allocation_write_path(ctx);
+#endif
+	results += test_deinterleave();
+	results += test_caller_timestamps();
+	results += test_status_snapshot();
+	results += test_worker_threads();
+	results += test_async_write();
+	results += test_writev();
+	results += test_write_planar();
+	results += test_write_formats();
+	results += test_audio_plan();
+	results += test_cpu_level();
+	results += test_channel_count();
+	results += test_unused_probe();
+	results += test_write_results();
+	results += test_housekeeping();
+	results += test_load_shedding();
+	results += test_lazy_detectors();
+	results += test_realtime();
+	results += test_analyzers();
+	results += test_smpte337_word_lengths();
+	results += test_smpte337_uneven_writes();
+	results += test_smpte337_burst_period();
+	results += test_pool();
+
+	ltnsdi_context_free(ctx);
+	printf("Free'd the SDI helper context.\n");
+
+	return results < 0 ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) LiveTimeNet, Inc. 2017. All Rights Reserved.
+ *
+ * Address: LTN Global Communications, Inc.
+ *          Historic Savage Mill
+ *          Box 2020 
+ *          8600 Foundry Street
+ *          Savage, MD 20763
+ *
+ * Contact: sales@ltnglobal.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Linked into ltnsdi_demo only. Replacing the allocator globally has no place in the
+ * production tools built from the same sources.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <libltnsdi/ltnsdi.h>
+#include "demo_allocations.h"
+
+int g_countAllocations = 0;
+unsigned int g_allocationCount = 0;
+
+#if defined(__GLIBC__)
+/* Minimal malloc interposer, so tests can prove the library isn't
+ * allocating on paths that should be allocation free.
+ * Only counts while g_countAllocations is set, otherwise it's a straight passthrough.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static void allocation_counted(void)
+{
+	if (g_countAllocations)
+		__atomic_add_fetch(&g_allocationCount, 1, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size)
+{
+	allocation_counted();
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	allocation_counted();
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	allocation_counted();
+	return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	if (alignment % sizeof(void *) || (alignment & (alignment - 1)))
+		return EINVAL;
+
+	allocation_counted();
+	void *p = __libc_memalign(alignment, size);
+	if (!p)
+		return ENOMEM;
+
+	*memptr = p;
+	return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	allocation_counted();
+	return __libc_memalign(alignment, size);
+}
+#endif
+
+/* Once warmed up, the write path must not touch the heap. */
+int test_zero_allocation_write_path(struct ltnsdi_context_s *ctx)
+{
+#if defined(__GLIBC__)
+	int ret = 0;
+
+	uint32_t channels = 16;
+	uint32_t wordLength = 32;
+	uint32_t stride = (wordLength / 8) * channels;
+	uint32_t audioFrames = 1602;
+
+	uint32_t *buf = malloc(audioFrames * stride);
+	uint32_t *sample = buf;
+	for (int j = 0; j < audioFrames; j++) {
+		for (int i = 0; i < channels; i++) {
+			/* Alternate PCM and empty channels, to exercise both paths. */
+			*(sample++) = (i & 1) ? 0 : ((j & 0x7fff) << 16);
+		}
+	}
+
+	/* Warm up, let the context size itself. */
+	for (int i = 0; i < 4; i++)
+		ltnsdi_audio_channels_write(ctx, (uint8_t *)buf, audioFrames, wordLength, channels, stride);
+
+	g_allocationCount = 0;
+	g_countAllocations = 1;
+	for (int i = 0; i < 256; i++) {
+		if (ltnsdi_audio_channels_write(ctx, (uint8_t *)buf, audioFrames, wordLength, channels, stride) < 0)
+			ret = -1;
+	}
+	g_countAllocations = 0;
+
+	if (g_allocationCount) {
+		fprintf(stderr, "%s() write path made %d heap allocations, expected none.\n", __func__, g_allocationCount);
+		ret = -1;
+	} else
+		printf("%s() passed.\n", __func__);
+
+	free(buf);
+
+	return ret;
+#else
+	return 0;
+#endif
+}
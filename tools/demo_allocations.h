@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) LiveTimeNet, Inc. 2017. All Rights Reserved.
+ *
+ * Address: LTN Global Communications, Inc.
+ *          Historic Savage Mill
+ *          Box 2020 
+ *          8600 Foundry Street
+ *          Savage, MD 20763
+ *
+ * Contact: sales@ltnglobal.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef DEMO_ALLOCATIONS_H
+#define DEMO_ALLOCATIONS_H
+
+#include <libltnsdi/ltnsdi.h>
+
+/* Heap allocations made while g_countAllocations is set, counted by the interposer in demo_allocations.c. */
+extern int g_countAllocations;
+extern unsigned int g_allocationCount;
+
+int test_zero_allocation_write_path(struct ltnsdi_context_s *ctx);
+
+#endif /* DEMO_ALLOCATIONS_H */